@@ -49,6 +49,7 @@ void RendererConfig::makeDefaults()
     height = rend::DEFAULT_HEIGHT;
     pathToTheAssets = fs::system_complete(fs::current_path<fs::path>()).string();   // executable directory
     rendererMode = "software";
+    renderOptions = rend::RenderOptions();
 }
 
 void Config::parseRendererConfig()
@@ -66,6 +67,24 @@ void Config::parseRendererConfig()
     m_rendererConfig.pathToTheAssets = root.get("assets", m_rendererConfig.pathToTheAssets).asString();
     getVec3(root["campos"], m_rendererConfig.camPosition);
 
+    rend::RenderOptions &options = m_rendererConfig.renderOptions;
+    options.threads = root.get("threads", options.threads).asInt();
+    options.tileSize = root.get("tilesize", options.tileSize).asInt();
+    options.vertexCache = root.get("vertexcache", options.vertexCache).asBool();
+    options.objectBackfaces = root.get("objectbackfaces", options.objectBackfaces).asBool();
+    options.occlusionCulling = root.get("occlusionculling", options.occlusionCulling).asBool();
+    options.perspectiveSpans = root.get("perspectivespans", options.perspectiveSpans).asBool();
+    options.affineError = (float)root.get("affineerror", options.affineError).asDouble();
+    options.coverageTest = root.get("coveragetest", options.coverageTest).asBool();
+
+    std::string textureLayout = root.get("texturelayout", "linear").asString();
+    if (textureLayout == "tiled")
+        options.textureLayout = rend::Texture::TL_TILED;
+    else if (textureLayout == "linear")
+        options.textureLayout = rend::Texture::TL_LINEAR;
+    else
+        syslog << "Unknown texture layout " << textureLayout << ", linear is used" << logwarn;
+
     // check resources path
     fs::path p(m_rendererConfig.pathToTheAssets);
 
@@ -10,6 +10,7 @@
 
 #include "math/vec3.h"
 #include "rend/color.h"
+#include "rend/renderoptions.h"
 
 namespace Json
 {
@@ -32,6 +33,7 @@ struct RendererConfig
     int             height;
     std::string     pathToTheAssets;
     std::string     rendererMode;           // "software" or "opengl"
+    rend::RenderOptions renderOptions;
 
     void makeDefaults();
 };
@@ -13,6 +13,7 @@
 #include "config.h"
 #include "rendermgr.h"
 #include "resourcemgr.h"
+#include "jobsystem.h"
 #include "viewport.h"
 #include "camera.h"
 #include "sceneobject.h"
@@ -41,12 +42,18 @@ Controller::Controller(int argc, const char *argv[])
     // create main camera
     m_mainCam = std::make_shared<rend::Camera>(camPosition);
 
+    // worker threads for loading and rendering
+    m_jobs = std::make_shared<JobSystem>(m_controllerConfig->getRendererConfig().renderOptions.threads);
+
+    // textures are reordered once, when they are loaded
+    m_resourceMgr->setTextureLayout(m_controllerConfig->getRendererConfig().renderOptions.textureLayout);
+
     // notify rmgr about resource path. Thus it will can load resources from this path
     std::string resourcesPath = m_controllerConfig->getRendererConfig().pathToTheAssets;
     m_resourceMgr->addPath(resourcesPath);
 
     // load all loadable from assets path
-    m_resourceMgr->loadAllResources();
+    m_resourceMgr->loadAllResources(m_jobs.get());
 }
 
 Controller::~Controller()
@@ -76,11 +83,12 @@ std::pair<int, int> Controller::getViewportSize()
 void Controller::createRenderManager()
 {
     std::string rendererMode = m_controllerConfig->getRendererConfig().rendererMode;
+    const rend::RenderOptions &options = m_controllerConfig->getRendererConfig().renderOptions;
 
     if (rendererMode == "software")
-        m_rendmgr = std::make_shared<rend::RenderMgr>(m_mainCam, m_viewport, rend::RM_SOFTWARE);
+        m_rendmgr = std::make_shared<rend::RenderMgr>(m_mainCam, m_viewport, rend::RM_SOFTWARE, options, m_jobs);
     else if (rendererMode == "opengl")
-        m_rendmgr = std::make_shared<rend::RenderMgr>(m_mainCam, m_viewport, rend::RM_OPENGL);
+        m_rendmgr = std::make_shared<rend::RenderMgr>(m_mainCam, m_viewport, rend::RM_OPENGL, options, m_jobs);
     else
         throw ControllerException(std::string(std::string("Invalid renderer ") + rendererMode).c_str());
 
@@ -25,6 +25,7 @@ namespace base
 
 class Config;
 class ResourceMgr;
+class JobSystem;
 
 DECLARE_EXCEPTION(ControllerException)
 
@@ -36,6 +37,7 @@ class Controller
     sptr(rend::Viewport)        m_viewport;
     sptr(rend::Camera)          m_mainCam;
     sptr(ResourceMgr)           m_resourceMgr;
+    sptr(JobSystem)             m_jobs;
 
     void update();
 
@@ -24,13 +24,23 @@ sptr(Resource) DecoderImage::decode(const std::string &path)
     int w = image.width();
     int h = image.height();
 
-    std::vector<rend::Color3> pixels;
-    pixels.reserve(image.size());
+    // one channel images (height maps) keep a byte per texel
+    rend::Texture::Format format = bpp == 1 ? rend::Texture::TF_R8 : rend::Texture::TF_RGBA8;
+
+    std::vector<uint8_t> data(w * h * rend::Texture::BytesPerTexel(format));
+    uint8_t *values = data.data();
+    uint32_t *texels = reinterpret_cast<uint32_t *>(data.data());
 
     for (int j = 0; j < h; j++)
     {
         for (int i = 0; i < w; i++)
         {
+            if (format == rend::Texture::TF_R8)
+            {
+                *values++ = (uint8_t)image(i, j, 0, 0);
+                continue;
+            }
+
 #ifdef _WIN32
             // swap r and b
             // something wrong with SetDIBitsToDevice
@@ -40,11 +50,13 @@ sptr(Resource) DecoderImage::decode(const std::string &path)
 #else
 #error "Unsupported OS."
 #endif
-            pixels.push_back(rend::Color3(r, g, b));
+            *texels++ = rend::RgbToInt(r, g, b);
         }
     }
 
-    auto texture = std::make_shared<rend::Texture>(pixels, w, h);
+    auto texture = std::make_shared<rend::Texture>(format, data, w, h);
+    texture->generateMips();
+    texture->setLayout(m_layout);
 
     std::tr2::sys::path p(path);
     texture->setName(std::string("texture_") + std::tr2::sys::basename(p));
@@ -9,17 +9,22 @@
 #define DECODERIMAGE_H
 
 #include "resourcedecoder.h"
+#include "rend/texture.h"
 
 namespace base
 {
 
 class DecoderImage : public ResourceDecoder
 {
+    rend::Texture::Layout m_layout;
+
 public:
-    DecoderImage() { }
+    //! Decoded textures and their mip levels get the given texels layout.
+    DecoderImage(rend::Texture::Layout layout = rend::Texture::TL_LINEAR) : m_layout(layout) { }
     ~DecoderImage() { }
 
     sptr(Resource)  decode(const std::string &path);
+    bool            reentrant() const { return true; }
     std::string     extension() const;
 };
 
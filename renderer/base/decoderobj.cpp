@@ -15,10 +15,49 @@
 #include "color.h"
 #include "material.h"
 #include "poly.h"
+#include "meshsimplifier.h"
 
 namespace base
 {
 
+//! Cache file of the levels of detail: signature, version, hash of the model file, levels.
+static const char LOD_CACHE_SIGNATURE[4] = { 'L', 'O', 'D', 'S' };
+static const uint32_t LOD_CACHE_VERSION = 2;
+
+//! FNV-1a hash of the file contents, 0 if the file can't be read.
+static uint64_t fileHash(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    char buffer[4096];
+
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+    {
+        for (std::streamsize i = 0; i < file.gcount(); i++)
+        {
+            hash ^= (uint8_t)buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+template<typename T>
+static bool readValue(std::istream &is, T &value)
+{
+    return (bool)is.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+template<typename T>
+static void writeValue(std::ostream &os, const T &value)
+{
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
 void DecoderOBJ::appendVertex(std::string &line)
 {
     line = line.substr(line.find(' ') + 1);
@@ -110,6 +149,142 @@ void DecoderOBJ::triangulateModel()
     }
 }
 
+bool DecoderOBJ::loadLods(rend::Mesh &mesh, const std::string &cachePath, uint64_t sourceHash)
+{
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file)
+        return false;
+
+    char signature[4];
+    uint32_t version, lodsCount;
+    uint64_t hash;
+
+    if (!file.read(signature, 4) || !std::equal(signature, signature + 4, LOD_CACHE_SIGNATURE)
+            || !readValue(file, version) || version != LOD_CACHE_VERSION
+            || !readValue(file, hash) || hash != sourceHash
+            || !readValue(file, lodsCount))
+        return false;
+
+    mesh.clearLods();
+
+    for (uint32_t level = 0; level < lodsCount; level++)
+    {
+        float error;
+        uint32_t submeshesCount;
+
+        if (!readValue(file, error) || !readValue(file, submeshesCount) || submeshesCount != (uint32_t)mesh.numSubMeshes())
+            break;
+
+        auto lod = std::make_shared<rend::Mesh>();
+
+        for (auto &source : mesh.getSubmeshes())
+        {
+            uint32_t verticesCount, indicesCount, indexSize;
+            if (!readValue(file, verticesCount))
+                break;
+
+            std::vector<math::vertex> vertices(verticesCount);
+            for (auto &v : vertices)
+            {
+                float data[8];
+                file.read(reinterpret_cast<char *>(data), sizeof(data));
+
+                v.p = math::vec3(data[0], data[1], data[2]);
+                v.n = math::vec3(data[3], data[4], data[5]);
+                v.t = math::vec2(data[6], data[7]);
+            }
+
+            if (!readValue(file, indicesCount) || !readValue(file, indexSize))
+                break;
+
+            // indices are stored with the width of the buffer
+            std::vector<int> indices(indicesCount);
+            if (indexSize == sizeof(uint32_t))
+            {
+                std::vector<uint32_t> stored(indicesCount);
+                if (indicesCount)
+                    file.read(reinterpret_cast<char *>(&stored[0]), indicesCount * sizeof(uint32_t));
+                std::copy(stored.begin(), stored.end(), indices.begin());
+            }
+            else if (indexSize == sizeof(uint16_t))
+            {
+                std::vector<uint16_t> stored(indicesCount);
+                if (indicesCount)
+                    file.read(reinterpret_cast<char *>(&stored[0]), indicesCount * sizeof(uint16_t));
+                std::copy(stored.begin(), stored.end(), indices.begin());
+            }
+            else
+                break;
+
+            if (!file)
+                break;
+
+            rend::VertexBuffer vb(source.getType());
+            vb.appendVertices(vertices, indices, true);
+            vb.setMaterial(source.getMaterial());
+
+            lod->appendSubmesh(vb);
+        }
+
+        if (!file || lod->numSubMeshes() != mesh.numSubMeshes())
+            break;
+
+        mesh.addLod(lod, error);
+    }
+
+    if (mesh.numLods() != lodsCount)
+    {
+        mesh.clearLods();
+        return false;
+    }
+
+    return true;
+}
+
+void DecoderOBJ::saveLods(const rend::Mesh &mesh, const std::string &cachePath, uint64_t sourceHash)
+{
+    std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        syslog << "Can't write levels of detail cache" << cachePath << logwarn;
+        return;
+    }
+
+    file.write(LOD_CACHE_SIGNATURE, 4);
+    writeValue(file, LOD_CACHE_VERSION);
+    writeValue(file, sourceHash);
+    writeValue(file, (uint32_t)mesh.numLods());
+
+    for (size_t level = 0; level < mesh.numLods(); level++)
+    {
+        const sptr(rend::Mesh) &lod = mesh.getLod(level);
+
+        writeValue(file, mesh.getLodError(level));
+        writeValue(file, (uint32_t)lod->numSubMeshes());
+
+        for (auto &vb : lod->getSubmeshes())
+        {
+            writeValue(file, (uint32_t)vb.numVertices());
+            for (auto &v : vb.getVertices())
+            {
+                float data[8] = { v.p.x, v.p.y, v.p.z, v.n.x, v.n.y, v.n.z, v.t.x, v.t.y };
+                file.write(reinterpret_cast<const char *>(data), sizeof(data));
+            }
+
+            const rend::VertexBuffer::IndexArray &indices = vb.getIndices();
+            writeValue(file, (uint32_t)indices.size());
+            writeValue(file, (uint32_t)indices.bytesPerIndex());
+            if (indices.wide())
+                file.write(reinterpret_cast<const char *>(indices.data<uint32_t>()), indices.size() * sizeof(uint32_t));
+            else if (!indices.empty())
+                file.write(reinterpret_cast<const char *>(indices.data<uint16_t>()), indices.size() * sizeof(uint16_t));
+        }
+    }
+
+    if (!file)
+        syslog << "Can't write levels of detail cache" << cachePath << logwarn;
+}
+
 void DecoderOBJ::clear()
 {
     vertexList.clear();
@@ -185,7 +360,19 @@ sptr(Resource) DecoderOBJ::decode(const std::string &path)
 
     syslog << "Decoded obj-model \"" << newObject->getName()
             << "\". Number of vertices:" << newMesh->numVertices()
-            << ". Number of faces:" << faces.size() << logmess;
+            << ". Number of faces:" << (int)faces.size() << logmess;
+
+    // levels of detail are simplified once and are cached next to the model
+    std::string cachePath = path + ".lod";
+    uint64_t sourceHash = fileHash(path);
+
+    if (!loadLods(*newMesh, cachePath, sourceHash))
+    {
+        rend::MeshSimplifier::buildLods(*newMesh);
+        saveLods(*newMesh, cachePath, sourceHash);
+    }
+
+    syslog << "Levels of detail of \"" << newObject->getName() << "\":" << (int)newMesh->numLods() << logmess;
 
     return newObject;
 }
@@ -11,6 +11,8 @@
 #include "resourcedecoder.h"
 #include "math/vertex.h"
 
+namespace rend { class Mesh; }
+
 namespace base
 {
 
@@ -39,6 +41,11 @@ public:
     DecoderOBJ() { }
     ~DecoderOBJ() { }
 
+    //! Reads the levels of detail from the cache next to the model, false if it is missing or stale.
+    static bool loadLods(rend::Mesh &mesh, const std::string &cachePath, uint64_t sourceHash);
+    //! Writes the levels of detail of the mesh to the cache.
+    static void saveLods(const rend::Mesh &mesh, const std::string &cachePath, uint64_t sourceHash);
+
     sptr(Resource)  decode(const std::string &path);
     std::string     extension() const;
 };
@@ -0,0 +1,218 @@
+/*
+ * jobsystem.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "jobsystem.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace base
+{
+
+// worker of the current thread, valid when t_system is set
+static THREAD_LOCAL const JobSystem *t_system = 0;
+static THREAD_LOCAL int t_worker = 0;
+
+JobSystem::JobSystem(int threads)
+{
+    m_queued = 0;
+    m_quit = false;
+
+    if (threads <= 0)
+        threads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    for (int i = 0; i < threads; i++)
+        m_workers.push_back(new Worker);
+
+    for (int i = 1; i < threads; i++)
+        m_threads.push_back(std::thread(&JobSystem::threadMain, this, i));
+
+    resetStats();
+
+    syslog << "Job system threads:" << threads << logmess;
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_quit = true;
+    }
+    m_wakeUp.notify_all();
+
+    for (auto &t : m_threads)
+        t.join();
+
+    for (auto w : m_workers)
+        delete w;
+}
+
+int JobSystem::workerIndex() const
+{
+    return t_system == this ? t_worker : 0;
+}
+
+bool JobSystem::takeJob(int worker, Job &job)
+{
+    // own jobs first, newest ones are still in the cache
+    {
+        Worker &own = *m_workers[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            m_queued--;
+            return true;
+        }
+    }
+
+    // steal the oldest job
+    int count = (int)m_workers.size();
+    for (int i = 1; i < count; i++)
+    {
+        Worker &victim = *m_workers[(worker + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            m_queued--;
+            m_workers[worker]->stolen++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::execute(int worker, const Job &job)
+{
+    Clock::time_point start = Clock::now();
+
+    (*job.body)(job.from, job.to);
+
+    Worker &w = *m_workers[worker];
+    w.busyTicks += (Clock::now() - start).count();
+    w.executed++;
+
+    job.pending->fetch_sub(1);
+}
+
+void JobSystem::threadMain(int worker)
+{
+    t_system = this;
+    t_worker = worker;
+
+    Job job;
+    for (;;)
+    {
+        if (takeJob(worker, job))
+        {
+            execute(worker, job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        while (!m_quit && m_queued == 0)
+            m_wakeUp.wait(lock);
+
+        if (m_quit)
+            return;
+    }
+}
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body)
+{
+    if (begin >= end)
+        return;
+
+    grain = std::max(grain, 1);
+    int chunks = (end - begin + grain - 1) / grain;
+
+    int worker = workerIndex();
+    std::atomic<int> pending;
+    pending = chunks;
+
+    // jobs are pushed in reverse order, so the owner goes from the beginning of the range
+    // and thieves from its end
+    {
+        Worker &own = *m_workers[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+
+        for (int i = chunks - 1; i >= 0; i--)
+        {
+            Job job;
+            job.body = &body;
+            job.from = begin + i * grain;
+            job.to = std::min(job.from + grain, end);
+            job.pending = &pending;
+
+            own.jobs.push_back(job);
+        }
+    }
+
+    m_queued += chunks;
+
+    // wake up the sleeping workers, the lock orders this with their check of the queue
+    if (chunks > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wakeUp.notify_all();
+    }
+
+    // help until our jobs are done
+    Job job;
+    while (pending > 0)
+    {
+        if (takeJob(worker, job))
+            execute(worker, job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::stats() const
+{
+    double wall = std::chrono::duration<double>(Clock::now() - m_statsStart).count();
+
+    std::vector<WorkerStats> res(m_workers.size());
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        const Worker &w = *m_workers[i];
+
+        res[i].jobs = w.executed;
+        res[i].steals = w.stolen;
+        res[i].busyTime = std::chrono::duration<double>(Clock::duration(w.busyTicks)).count();
+        res[i].utilization = wall > 0.0 ? (float)(res[i].busyTime / wall) : 0.0f;
+    }
+
+    return res;
+}
+
+void JobSystem::resetStats()
+{
+    for (auto w : m_workers)
+    {
+        w->executed = 0;
+        w->stolen = 0;
+        w->busyTicks = 0;
+    }
+
+    m_statsStart = Clock::now();
+}
+
+}
@@ -0,0 +1,108 @@
+/*
+ * jobsystem.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+
+namespace base
+{
+
+//! Work-stealing job system.
+/*!
+  * Every worker thread has its own deque of jobs. Worker takes jobs from the back of its deque
+  * and, when it is empty, steals from the front of the other deques. Threads outside of the
+  * system share one more deque. A thread which waits for its jobs executes jobs too, so
+  * parallelFor() may be called from the jobs.
+  *
+  * Jobs must not throw.
+  */
+class JobSystem
+{
+public:
+    //! Per-worker counters since the last resetStats().
+    struct WorkerStats
+    {
+        //! Executed jobs.
+        int jobs;
+        //! Jobs taken from the other workers.
+        int steals;
+        //! Seconds spent in jobs.
+        double busyTime;
+        //! busyTime / wall time.
+        float utilization;
+    };
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    struct Job
+    {
+        const std::function<void(int, int)> *body;
+        int from, to;
+        std::atomic<int> *pending;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+
+        std::atomic<int> executed;
+        std::atomic<int> stolen;
+        std::atomic<long long> busyTicks;
+
+        Worker() { executed = 0; stolen = 0; busyTicks = 0; }
+    };
+
+    //! Worker 0 is used by the threads outside of the system.
+    std::vector<Worker *> m_workers;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+    //! Jobs in all deques.
+    std::atomic<int> m_queued;
+    std::atomic<bool> m_quit;
+
+    Clock::time_point m_statsStart;
+
+    //! Index of the calling thread worker.
+    int workerIndex() const;
+    //! Takes a job from own deque or steals it from the others.
+    bool takeJob(int worker, Job &job);
+    void execute(int worker, const Job &job);
+
+    void threadMain(int worker);
+
+public:
+    //! Creates given count of threads (including the calling one). 0 means one thread per core.
+    JobSystem(int threads = 0);
+    ~JobSystem();
+
+    //! Threads count including the calling one.
+    int threads() const { return (int)m_workers.size(); }
+
+    //! Calls body(from, to) for subranges of [begin, end) no longer than grain and waits for all of them.
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+    //! Counters for each worker. First element is for the threads outside of the system.
+    std::vector<WorkerStats> stats() const;
+    void resetStats();
+
+    NONCOPYABLE(JobSystem)
+};
+
+}
+
+#endif // JOBSYSTEM_H
@@ -44,6 +44,9 @@ public:
     //! Need to be implemented in derived classes. Creates engine representation of the asset.
     virtual sptr(Resource)  decode(const std::string &path) = 0;
 
+    //! Decoder without state may decode several files at the same time.
+    virtual bool            reentrant() const { return false; }
+
     //! Returns asset extension.
     // TODO: return something like container. One decoder may load more than one files.
     virtual std::string     extension() const = 0;
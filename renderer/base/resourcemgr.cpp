@@ -12,6 +12,7 @@
 #include "resource.h"
 #include "resourcedecoder.h"
 #include "osfile.h"
+#include "jobsystem.h"
 #include "decoderbspq3.h"
 #include "decoderobj.h"
 #include "decoderimage.h"
@@ -36,6 +37,12 @@ ResourceMgr::~ResourceMgr()
 {
 }
 
+void ResourceMgr::setTextureLayout(rend::Texture::Layout layout)
+{
+    sptr(ResourceDecoder) imgDecoder(new DecoderImage(layout));
+    m_decoders[imgDecoder->extension()] = imgDecoder;
+}
+
 sptr(Resource) ResourceMgr::getResource(const std::string &name)
 {
     fs::path p(name);
@@ -97,6 +104,22 @@ sptr(Resource) ResourceMgr::getResource(const std::string &name)
         return m_resources[fullpath];
 }
 
+sptr(ResourceDecoder) ResourceMgr::getDecoder(const FSPath &p) const
+{
+    std::string extension = p.extension();
+    if (extension.empty())
+        return sptr(ResourceDecoder)();
+
+    if (extension.at(0) == '.')
+        extension.erase(extension.begin());
+
+    auto dit = m_decoders.find(extension);
+    if (dit == m_decoders.end())
+        return sptr(ResourceDecoder)();
+
+    return dit->second;
+}
+
 void ResourceMgr::loadResource(const std::string &resourcepath) try
 {
     const char *error = "Loading resource:";
@@ -108,17 +131,10 @@ void ResourceMgr::loadResource(const std::string &resourcepath) try
         return;
     }
     
-    if (p.extension() == std::string())
-        return;
-
     // ensure that we have decoder for this resource
-    std::string extension = p.extension();
-    if (extension.at(0) == '.')
-        extension.erase(extension.begin());
-
-    auto dit = m_decoders.find(extension);
+    sptr(ResourceDecoder) decoder = getDecoder(p);
     // unsupported
-    if (dit == m_decoders.end())
+    if (!decoder)
         return;
 
     // if we already have the resource
@@ -136,7 +152,7 @@ void ResourceMgr::loadResource(const std::string &resourcepath) try
 
     sptr(Resource) newResource;
 
-    newResource = dit->second->decode(fullpath);
+    newResource = decoder->decode(fullpath);
 
     if (newResource)
     {
@@ -159,8 +175,10 @@ void ResourceMgr::unloadResource(const std::string &/*resourcepath*/)
     // TODO:
 }
 
-void ResourceMgr::loadAllResources() try
+void ResourceMgr::loadAllResources(JobSystem *jobs) try
 {
+    std::vector<fs::path> files;
+
     for (auto loadablePath : m_loadablePaths)
     {
         std::vector<fs::path> dirEntries;
@@ -171,10 +189,70 @@ void ResourceMgr::loadAllResources() try
                       std::back_inserter(dirEntries));
 
             for (auto p : dirEntries)
-                loadResource(loadablePath / p);
+                files.push_back(loadablePath / p);
         }
     }
 
+    std::vector<bool> loaded(files.size(), false);
+
+    if (jobs)
+    {
+        // decode files of the reentrant decoders in parallel
+        std::vector<size_t> parallelFiles;
+        std::vector<std::string> fullpaths;
+        std::vector<sptr(ResourceDecoder)> decoders;
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            sptr(ResourceDecoder) decoder = getDecoder(files[i]);
+            if (!decoder || !decoder->reentrant() || fs::is_directory(files[i]) || !fs::exists(files[i]))
+                continue;
+
+            std::string fullpath = fs::system_complete(files[i]);
+            if (m_resources.find(fullpath) != m_resources.end())
+                continue;
+
+            parallelFiles.push_back(i);
+            fullpaths.push_back(fullpath);
+            decoders.push_back(decoder);
+        }
+
+        std::vector<sptr(Resource)> decoded(parallelFiles.size());
+
+        jobs->parallelFor(0, (int)parallelFiles.size(), 1, [&](int from, int to)
+        {
+            for (int i = from; i < to; i++)
+            {
+                try
+                {
+                    decoded[i] = decoders[i]->decode(fullpaths[i]);
+                }
+                catch (...) { }     // jobs can't throw, reported below as not decoded
+            }
+        });
+
+        // the rest of loading is done in order
+        for (size_t i = 0; i < parallelFiles.size(); i++)
+        {
+            loaded[parallelFiles[i]] = true;
+
+            if (!decoded[i])
+            {
+                syslog << "Loading resource:" << "Can't decode resource:" << fullpaths[i] << logerr;
+                continue;
+            }
+
+            decoded[i]->additionalLoading(this);
+            m_resources[fullpaths[i]] = decoded[i];
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!loaded[i])
+            loadResource(files[i]);
+    }
+
     syslog << "Loaded resources:\n";
     for (auto resource : m_resources)
     {
@@ -8,6 +8,8 @@
 #ifndef RESOURCEMGR_H
 #define RESOURCEMGR_H
 
+#include "rend/texture.h"
+
 namespace rend
 {
 class SceneObject;
@@ -18,6 +20,7 @@ namespace base
 
 class Resource;
 class ResourceDecoder;
+class JobSystem;
 
 DECLARE_EXCEPTION(UnsupportedResource)
 
@@ -42,6 +45,9 @@ class ResourceMgr
       */
     sptr(Resource) getResource(const std::string &name);
 
+    //! Returns decoder for the file or 0 if the file isn't supported.
+    sptr(ResourceDecoder) getDecoder(const FSPath &p) const;
+
     void loadResource(const std::string &resourcepath);
     void unloadResource(const std::string &resourcepath);
 
@@ -58,9 +64,12 @@ public:
     template<typename T>
     sptr(T) getObject(const std::string &name);
 
-    void loadAllResources();
+    //! Loads all resources from the added paths. Files, which decoders are reentrant, are decoded by the jobs.
+    void loadAllResources(JobSystem *jobs = 0);
 
     void addPath(const std::string &name);
+    //! Texels layout of the textures, which are loaded after this call.
+    void setTextureLayout(rend::Texture::Layout layout);
     void listPath();
 
     NONCOPYABLE(ResourceMgr)
@@ -0,0 +1,161 @@
+/*
+ * frustum.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "frustum.h"
+
+#include "m44.h"
+#include "vec3.h"
+
+namespace math
+{
+
+Frustum::Frustum()
+{
+    for (int i = 0; i < LANES; i++)
+        m_a[i] = m_b[i] = m_c[i] = m_d[i] = 0.0f;
+}
+
+void Frustum::setPlane(int i, float a, float b, float c, float d)
+{
+    float len = sqrt(a * a + b * b + c * c);
+    assert(!DCMP(len, 0.0f));
+
+    m_a[i] = a / len;
+    m_b[i] = b / len;
+    m_c[i] = c / len;
+    m_d[i] = d / len;
+}
+
+void Frustum::set(const M44 &viewProjection, float nearZ, float farZ)
+{
+    const float (&m)[4][4] = viewProjection.x;
+
+    // clip = (x y z 1) * m, so the clip components are the columns
+    setPlane(LEFT, m[0][3] + m[0][0], m[1][3] + m[1][0], m[2][3] + m[2][0], m[3][3] + m[3][0]);
+    setPlane(RIGHT, m[0][3] - m[0][0], m[1][3] - m[1][0], m[2][3] - m[2][0], m[3][3] - m[3][0]);
+    setPlane(BOTTOM, m[0][3] + m[0][1], m[1][3] + m[1][1], m[2][3] + m[2][1], m[3][3] + m[3][1]);
+    setPlane(TOP, m[0][3] - m[0][1], m[1][3] - m[1][1], m[2][3] - m[2][1], m[3][3] - m[3][1]);
+    setPlane(NEAR_PLANE, m[0][2], m[1][2], m[2][2], m[3][2] - nearZ);
+    setPlane(FAR_PLANE, -m[0][2], -m[1][2], -m[2][2], farZ - m[3][2]);
+
+    for (int i = PLANES_COUNT; i < LANES; i++)
+    {
+        m_a[i] = m_a[FAR_PLANE];
+        m_b[i] = m_b[FAR_PLANE];
+        m_c[i] = m_c[FAR_PLANE];
+        m_d[i] = m_d[FAR_PLANE];
+    }
+}
+
+float Frustum::distance(int plane, const vec3 &p) const
+{
+    return m_a[plane] * p.x + m_b[plane] * p.y + m_c[plane] * p.z + m_d[plane];
+}
+
+// distances to the points must be > radius for all planes to be inside, < -radius for any plane to be outside
+static FrustumRelation classify(const float *a, const float *b, const float *c, const float *d,
+                                const vec3 &center, const __m128 (&radius)[2])
+{
+    __m128 cx = _mm_set1_ps(center.x);
+    __m128 cy = _mm_set1_ps(center.y);
+    __m128 cz = _mm_set1_ps(center.z);
+
+    int outside = 0;
+    int inside = 0;
+
+    for (int g = 0; g < 2; g++)
+    {
+        __m128 dist = _mm_mul_ps(_mm_loadu_ps(a + g * 4), cx);
+        dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(b + g * 4), cy));
+        dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(c + g * 4), cz));
+        dist = _mm_add_ps(dist, _mm_loadu_ps(d + g * 4));
+
+        __m128 minusR = _mm_sub_ps(_mm_setzero_ps(), radius[g]);
+
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(dist, minusR));
+        inside |= _mm_movemask_ps(_mm_cmpgt_ps(dist, radius[g])) << (g * 4);
+    }
+
+    if (outside)
+        return FRUSTUM_OUTSIDE;
+
+    return inside == 0xff ? FRUSTUM_INSIDE : FRUSTUM_INTERSECT;
+}
+
+FrustumRelation Frustum::testSphere(const vec3 &center, float radius) const
+{
+    __m128 r[2] = { _mm_set1_ps(radius), _mm_set1_ps(radius) };
+
+    return classify(m_a, m_b, m_c, m_d, center, r);
+}
+
+FrustumRelation Frustum::testBox(const vec3 &center, const vec3 &extents) const
+{
+    // projection of the box on the plane normal
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 ex = _mm_set1_ps(extents.x);
+    __m128 ey = _mm_set1_ps(extents.y);
+    __m128 ez = _mm_set1_ps(extents.z);
+
+    __m128 r[2];
+    for (int g = 0; g < 2; g++)
+    {
+        r[g] = _mm_mul_ps(_mm_and_ps(_mm_loadu_ps(m_a + g * 4), absMask), ex);
+        r[g] = _mm_add_ps(r[g], _mm_mul_ps(_mm_and_ps(_mm_loadu_ps(m_b + g * 4), absMask), ey));
+        r[g] = _mm_add_ps(r[g], _mm_mul_ps(_mm_and_ps(_mm_loadu_ps(m_c + g * 4), absMask), ez));
+    }
+
+    return classify(m_a, m_b, m_c, m_d, center, r);
+}
+
+void Frustum::testSpheres(const float *x, const float *y, const float *z, const float *radius, size_t count,
+                          FrustumRelation *relations) const
+{
+    size_t i = 0;
+
+    // lanes are spheres here, planes are taken one by one
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(x + i);
+        __m128 cy = _mm_loadu_ps(y + i);
+        __m128 cz = _mm_loadu_ps(z + i);
+        __m128 r = _mm_loadu_ps(radius + i);
+        __m128 minusR = _mm_sub_ps(_mm_setzero_ps(), r);
+
+        __m128 outside = _mm_setzero_ps();
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < PLANES_COUNT; p++)
+        {
+            __m128 dist = _mm_mul_ps(_mm_set1_ps(m_a[p]), cx);
+            dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(m_b[p]), cy));
+            dist = _mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(m_c[p]), cz));
+            dist = _mm_add_ps(dist, _mm_set1_ps(m_d[p]));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, minusR));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(dist, r));
+        }
+
+        int outsideMask = _mm_movemask_ps(outside);
+        int insideMask = _mm_movemask_ps(inside);
+
+        for (int k = 0; k < 4; k++)
+        {
+            if (outsideMask & (1 << k))
+                relations[i + k] = FRUSTUM_OUTSIDE;
+            else
+                relations[i + k] = insideMask & (1 << k) ? FRUSTUM_INSIDE : FRUSTUM_INTERSECT;
+        }
+    }
+
+    for (; i < count; i++)
+        relations[i] = testSphere(vec3(x[i], y[i], z[i]), radius[i]);
+}
+
+}
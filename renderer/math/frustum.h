@@ -0,0 +1,73 @@
+/*
+ * frustum.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+namespace math
+{
+
+struct M44;
+struct vec3;
+
+//! Volume and view frustum relation types.
+enum FrustumRelation
+{
+    FRUSTUM_OUTSIDE,        /*!< Volume is outside of one of the planes. */
+    FRUSTUM_INTERSECT,      /*!< Volume crosses some planes. */
+    FRUSTUM_INSIDE          /*!< Volume is inside of all planes. */
+};
+
+//! Six planes of the view volume in the world space.
+/*!
+  * Planes are kept in SoA layout, so a sphere or a box is tested against four planes at a time.
+  * Default frustum gives FRUSTUM_INTERSECT for any volume.
+  */
+class Frustum
+{
+public:
+    enum { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, PLANES_COUNT };
+
+private:
+    // two SSE registers, the last two lanes repeat the far plane
+    static const int LANES = 8;
+
+    //! Plane equations ax + by + cz + d, positive inside. Normals are unit length.
+    float m_a[LANES];
+    float m_b[LANES];
+    float m_c[LANES];
+    float m_d[LANES];
+
+    void setPlane(int i, float a, float b, float c, float d);
+
+public:
+    //! Default ctor.
+    Frustum();
+
+    //! Extracts planes from the world -> clip transformation.
+    /*!
+      * Side planes are -w <= x <= w, -w <= y <= w. Clip z must be camera space z (as in rend::Camera),
+      * the near and far planes are nearZ <= z <= farZ.
+      */
+    void set(const M44 &viewProjection, float nearZ, float farZ);
+
+    //! Signed distance from the plane to the point.
+    float distance(int plane, const vec3 &p) const;
+
+    //! Tests the sphere.
+    FrustumRelation testSphere(const vec3 &center, float radius) const;
+    //! Tests axis aligned box with the center and half sizes.
+    FrustumRelation testBox(const vec3 &center, const vec3 &extents) const;
+
+    //! Tests count spheres given in SoA layout, four at a time.
+    void testSpheres(const float *x, const float *y, const float *z, const float *radius, size_t count,
+                     FrustumRelation *relations) const;
+};
+
+}
+
+#endif // FRUSTUM_H
@@ -156,6 +156,22 @@ float M33::determinant() const
             x[0][2] * (x[1][0] * x[2][1] - x[1][1] * x[2][0]));
 }
 
+// Square root of the largest eigenvalue of (m^T * m). The eigenvalue is bounded by the Gershgorin circles,
+// which are exact for the rotation and the scale only.
+float M33::maxScale() const
+{
+    float a[3][3];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            a[i][j] = x[0][i] * x[0][j] + x[1][i] * x[1][j] + x[2][i] * x[2][j];
+
+    float bound = 0.0f;
+    for (int i = 0; i < 3; i++)
+        bound = std::max(bound, (float)(fabs(a[i][0]) + fabs(a[i][1]) + fabs(a[i][2])));
+
+    return sqrt(bound);
+}
+
 M33 M33::getScaleMatrix(const vec3 &vect)
 {
     M33 A;
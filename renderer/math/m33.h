@@ -63,6 +63,8 @@ struct M33
     M33 &transpose();
     //! Determinant computing.
     float determinant() const;
+    //! Upper bound of the length of the transformed unit vector.
+    float maxScale() const;
 
     //! Returns matrix memory address.
     float *getPointer() { return reinterpret_cast<float *>(x); }
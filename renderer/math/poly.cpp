@@ -13,12 +13,14 @@ namespace math
 {
 
 Triangle::Triangle()
-    : clipped(false)
+    : m_material(0),
+      clipped(false)
 {
 }
 
 Triangle::Triangle(const vertex *arr)
-    : clipped(false)
+    : m_material(0),
+      clipped(false)
 {
     if (!arr)
     {
@@ -87,18 +89,12 @@ std::vector<vec2> Triangle::uvs() const
 
 void Triangle::computeNormal()
 {
-    static vec3 p1, p2;
-
-    p1.set((m_verts[1].p - m_verts[0].p).normalize());
-    p2.set((m_verts[2].p - m_verts[0].p).normalize());
-
-    m_normal = p1.crossProduct(p2);
-    m_normal.normalize();
+    m_normal = TriangleNormal(m_verts[0].p, m_verts[1].p, m_verts[2].p);
 }
 
 float Triangle::square() const
 {
-    static vec3 p1, p2;
+    vec3 p1, p2;
 
     p1.set((m_verts[1].p - m_verts[0].p).normalize());
     p2.set((m_verts[2].p - m_verts[0].p).normalize());
@@ -108,6 +104,19 @@ float Triangle::square() const
     return 0.5f * n.length();
 }
 
+vec3 TriangleNormal(const vec3 &p0, const vec3 &p1, const vec3 &p2)
+{
+    vec3 e1, e2;
+
+    e1.set((p1 - p0).normalize());
+    e2.set((p2 - p0).normalize());
+
+    vec3 n = e1.crossProduct(e2);
+    n.normalize();
+
+    return n;
+}
+
 bool ZCompareAvg(const math::Triangle &t1, const math::Triangle &t2)
 {
     float avgz = 0.33333f * (t1.m_verts[0].p.z + t1.m_verts[1].p.z + t1.m_verts[2].p.z);
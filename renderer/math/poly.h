@@ -8,6 +8,8 @@
 #ifndef POLY_H
 #define POLY_H
 
+#include <type_traits>
+
 #include "vertex.h"
 #include "material.h"
 #include "m44.h"
@@ -20,7 +22,7 @@ class Triangle
     vertex m_verts[3];
     vec3 m_normal;
 
-    sptr(rend::Material) m_material;
+    rend::MaterialHandle m_material;
 
 public:
     bool clipped;
@@ -50,11 +52,13 @@ public:
     //! Returns copy of the triangle texture coordinates.
     std::vector<vec2> uvs() const;
 
-    sptr(rend::Material) getMaterial() const { return m_material; }
-    void setMaterial(sptr(rend::Material) material) { m_material = material; }
+    //! Returns the material from the registry, null if it is not set.
+    const rend::Material *getMaterial() const { return rend::MaterialRegistry::instance().get(m_material); }
+    rend::MaterialHandle getMaterialHandle() const { return m_material; }
+    void setMaterial(rend::MaterialHandle material) { m_material = material; }
 
     void computeNormal();
-    vec3 normal() const { return m_normal; }
+    const vec3 &normal() const { return m_normal; }
 
     float square() const;
 
@@ -63,6 +67,12 @@ public:
     friend bool ZCompareMax(const math::Triangle &t1, const math::Triangle &t2);
 };
 
+//! Returns unit normal of the triangle p0, p1, p2 (zero for the degenerate one).
+vec3 TriangleNormal(const vec3 &p0, const vec3 &p1, const vec3 &p2);
+
+// render list is copied as plain memory
+static_assert(std::is_trivially_copyable<Triangle>::value, "Triangle must be trivially copyable");
+
 bool ZCompareAvg(const math::Triangle &t1, const math::Triangle &t2);
 bool ZCompareMin(const math::Triangle &t1, const math::Triangle &t2);
 bool ZCompareMax(const math::Triangle &t1, const math::Triangle &t2);
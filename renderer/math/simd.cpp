@@ -0,0 +1,311 @@
+/*
+ * simd.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "simd.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "m44.h"
+#include "vec3.h"
+
+namespace math
+{
+
+static inline const float *pointAt(const vec3 *points, size_t stride, size_t i)
+{
+    return reinterpret_cast<const float *>(reinterpret_cast<const char *>(points) + i * stride);
+}
+
+// four points, x y z in the separate registers
+static inline void load4(const vec3 *points, size_t stride, size_t i, __m128 &x, __m128 &y, __m128 &z)
+{
+    __m128 r0 = _mm_loadu_ps(pointAt(points, stride, i + 0));
+    __m128 r1 = _mm_loadu_ps(pointAt(points, stride, i + 1));
+    __m128 r2 = _mm_loadu_ps(pointAt(points, stride, i + 2));
+    __m128 r3 = _mm_loadu_ps(pointAt(points, stride, i + 3));
+
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    x = r0;
+    y = r1;
+    z = r2;
+}
+
+#ifdef __AVX2__
+// eight points, lanes 0-3 are points i..i+3, lanes 4-7 are points i+4..i+7
+static inline void load8(const vec3 *points, size_t stride, size_t i, __m256 &x, __m256 &y, __m256 &z)
+{
+    __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pointAt(points, stride, i + 0))),
+                                     _mm_loadu_ps(pointAt(points, stride, i + 4)), 1);
+    __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pointAt(points, stride, i + 1))),
+                                     _mm_loadu_ps(pointAt(points, stride, i + 5)), 1);
+    __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pointAt(points, stride, i + 2))),
+                                     _mm_loadu_ps(pointAt(points, stride, i + 6)), 1);
+    __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pointAt(points, stride, i + 3))),
+                                     _mm_loadu_ps(pointAt(points, stride, i + 7)), 1);
+
+    // x0 x1 y0 y1, x2 x3 y2 y3, z0 z1 w0 w1, z2 z3 w2 w3 in each half
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+    x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+}
+#endif
+
+int SimdWidth()
+{
+#ifdef __AVX2__
+    return 8;
+#else
+    return 4;
+#endif
+}
+
+const char *SimdInstructionSet()
+{
+#ifdef __AVX2__
+    return "AVX2";
+#else
+    return "SSE4.1";
+#endif
+}
+
+void TransformPoints(const M44 &m, const vec3 *points, size_t stride, size_t count,
+                     float *x, float *y, float *z, float *w)
+{
+    float *out[4] = { x, y, z, w };
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px, py, pz;
+        load8(points, stride, i, px, py, pz);
+
+        for (int c = 0; c < 4; c++)
+        {
+            if (!out[c])
+                continue;
+
+            __m256 r = _mm256_mul_ps(px, _mm256_set1_ps(m.x[0][c]));
+            r = _mm256_add_ps(r, _mm256_mul_ps(py, _mm256_set1_ps(m.x[1][c])));
+            r = _mm256_add_ps(r, _mm256_mul_ps(pz, _mm256_set1_ps(m.x[2][c])));
+            r = _mm256_add_ps(r, _mm256_set1_ps(m.x[3][c]));
+
+            _mm256_storeu_ps(out[c] + i, r);
+        }
+    }
+#endif
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px, py, pz;
+        load4(points, stride, i, px, py, pz);
+
+        for (int c = 0; c < 4; c++)
+        {
+            if (!out[c])
+                continue;
+
+            __m128 r = _mm_mul_ps(px, _mm_set1_ps(m.x[0][c]));
+            r = _mm_add_ps(r, _mm_mul_ps(py, _mm_set1_ps(m.x[1][c])));
+            r = _mm_add_ps(r, _mm_mul_ps(pz, _mm_set1_ps(m.x[2][c])));
+            r = _mm_add_ps(r, _mm_set1_ps(m.x[3][c]));
+
+            _mm_storeu_ps(out[c] + i, r);
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        const float *p = pointAt(points, stride, i);
+
+        for (int c = 0; c < 4; c++)
+        {
+            if (out[c])
+                out[c][i] = p[0] * m.x[0][c] + p[1] * m.x[1][c] + p[2] * m.x[2][c] + m.x[3][c];
+        }
+    }
+}
+
+void ClipFlags(const float *x, const float *y, const float *w, size_t count, float nearW, uint8_t *flags)
+{
+    size_t i = 0;
+
+#ifdef __AVX2__
+    const __m256 signMask8 = _mm256_set1_ps(-0.0f);
+    const __m256 nearW8 = _mm256_set1_ps(nearW);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pw = _mm256_loadu_ps(w + i);
+        __m256 minusW = _mm256_xor_ps(pw, signMask8);
+
+        __m256 left = _mm256_cmp_ps(px, minusW, _CMP_LT_OQ);
+        __m256 right = _mm256_andnot_ps(left, _mm256_cmp_ps(px, pw, _CMP_GT_OQ));
+        __m256 bottom = _mm256_cmp_ps(py, minusW, _CMP_LT_OQ);
+        __m256 top = _mm256_andnot_ps(bottom, _mm256_cmp_ps(py, pw, _CMP_GT_OQ));
+
+        __m256i f = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(pw, nearW8, _CMP_LT_OQ)),
+                                     _mm256_set1_epi32(CLIP_PLANE_NEAR));
+        f = _mm256_or_si256(f, _mm256_and_si256(_mm256_castps_si256(left), _mm256_set1_epi32(CLIP_PLANE_LEFT)));
+        f = _mm256_or_si256(f, _mm256_and_si256(_mm256_castps_si256(right), _mm256_set1_epi32(CLIP_PLANE_RIGHT)));
+        f = _mm256_or_si256(f, _mm256_and_si256(_mm256_castps_si256(bottom), _mm256_set1_epi32(CLIP_PLANE_BOTTOM)));
+        f = _mm256_or_si256(f, _mm256_and_si256(_mm256_castps_si256(top), _mm256_set1_epi32(CLIP_PLANE_TOP)));
+
+        // 8 ints -> 8 bytes
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(f), _mm256_extracti128_si256(f, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(flags + i), _mm_packus_epi16(packed, packed));
+    }
+#endif
+
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 nearW4 = _mm_set1_ps(nearW);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pw = _mm_loadu_ps(w + i);
+        __m128 minusW = _mm_xor_ps(pw, signMask);
+
+        __m128 left = _mm_cmplt_ps(px, minusW);
+        __m128 right = _mm_andnot_ps(left, _mm_cmpgt_ps(px, pw));
+        __m128 bottom = _mm_cmplt_ps(py, minusW);
+        __m128 top = _mm_andnot_ps(bottom, _mm_cmpgt_ps(py, pw));
+
+        __m128i f = _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(pw, nearW4)), _mm_set1_epi32(CLIP_PLANE_NEAR));
+        f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(left), _mm_set1_epi32(CLIP_PLANE_LEFT)));
+        f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(right), _mm_set1_epi32(CLIP_PLANE_RIGHT)));
+        f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(bottom), _mm_set1_epi32(CLIP_PLANE_BOTTOM)));
+        f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(top), _mm_set1_epi32(CLIP_PLANE_TOP)));
+
+        // 4 ints -> 4 bytes
+        f = _mm_packs_epi32(f, f);
+        int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(f, f));
+        memcpy(flags + i, &bytes, sizeof(bytes));
+    }
+
+    for (; i < count; i++)
+    {
+        int f = w[i] < nearW ? CLIP_PLANE_NEAR : 0;
+
+        if (x[i] < -w[i])
+            f |= CLIP_PLANE_LEFT;
+        else if (x[i] > w[i])
+            f |= CLIP_PLANE_RIGHT;
+
+        if (y[i] < -w[i])
+            f |= CLIP_PLANE_BOTTOM;
+        else if (y[i] > w[i])
+            f |= CLIP_PLANE_TOP;
+
+        flags[i] = (uint8_t)f;
+    }
+}
+
+void ClipToScreen(const float *x, const float *y, const float *w, size_t count,
+                  float scaleX, float offsetX, float scaleY, float offsetY,
+                  float *sx, float *sy)
+{
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 8 <= count; i += 8)
+    {
+        // exact division, the reciprocal estimate is too rough for the screen coordinates
+        __m256 invW = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_loadu_ps(w + i));
+        __m256 rx = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(scaleX), _mm256_loadu_ps(x + i)), invW);
+        __m256 ry = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(scaleY), _mm256_loadu_ps(y + i)), invW);
+
+        _mm256_storeu_ps(sx + i, _mm256_add_ps(rx, _mm256_set1_ps(offsetX)));
+        _mm256_storeu_ps(sy + i, _mm256_add_ps(ry, _mm256_set1_ps(offsetY)));
+    }
+#endif
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(w + i));
+        __m128 rx = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(scaleX), _mm_loadu_ps(x + i)), invW);
+        __m128 ry = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(scaleY), _mm_loadu_ps(y + i)), invW);
+
+        _mm_storeu_ps(sx + i, _mm_add_ps(rx, _mm_set1_ps(offsetX)));
+        _mm_storeu_ps(sy + i, _mm_add_ps(ry, _mm_set1_ps(offsetY)));
+    }
+
+    for (; i < count; i++)
+    {
+        float invW = 1.0f / w[i];
+        float rx = scaleX * x[i] * invW + offsetX;
+        float ry = scaleY * y[i] * invW + offsetY;
+
+        sx[i] = rx;
+        sy[i] = ry;
+    }
+}
+
+void BackfaceDots(const vec3 *normals, size_t normalStride, const vec3 *points, size_t pointStride,
+                  size_t count, const vec3 &eye, float *dots)
+{
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 nx, ny, nz, px, py, pz;
+        load8(normals, normalStride, i, nx, ny, nz);
+        load8(points, pointStride, i, px, py, pz);
+
+        __m256 dx = _mm256_sub_ps(_mm256_set1_ps(eye.x), px);
+        __m256 dy = _mm256_sub_ps(_mm256_set1_ps(eye.y), py);
+        __m256 dz = _mm256_sub_ps(_mm256_set1_ps(eye.z), pz);
+
+        __m256 r = _mm256_mul_ps(nx, dx);
+        r = _mm256_add_ps(r, _mm256_mul_ps(ny, dy));
+        r = _mm256_add_ps(r, _mm256_mul_ps(nz, dz));
+
+        _mm256_storeu_ps(dots + i, r);
+    }
+#endif
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 nx, ny, nz, px, py, pz;
+        load4(normals, normalStride, i, nx, ny, nz);
+        load4(points, pointStride, i, px, py, pz);
+
+        __m128 dx = _mm_sub_ps(_mm_set1_ps(eye.x), px);
+        __m128 dy = _mm_sub_ps(_mm_set1_ps(eye.y), py);
+        __m128 dz = _mm_sub_ps(_mm_set1_ps(eye.z), pz);
+
+        __m128 r = _mm_mul_ps(nx, dx);
+        r = _mm_add_ps(r, _mm_mul_ps(ny, dy));
+        r = _mm_add_ps(r, _mm_mul_ps(nz, dz));
+
+        _mm_storeu_ps(dots + i, r);
+    }
+
+    for (; i < count; i++)
+    {
+        const float *n = pointAt(normals, normalStride, i);
+        const float *p = pointAt(points, pointStride, i);
+
+        dots[i] = n[0] * (eye.x - p[0]) + n[1] * (eye.y - p[1]) + n[2] * (eye.z - p[2]);
+    }
+}
+
+}
@@ -0,0 +1,63 @@
+/*
+ * simd.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+namespace math
+{
+
+struct M44;
+struct vec3;
+
+//! Batch kernels over arrays of points.
+/*!
+  * Points are read straight from the vertex or triangle arrays: `stride' is the distance in bytes
+  * between two neighbouring points (sizeof(vertex), sizeof(Triangle)). Results are written
+  * in SoA layout, one array per component.
+  *
+  * The kernels process 8 points at a time when compiled with AVX2 (/arch:AVX2, -mavx2),
+  * 4 points with SSE4.1 otherwise. Operations are done in the same order as in the scalar code
+  * (vec3 * M44 etc.), so results are the same bit to bit.
+  */
+
+//! Count of points processed at a time.
+int SimdWidth();
+//! Name of the compiled instruction set.
+const char *SimdInstructionSet();
+
+//! (x y z 1) * m for every point. Any of the outputs may be null.
+/*! Unlike vec3 * M44, the result is not divided by w. */
+void TransformPoints(const M44 &m, const vec3 *points, size_t stride, size_t count,
+                     float *x, float *y, float *z, float *w);
+
+//! Flags of the clip space points outside of the view volume.
+enum ClipPlanes
+{
+    CLIP_PLANE_NEAR = 1,        /*!< w < near. */
+    CLIP_PLANE_LEFT = 2,        /*!< x < -w. */
+    CLIP_PLANE_RIGHT = 4,       /*!< x > w, not with the left one. */
+    CLIP_PLANE_BOTTOM = 8,      /*!< y < -w. */
+    CLIP_PLANE_TOP = 16         /*!< y > w, not with the bottom one. */
+};
+
+//! ClipPlanes flags of every clip space point.
+void ClipFlags(const float *x, const float *y, const float *w, size_t count, float nearW, uint8_t *flags);
+
+//! Perspective divide and viewport transformation: sx = scaleX * x / w + offsetX, the same for y.
+/*! Outputs may alias the inputs. */
+void ClipToScreen(const float *x, const float *y, const float *w, size_t count,
+                  float scaleX, float offsetX, float scaleY, float offsetY,
+                  float *sx, float *sy);
+
+//! Back face test: dots[i] = normal * (eye - point). The face is turned away when the dot is not positive.
+void BackfaceDots(const vec3 *normals, size_t normalStride, const vec3 *points, size_t pointStride,
+                  size_t count, const vec3 &eye, float *dots);
+
+}
+
+#endif // SIMD_H
@@ -45,6 +45,11 @@ public:
 
     virtual void setWorldViewMatrix(const math::M44 &m) = 0;
     virtual void setProjectionMatrix(const math::M44 &m) = 0;
+
+    //! Enables counting of pixels written more than once by the rasterizers (debug mode).
+    virtual void setCoverageTest(bool enabled) = 0;
+    //! Duplicate pixel writes of the last rendered world (0 if coverage test is disabled).
+    virtual int duplicateWrites() const = 0;
 };
 
 }
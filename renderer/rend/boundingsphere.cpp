@@ -23,6 +23,12 @@ BoundingSphere::BoundingSphere(const std::vector<math::vec3> &vertices)
     calculate(vertices);
 }
 
+BoundingSphere::BoundingSphere(const math::vec3 &center, float radius)
+    : m_centerPoint(center),
+      m_radius(radius)
+{
+}
+
 BoundingSphere::~BoundingSphere()
 {
 }
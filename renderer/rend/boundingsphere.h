@@ -21,6 +21,7 @@ class BoundingSphere
 public:
     BoundingSphere();
     BoundingSphere(const std::vector<math::vec3> &vertices);
+    BoundingSphere(const math::vec3 &center, float radius);
     ~BoundingSphere();
 
     math::vec3  center() const { return m_centerPoint; }
@@ -18,6 +18,9 @@
 namespace rend
 {
 
+//! Triangles transformed and culled by the batch kernels at a time.
+static const size_t CULL_CHUNK = 256;
+
 Camera::Camera(const math::vec3 position,
                float fov,
                float nearZ,
@@ -99,35 +102,88 @@ void Camera::buildCamMatrix()
     // compute result matrix
     m_worldToCamera.set(-m_position);
     m_worldToCamera *= mrot;
+
+    m_viewProjection = m_worldToCamera * m_projection;
+    m_frustum.set(m_viewProjection, m_nearZ, m_farZ);
+}
+
+void Camera::buildProjection(int width, int height, float aspect)
+{
+    // x' = d * x, y' = d * y, w = z
+    float scale = m_distance / (0.5f * m_viewPlaneWidth);
+    m_projection.set(scale, 0.0f, 0.0f, 0.0f,
+                     0.0f, scale * aspect, 0.0f, 0.0f,
+                     0.0f, 0.0f, 1.0f, 1.0f,
+                     0.0f, 0.0f, 0.0f, 0.0f);
+
+    float alpha = 0.5f * width - 0.5f;
+    float beta = 0.5f * height - 0.5f;
+    m_screen.set(alpha, 0.0f, 0.0f, 0.0f,
+                 0.0f, -beta, 0.0f, 0.0f,
+                 0.0f, 0.0f, 1.0f, 0.0f,
+                 alpha, beta, 0.0f, 1.0f);
+
+    m_viewProjection = m_worldToCamera * m_projection;
+    m_frustum.set(m_viewProjection, m_nearZ, m_farZ);
 }
 
 void Camera::toCamera(RenderList *rendList) const
+{
+    toCamera(rendList, 0, rendList->getSize());
+}
+
+size_t Camera::toCamera(RenderList *rendList, size_t from, size_t to) const
 {
     RenderList::Triangles &trias = rendList->triangles();
+    size_t culled = 0;
+
+    // camera space positions of the first, second and third vertices of the chunk triangles
+    float x[3][CULL_CHUNK], y[3][CULL_CHUNK], z[3][CULL_CHUNK];
 
-    for (auto &t : trias)
+    for (size_t first = from; first < to; first += CULL_CHUNK)
     {
-        if (t.clipped)
-            continue;
+        size_t count = std::min(CULL_CHUNK, to - first);
 
-        t.applyTransformation(m_worldToCamera);
+        for (int k = 0; k < 3; k++)
+            math::TransformPoints(m_worldToCamera, &trias[first].v(k).p, sizeof(math::Triangle), count, x[k], y[k], z[k], 0);
 
-        // delete all triangles, that lies behind z plane
-        if (t.v(0).p.z < m_distance || t.v(1).p.z < m_distance || t.v(2).p.z < m_distance)
+        for (size_t i = 0; i < count; i++)
         {
-//            t = trias.erase(t);
-//            continue;
-            t.clipped = true;
+            math::Triangle &t = trias[first + i];
+
+            if (t.clipped)
+                continue;
+
+            for (int k = 0; k < 3; k++)
+                t.v(k).p.set(x[k][i], y[k][i], z[k][i]);
+
+            // delete all triangles, that lies behind z plane
+            if (z[0][i] < m_distance || z[1][i] < m_distance || z[2][i] < m_distance)
+            {
+//                t = trias.erase(t);
+//                continue;
+                t.clipped = true;
+                culled++;
+            }
         }
     }
+
+    return culled;
 }
 
 void Camera::toScreen(RenderList *rendList, const Viewport &viewport) const
+{
+    toScreen(rendList, viewport, 0, rendList->getSize());
+}
+
+void Camera::toScreen(RenderList *rendList, const Viewport &viewport, size_t from, size_t to) const
 {
     RenderList::Triangles &trias = rendList->triangles();
 
-    for (auto &t : trias)
+    for (size_t i = from; i < to; i++)
     {
+        math::Triangle &t = trias[i];
+
         if (t.clipped)
             continue;
 
@@ -142,84 +198,72 @@ void Camera::toScreen(RenderList *rendList, const Viewport &viewport) const
 }
 
 void Camera::frustumCull(RenderList *rendList) const
+{
+    frustumCull(rendList, 0, rendList->getSize());
+}
+
+size_t Camera::frustumCull(RenderList *rendList, size_t from, size_t to) const
 {
     RenderList::Triangles &trias = rendList->triangles();
+    size_t culled = 0;
 
-    auto testFn = [](float coord, float plane) -> bool { return coord > plane || coord < -plane; };
+    // clip space x, y, w and the flags of the first, second and third vertices of the chunk triangles
+    float x[3][CULL_CHUNK], y[3][CULL_CHUNK], w[3][CULL_CHUNK];
+    uint8_t flags[3][CULL_CHUNK];
 
-    float zfactor = 0.5f * m_viewPlaneWidth / m_distance;
-    bool cull1_x = false, cull2_x = false, cull3_x = false;
-    bool cull1_y = false, cull2_y = false, cull3_y = false;
-    for (auto &t : trias)
+    for (size_t first = from; first < to; first += CULL_CHUNK)
     {
-        if (t.clipped)
-            continue;
+        size_t count = std::min(CULL_CHUNK, to - first);
 
-        // xz plane
-        cull1_x = testFn(t.v(0).p.x, zfactor * t.v(0).p.z);
-        cull2_x = testFn(t.v(1).p.x, zfactor * t.v(1).p.z);
-        cull3_x = testFn(t.v(2).p.x, zfactor * t.v(2).p.z);
-
-        // yz plane
-        cull1_y = testFn(t.v(0).p.y, zfactor * t.v(0).p.z);
-        cull2_y = testFn(t.v(1).p.y, zfactor * t.v(1).p.z);
-        cull3_y = testFn(t.v(2).p.y, zfactor * t.v(2).p.z);
+        for (int k = 0; k < 3; k++)
+        {
+            math::TransformPoints(m_projection, &trias[first].v(k).p, sizeof(math::Triangle), count, x[k], y[k], 0, w[k]);
+            clipFlags(x[k], y[k], w[k], count, flags[k]);
+        }
 
-        // triangle out of fov
-        if ((cull1_x && cull2_x && cull3_x) || (cull1_y && cull2_y && cull3_y))
+        for (size_t i = 0; i < count; i++)
         {
-//            t = trias.erase(t);
-//            continue;
-            t.clipped = true;
+            math::Triangle &t = trias[first + i];
+
+            if (t.clipped)
+                continue;
+
+            // triangle out of fov: all vertices are outside of the same plane
+            int outside = flags[0][i] & flags[1][i] & flags[2][i];
+            if (outside & ~CLIP_NEAR)
+            {
+//                t = trias.erase(t);
+//                continue;
+                t.clipped = true;
+                culled++;
+            }
         }
     }
+
+    return culled;
 }
 
-bool Camera::culled(const sptr(SceneObject) obj) const
+int Camera::clipFlags(const math::vec3 &v) const
 {
-    math::vec3 spherePos = obj->getPosition();
-    if (!obj->bsphere().valid())
-        return false;
-
-    float radius = obj->bsphere().radius();
-    spherePos = spherePos * m_worldToCamera;
-
-    // check Z plane
-    if (((spherePos.z - radius) > m_farZ)
-            || ((spherePos.z + radius) < m_nearZ))
-        return true;
-
-//    // check X plane
-//    float zTest = 0.5 * m_viewPlaneWidth * spherePos.z / m_distance;
-//    if (((spherePos.x - radius) > zTest) ||
-//            ((spherePos.x + radius) < -zTest))
-//        return true;
-
-//    // check Y plane
-//    zTest = 0.5 * m_viewPlaneHeight * spherePos.z / m_distance;
-//    if (((spherePos.y - radius) > zTest) ||
-//            ((spherePos.y + radius) < -zTest))
-//        return true;
-
-    return false;
+    return clipFlags(v.x * m_projection.x[0][0], v.y * m_projection.x[1][1], v.z);
 }
 
-void Camera::toScreen(math::vec3 &v, const Viewport &viewport) const
+math::FrustumRelation Camera::classify(const sptr(SceneObject) obj) const
 {
-    // perspective transformation
-    float z = v.z;
-
-    assert(z != 0.0f);
+    // world space sphere, scaled and rotated with the object
+    BoundingSphere sphere = obj->bsphere();
+    if (!sphere.valid())
+        return math::FRUSTUM_INTERSECT;
 
-    v.x = m_distance * v.x / z;
-    v.y = m_distance * v.y * viewport.getAspect() / z;
+    return m_frustum.testSphere(sphere.center(), sphere.radius());
+}
 
-    // screen transformation
-    float alpha = 0.5f * viewport.getWidth() - 0.5f;
-    float beta = 0.5f * viewport.getHeight() - 0.5f;
+void Camera::toScreen(math::vec3 &v, const Viewport &/*viewport*/) const
+{
+    assert(v.z != 0.0f);
 
-    v.x = alpha + alpha * v.x;
-    v.y = beta - beta * v.y;
+    // camera -> clip space (w is camera space z), perspective and screen transformation
+    clipToScreen(v.x * m_projection.x[0][0], v.y * m_projection.x[1][1], v.z, v.x, v.y);
 }
 
 }
@@ -10,6 +10,8 @@
 
 #include "math/vec3.h"
 #include "math/m44.h"
+#include "math/simd.h"
+#include "math/frustum.h"
 
 namespace rend
 {
@@ -51,16 +53,32 @@ class Camera
     //! Distance from the (0, 0, 0) to the projected plane along Z axis.
     float m_distance;
 
+    //! World -> camera transformation.
     math::M44 m_worldToCamera;
+    //! Camera -> clip space. After the perspective divide the view volume is [-1, 1].
     math::M44 m_projection;
+    //! World -> clip space, concatenation of the two above.
+    math::M44 m_viewProjection;
+    //! Clip space (after the perspective divide) -> screen.
     math::M44 m_screen;
-
-    // helpers
-    void toScreen(math::vec3 &v, const Viewport &viewport) const;
+    //! World space view volume, rebuilt with the view projection matrix.
+    math::Frustum m_frustum;
 
     void buildCamMatrix();
+    //! Rebuilds the projection and screen matrices. Called by the viewport.
+    void buildProjection(int width, int height, float aspect);
 
 public:
+    //! Flags of the camera space point, which is outside of the view volume.
+    enum ClipFlags
+    {
+        CLIP_NEAR = math::CLIP_PLANE_NEAR,      /*!< Behind the projection plane. */
+        CLIP_LEFT = math::CLIP_PLANE_LEFT,
+        CLIP_RIGHT = math::CLIP_PLANE_RIGHT,
+        CLIP_BOTTOM = math::CLIP_PLANE_BOTTOM,
+        CLIP_TOP = math::CLIP_PLANE_TOP
+    };
+
     //! Default ctor.
     /*! Initialize camera with position,
       * field of view (default 90 gr.), near and far clipping planes */
@@ -81,11 +99,66 @@ public:
 
     void setEulerAnglesRotation(float yaw, float pitch, float roll);
 
+    const math::M44 &getWorldToCameraMatrix() const { return m_worldToCamera; }
+    const math::M44 &getProjectionMatrix() const { return m_projection; }
+    const math::M44 &getViewProjectionMatrix() const { return m_viewProjection; }
+    const math::Frustum &getFrustum() const { return m_frustum; }
+    //! Screen height in pixels of the unit length at the unit distance, for the level of detail selection.
+    float pixelsPerUnit() const { return fabs(m_screen.x[1][1] * m_projection.x[1][1]); }
+
+    //! Returns ClipFlags of the clip space point.
+    int clipFlags(float x, float y, float w) const
+    {
+        int flags = w < m_distance ? CLIP_NEAR : 0;
+
+        if (x < -w)
+            flags |= CLIP_LEFT;
+        else if (x > w)
+            flags |= CLIP_RIGHT;
+
+        if (y < -w)
+            flags |= CLIP_BOTTOM;
+        else if (y > w)
+            flags |= CLIP_TOP;
+
+        return flags;
+    }
+    //! Returns ClipFlags of the camera space point.
+    int clipFlags(const math::vec3 &v) const;
+    //! Perspective divide and screen transformation of the clip space point.
+    void clipToScreen(float x, float y, float w, float &sx, float &sy) const
+    {
+        float invW = 1.0f / w;
+
+        sx = m_screen.x[0][0] * x * invW + m_screen.x[3][0];
+        sy = m_screen.x[1][1] * y * invW + m_screen.x[3][1];
+    }
+    //! ClipFlags of the clip space points in SoA layout.
+    void clipFlags(const float *x, const float *y, const float *w, size_t count, uint8_t *flags) const
+    {
+        math::ClipFlags(x, y, w, count, m_distance, flags);
+    }
+    //! clipToScreen() of the points in SoA layout. Outputs may alias the inputs.
+    void clipToScreen(const float *x, const float *y, const float *w, size_t count, float *sx, float *sy) const
+    {
+        math::ClipToScreen(x, y, w, count, m_screen.x[0][0], m_screen.x[3][0], m_screen.x[1][1], m_screen.x[3][1], sx, sy);
+    }
+    //! Camera space -> perspective -> screen transformation of the point. Keeps camera space Z.
+    void toScreen(math::vec3 &v, const Viewport &viewport) const;
+
     void toCamera(RenderList *rendList) const;
+    //! Returns count of triangles culled by the near plane.
+    size_t toCamera(RenderList *rendList, size_t from, size_t to) const;
     void toScreen(RenderList *rendList, const Viewport &viewport) const;
+    void toScreen(RenderList *rendList, const Viewport &viewport, size_t from, size_t to) const;
 
     void frustumCull(RenderList *rendList) const;
-    bool culled(const sptr(SceneObject) obj) const;
+    //! Returns count of the culled triangles.
+    size_t frustumCull(RenderList *rendList, size_t from, size_t to) const;
+    //! Tests the object bounding sphere against six frustum planes.
+    math::FrustumRelation classify(const sptr(SceneObject) obj) const;
+    //! Object is outside of the frustum.
+    bool culled(const sptr(SceneObject) obj) const { return classify(obj) == math::FRUSTUM_OUTSIDE; }
 };
 
 }
@@ -143,9 +143,6 @@ public:
         m_b = BlueFromInt(color);
     }
 
-    //! Dtor.
-    ~Color3() { }
-
     //! Returns raw color in 32bit integer value.
     uint32_t color() const { return RgbToInt(m_r, m_g, m_b); }
     //! Casts this object to 32bit integer color.
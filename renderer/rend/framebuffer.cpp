@@ -12,6 +12,9 @@
 namespace rend
 {
 
+//! Extra floats after the last row, so 4-wide loads never read past the allocation.
+static const int ZBUFFER_PADDING = 4;
+
 void memset32(void *dest, uint32_t data, int count)
 {
 #ifdef _MSC_VER
@@ -29,6 +32,7 @@ void memset32(void *dest, uint32_t data, int count)
 FrameBuffer::FrameBuffer(int w, int h)
     : m_pixels(0),
       m_zbuffer(0),
+      m_coverage(0),
       m_width(w),
       m_height(h),
       m_xOrigin(0),
@@ -37,7 +41,7 @@ FrameBuffer::FrameBuffer(int w, int h)
 {
     m_size = m_width * m_height;
     m_pixels = new rgb[m_size];
-    m_zbuffer = new float[m_size];
+    m_zbuffer = new float[m_size + ZBUFFER_PADDING];
 }
 
 FrameBuffer::~FrameBuffer()
@@ -46,13 +50,18 @@ FrameBuffer::~FrameBuffer()
         delete [] m_pixels;
     if (m_zbuffer)
         delete [] m_zbuffer;
+    if (m_coverage)
+        delete [] m_coverage;
 }
 
 void FrameBuffer::clear()
 {
     memset(m_pixels, 0x00, sizeof(rgb) * m_width * m_height);
-    memset(m_zbuffer, 0x00, sizeof(float) * m_width * m_height);         // NOTE: this is 1/z buffer
+    memset(m_zbuffer, 0x00, sizeof(float) * (m_width * m_height + ZBUFFER_PADDING));         // NOTE: this is 1/z buffer
 //    memset32(m_zbuffer, std::numeric_limits<int>::max(), m_width * m_height);         // for z buffer
+
+    if (m_coverage)
+        memset(m_coverage, 0x00, m_width * m_height);
 }
 
 void FrameBuffer::resize(int w, int h)
@@ -67,9 +76,44 @@ void FrameBuffer::resize(int w, int h)
         delete [] m_zbuffer;
 
     m_pixels = new rgb[m_size];
-    m_zbuffer = new float[m_size];
+    m_zbuffer = new float[m_size + ZBUFFER_PADDING];
+
+    if (m_coverage)
+    {
+        delete [] m_coverage;
+        m_coverage = new uint8_t[m_size];
+    }
 
     clear();
 }
 
+void FrameBuffer::setCoverageTest(bool enabled)
+{
+    if (enabled && !m_coverage)
+    {
+        m_coverage = new uint8_t[m_size];
+        memset(m_coverage, 0x00, m_size);
+    }
+    else if (!enabled && m_coverage)
+    {
+        delete [] m_coverage;
+        m_coverage = 0;
+    }
+}
+
+int FrameBuffer::duplicateWrites() const
+{
+    if (!m_coverage)
+        return 0;
+
+    int duplicates = 0;
+    for (int i = 0; i < m_size; i++)
+    {
+        if (m_coverage[i] > 1)
+            duplicates += m_coverage[i] - 1;
+    }
+
+    return duplicates;
+}
+
 }
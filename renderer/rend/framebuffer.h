@@ -40,6 +40,8 @@ private:
     rgb *m_pixels;
     //! Z Buffer contains 1/z values (in order to perform perspective correct rasterization).
     float *m_zbuffer;
+    //! How many times each pixel was written during the frame. Allocated only in coverage test mode.
+    uint8_t *m_coverage;
 
     int m_width;
     int m_height;
@@ -47,9 +49,14 @@ private:
     int m_yOrigin;
     int m_size;
 
+public:
+    FrameBuffer(int w, int h);
+    ~FrameBuffer();
+
+    //! Writes the pixel without bounds checking and depth test.
     void blendAndStore(int pos, uint8_t r, uint8_t g, uint8_t b, int alpha = 255)
     {
-        static float a, oneMinusAlpha;
+        float a, oneMinusAlpha;
 
         rgb &currPix = m_pixels[pos];
 
@@ -70,10 +77,6 @@ private:
         }
     }
 
-public:
-    FrameBuffer(int w, int h);
-    ~FrameBuffer();
-
     void clear();
 
     void wscanline(const int x1, const int x2,
@@ -91,6 +94,17 @@ public:
     int xorig() const { return m_xOrigin; }
     int yorig() const { return m_yOrigin; }
 
+    //! Raw 1/z buffer. Rows are m_width floats long, padded with 4 floats at the end for SSE loads.
+    float *zbuffer() { return m_zbuffer; }
+
+    //! Coverage test mode: rasterizers count the pixel writes, which passed the depth test,
+    //! so we can check that pixels on the shared edges are written once.
+    void setCoverageTest(bool enabled);
+    //! Coverage counters or 0 if coverage test is disabled.
+    uint8_t *coverage() { return m_coverage; }
+    //! Number of pixel writes over the first one during the frame (in coverage test mode).
+    int duplicateWrites() const;
+
     void resize(int w, int h);
 
     operator unsigned char *() { return (unsigned char *)m_pixels; }
@@ -122,7 +136,7 @@ inline void FrameBuffer::wpixel(const int x, const int y, const Color3 &color, i
 
 inline void FrameBuffer::wpixel(const int x, const int y, const Color3 &color, float z, int alpha)
 {
-    static float a, oneMinusAlpha;
+    float a, oneMinusAlpha;
 
     if (!(x >= 0 && x < m_width && y >= 0 && y < m_height))
         return;
@@ -0,0 +1,97 @@
+/*
+ * heightsource.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "heightsource.h"
+
+#include "texture.h"
+
+namespace rend
+{
+
+TextureHeightSource::TextureHeightSource(const sptr(Texture) texture)
+    : m_texture(texture)
+{
+    assert(texture);
+}
+
+int TextureHeightSource::columns() const
+{
+    return m_texture->width();
+}
+
+int TextureHeightSource::rows() const
+{
+    return m_texture->height();
+}
+
+void TextureHeightSource::read(int column, int row, int columns, int rows, float *heights) const
+{
+    int width = m_texture->width();
+    int height = m_texture->height();
+
+    for (int z = 0; z < rows; z++)
+    {
+        int y = std::min(std::max(row + z, 0), height - 1);
+
+        for (int x = 0; x < columns; x++)
+        {
+            int sx = std::min(std::max(column + x, 0), width - 1);
+            *heights++ = (float)RedFromInt(m_texture->texel(sx, y)) / 255.0f;
+        }
+    }
+}
+
+RawHeightSource::RawHeightSource(const std::string &path, int columns, int rows, int sampleSize)
+    : m_file(path.c_str(), std::ios::in | std::ios::binary),
+      m_columns(columns),
+      m_rows(rows),
+      m_sampleSize(sampleSize)
+{
+    assert(sampleSize == 1 || sampleSize == 2);
+
+    if (!m_file)
+        throw HeightSourceException(("Can't open height map " + path).c_str());
+}
+
+void RawHeightSource::read(int column, int row, int columns, int rows, float *heights) const
+{
+    const float maxValue = m_sampleSize == 1 ? 255.0f : 65535.0f;
+
+    // continuous part of the row inside of the grid, the rest is clamped
+    int first = std::min(std::max(column, 0), m_columns - 1);
+    int last = std::min(std::max(column + columns - 1, 0), m_columns - 1);
+    std::vector<uint8_t> bytes((last - first + 1) * m_sampleSize);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (int z = 0; z < rows; z++)
+    {
+        int y = std::min(std::max(row + z, 0), m_rows - 1);
+
+        m_file.clear();
+        m_file.seekg(((std::streamoff)y * m_columns + first) * m_sampleSize);
+        m_file.read(reinterpret_cast<char *>(&bytes[0]), bytes.size());
+
+        if (!m_file)
+        {
+            syslog << "Can't read the height map row" << y << logerr;
+            std::fill(bytes.begin(), bytes.end(), 0);
+        }
+
+        for (int x = 0; x < columns; x++)
+        {
+            int i = std::min(std::max(column + x, first), last) - first;
+            float value = m_sampleSize == 1 ? bytes[i] : (float)(bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+
+            *heights++ = value / maxValue;
+        }
+    }
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+ * heightsource.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef HEIGHTSOURCE_H
+#define HEIGHTSOURCE_H
+
+#include <mutex>
+
+namespace rend
+{
+
+DECLARE_EXCEPTION(HeightSourceException)
+
+class Texture;
+
+//! Grid of heights, which is read by blocks.
+class HeightSource
+{
+public:
+    virtual ~HeightSource() { }
+
+    //! Samples count in a row.
+    virtual int columns() const = 0;
+    //! Rows count.
+    virtual int rows() const = 0;
+
+    //! Reads heights in [0, 1] of the block row by row. Samples outside of the grid are clamped.
+    /*! May be called from any thread. */
+    virtual void read(int column, int row, int columns, int rows, float *heights) const = 0;
+};
+
+//! Heights from the red channel of the decoded image.
+class TextureHeightSource : public HeightSource
+{
+    sptr(Texture) m_texture;
+
+public:
+    TextureHeightSource(const sptr(Texture) texture);
+
+    int columns() const;
+    int rows() const;
+
+    void read(int column, int row, int columns, int rows, float *heights) const;
+};
+
+//! Heights in the raw file of 8 or 16 bit (little endian) unsigned samples, row by row.
+/*!
+  * The file is not loaded into memory, only the rows of the block are read from it.
+  */
+class RawHeightSource : public HeightSource
+{
+    mutable std::ifstream m_file;
+    mutable std::mutex m_mutex;
+    int m_columns, m_rows;
+    int m_sampleSize;
+
+public:
+    //! Opens the file, throws HeightSourceException if it fails. sampleSize is 1 or 2 bytes.
+    RawHeightSource(const std::string &path, int columns, int rows, int sampleSize = 2);
+
+    int columns() const { return m_columns; }
+    int rows() const { return m_rows; }
+
+    void read(int column, int row, int columns, int rows, float *heights) const;
+
+    NONCOPYABLE(RawHeightSource)
+};
+
+}
+
+#endif // HEIGHTSOURCE_H
@@ -0,0 +1,123 @@
+/*
+ * indexarray.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef INDEXARRAY_H
+#define INDEXARRAY_H
+
+namespace rend
+{
+
+//! Indices of the vertex buffer, 16 bit while all of them fit, 32 bit otherwise.
+/*!
+  * Small buffers keep the half of the memory and of the bandwidth. The array is widened once,
+  * when the first big index comes. Hot loops take the typed data once per buffer with data()
+  * and are instantiated for both widths, the rest of the code reads the indices by operator[].
+  */
+class IndexArray
+{
+    std::vector<uint16_t> m_short;
+    std::vector<uint32_t> m_long;
+    bool m_wide;
+
+    void widen()
+    {
+        m_long.assign(m_short.begin(), m_short.end());
+        std::vector<uint16_t>().swap(m_short);
+        m_wide = true;
+    }
+
+public:
+    //! Max index of the 16 bit array.
+    static const uint32_t SHORT_MAX = 0xffff;
+
+    IndexArray() : m_wide(false) { }
+
+    template<typename It>
+    IndexArray(It first, It last) : m_wide(false) { assign(first, last); }
+
+    template<typename It>
+    void assign(It first, It last)
+    {
+        clear();
+
+        // the width is chosen before the copy
+        for (It it = first; it != last && !m_wide; ++it)
+        {
+            if ((uint32_t)*it > SHORT_MAX)
+                m_wide = true;
+        }
+
+        if (m_wide)
+            m_long.assign(first, last);
+        else
+            m_short.assign(first, last);
+    }
+
+    void push_back(uint32_t index)
+    {
+        if (!m_wide && index > SHORT_MAX)
+            widen();
+
+        if (m_wide)
+            m_long.push_back(index);
+        else
+            m_short.push_back((uint16_t)index);
+    }
+
+    void reserve(size_t count)
+    {
+        if (m_wide)
+            m_long.reserve(count);
+        else
+            m_short.reserve(count);
+    }
+
+    void clear()
+    {
+        m_short.clear();
+        m_long.clear();
+        m_wide = false;
+    }
+
+    void swap(IndexArray &other)
+    {
+        m_short.swap(other.m_short);
+        m_long.swap(other.m_long);
+        std::swap(m_wide, other.m_wide);
+    }
+
+    size_t size() const { return m_wide ? m_long.size() : m_short.size(); }
+    bool empty() const { return size() == 0; }
+
+    uint32_t operator[] (size_t i) const { return m_wide ? m_long[i] : m_short[i]; }
+
+    //! Indices are 32 bit.
+    bool wide() const { return m_wide; }
+    size_t bytesPerIndex() const { return m_wide ? sizeof(uint32_t) : sizeof(uint16_t); }
+
+    //! Typed indices, uint16_t or uint32_t as wide() tells. Null for the empty array.
+    template<typename Index>
+    const Index *data() const;
+};
+
+template<>
+inline const uint16_t *IndexArray::data<uint16_t>() const
+{
+    assert(!m_wide);
+    return m_short.empty() ? 0 : &m_short[0];
+}
+
+template<>
+inline const uint32_t *IndexArray::data<uint32_t>() const
+{
+    assert(m_wide);
+    return m_long.empty() ? 0 : &m_long[0];
+}
+
+}
+
+#endif // INDEXARRAY_H
@@ -0,0 +1,203 @@
+/*
+ * instancedsceneobject.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "instancedsceneobject.h"
+#include "camera.h"
+#include "mesh.h"
+#include "material.h"
+
+namespace rend
+{
+
+InstancedSceneObject::InstancedSceneObject(sptr(Mesh) mesh)
+    : SceneObject(mesh),
+      m_dirty(true)
+{
+    setName("instanced");
+}
+
+void InstancedSceneObject::instancesChanged()
+{
+    m_dirty = true;
+    transformChanged();
+}
+
+void InstancedSceneObject::update() const
+{
+    if (!m_dirty && m_lastTransformation == getTransformation())
+        return;
+
+    m_dirty = false;
+    m_lastTransformation = getTransformation();
+
+    size_t count = m_instances.size();
+    m_world.resize(count);
+    m_x.resize(count);
+    m_y.resize(count);
+    m_z.resize(count);
+    m_radius.resize(count);
+    m_bounds = BoundingSphere();
+
+    const BoundingSphere &local = getMesh()->getBoundingSphere();
+    if (count == 0 || !local.valid())
+        return;
+
+    math::vec3 min, max;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        m_world[i] = m_instances[i].transform * m_lastTransformation;
+
+        math::vec3 center = local.center() * m_world[i];
+        float radius = local.radius() * m_world[i].getM().maxScale();
+
+        m_x[i] = center.x;
+        m_y[i] = center.y;
+        m_z[i] = center.z;
+        m_radius[i] = radius;
+
+        math::vec3 r(radius, radius, radius);
+        if (i == 0)
+        {
+            min = center - r;
+            max = center + r;
+            continue;
+        }
+
+        min = math::vec3(std::min(min.x, center.x - radius), std::min(min.y, center.y - radius), std::min(min.z, center.z - radius));
+        max = math::vec3(std::max(max.x, center.x + radius), std::max(max.y, center.y + radius), std::max(max.z, center.z + radius));
+    }
+
+    // sphere around the instance spheres, centered in their box
+    math::vec3 center = 0.5f * (min + max);
+    float radius = 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        math::vec3 d = math::vec3(m_x[i], m_y[i], m_z[i]) - center;
+        radius = std::max(radius, d.length() + m_radius[i]);
+    }
+
+    m_bounds = BoundingSphere(center, radius);
+}
+
+size_t InstancedSceneObject::addInstance(const math::M44 &transform, sptr(Material) material)
+{
+    Instance instance;
+    instance.transform = transform;
+    instance.material = material;
+
+    m_instances.push_back(instance);
+    instancesChanged();
+
+    return m_instances.size() - 1;
+}
+
+void InstancedSceneObject::removeInstance(size_t index)
+{
+    if (index >= m_instances.size())
+    {
+        syslog << "Wrong instance index" << (int)index << logerr;
+        return;
+    }
+
+    m_instances[index] = m_instances.back();
+    m_instances.pop_back();
+    instancesChanged();
+}
+
+void InstancedSceneObject::clearInstances()
+{
+    m_instances.clear();
+    instancesChanged();
+}
+
+void InstancedSceneObject::setInstanceTransform(size_t index, const math::M44 &transform)
+{
+    if (index >= m_instances.size())
+    {
+        syslog << "Wrong instance index" << (int)index << logerr;
+        return;
+    }
+
+    m_instances[index].transform = transform;
+    instancesChanged();
+}
+
+void InstancedSceneObject::setInstanceMaterial(size_t index, sptr(Material) material)
+{
+    if (index >= m_instances.size())
+    {
+        syslog << "Wrong instance index" << (int)index << logerr;
+        return;
+    }
+
+    // the sphere is not changed
+    m_instances[index].material = material;
+}
+
+const math::M44 &InstancedSceneObject::getInstanceWorld(size_t index) const
+{
+    update();
+
+    return m_world[index];
+}
+
+sptr(Mesh) InstancedSceneObject::getInstanceMesh(size_t lod) const
+{
+    const sptr(Mesh) mesh = getMesh();
+    if (lod == 0 || !mesh || lod > mesh->numLods())
+        return mesh;
+
+    return mesh->getLod(lod - 1);
+}
+
+BoundingSphere InstancedSceneObject::bsphere() const
+{
+    update();
+
+    return m_bounds;
+}
+
+void InstancedSceneObject::selectLod(const Camera &)
+{
+}
+
+void InstancedSceneObject::cullInstances(const Camera &camera, math::FrustumRelation relation, std::vector<Visible> &visible)
+{
+    visible.clear();
+
+    update();
+
+    size_t count = m_instances.size();
+    if (count == 0 || relation == math::FRUSTUM_OUTSIDE)
+        return;
+
+    m_relations.resize(count);
+
+    if (relation == math::FRUSTUM_INSIDE)
+        std::fill(m_relations.begin(), m_relations.end(), math::FRUSTUM_INSIDE);
+    else
+        camera.getFrustum().testSpheres(&m_x[0], &m_y[0], &m_z[0], &m_radius[0], count, &m_relations[0]);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (m_relations[i] == math::FRUSTUM_OUTSIDE)
+            continue;
+
+        Visible instance;
+        instance.index = i;
+        instance.relation = m_relations[i];
+        instance.lod = lodFor(BoundingSphere(math::vec3(m_x[i], m_y[i], m_z[i]), m_radius[i]), camera);
+
+        visible.push_back(instance);
+    }
+}
+
+}
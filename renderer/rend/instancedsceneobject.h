@@ -0,0 +1,98 @@
+/*
+ * instancedsceneobject.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef INSTANCEDSCENEOBJECT_H
+#define INSTANCEDSCENEOBJECT_H
+
+#include "sceneobject.h"
+#include "../math/m44.h"
+#include "../math/frustum.h"
+
+namespace rend
+{
+
+struct Material;
+
+//! Many copies of one mesh.
+/*!
+  * The mesh and its levels of detail are shared by all instances and are not copied, every instance
+  * has only its transformation and optionally its own material, which replaces the materials
+  * of all submeshes. Instance transformations are applied before the transformation of the object.
+  *
+  * The scene tree and the occlusion culling see the object as one sphere around all instances.
+  * RenderMgr then culls the instances against the frustum four spheres at a time and chooses
+  * the level of detail of every visible instance. The mesh should not be changed while it is drawn.
+  *
+  * The object should not be an occluder, only its mesh would be drawn into the occlusion buffer.
+  */
+class InstancedSceneObject : public SceneObject
+{
+public:
+    struct Instance
+    {
+        math::M44 transform;
+        //! Replaces the materials of the mesh, if it is not null.
+        sptr(Material) material;
+    };
+
+    //! Instance, which is not outside of the frustum.
+    struct Visible
+    {
+        size_t index;
+        math::FrustumRelation relation;
+        //! Level of detail, 0 is the mesh itself.
+        size_t lod;
+    };
+
+private:
+    std::vector<Instance> m_instances;
+
+    //! World transformations and spheres of the instances, rebuilt when the instances or the object are moved.
+    mutable std::vector<math::M44> m_world;
+    mutable std::vector<float> m_x, m_y, m_z, m_radius;
+    mutable BoundingSphere m_bounds;
+    mutable math::M44 m_lastTransformation;
+    mutable bool m_dirty;
+
+    std::vector<math::FrustumRelation> m_relations;
+
+    void instancesChanged();
+    void update() const;
+
+public:
+    InstancedSceneObject(sptr(Mesh) mesh);
+
+    //! Returns the index of the new instance.
+    size_t addInstance(const math::M44 &transform, sptr(Material) material = sptr(Material)());
+    //! The last instance takes the place of the removed one.
+    void removeInstance(size_t index);
+    void clearInstances();
+
+    void setInstanceTransform(size_t index, const math::M44 &transform);
+    void setInstanceMaterial(size_t index, sptr(Material) material);
+
+    size_t numInstances() const { return m_instances.size(); }
+    const Instance &getInstance(size_t index) const { return m_instances[index]; }
+    //! Instance transformation followed by the object one.
+    const math::M44 &getInstanceWorld(size_t index) const;
+    //! Mesh of the level of detail, 0 is the mesh itself.
+    sptr(Mesh) getInstanceMesh(size_t lod) const;
+
+    //! Sphere around all instances.
+    virtual BoundingSphere bsphere() const;
+
+    //! Levels of detail are chosen per instance by cullInstances().
+    virtual void selectLod(const Camera &camera);
+
+    //! Instances, which spheres are not outside of the frustum.
+    /*! \param relation Relation of the whole object, the instances of the inner one are not tested. */
+    void cullInstances(const Camera &camera, math::FrustumRelation relation, std::vector<Visible> &visible);
+};
+
+}
+
+#endif // INSTANCEDSCENEOBJECT_H
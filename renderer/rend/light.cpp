@@ -8,6 +8,7 @@
 #include "stdafx.h"
 
 #include "light.h"
+#include "material.h"
 
 namespace rend
 {
@@ -33,58 +34,10 @@ Light::~Light()
     NumLights--;
 }
 
-void Light::illuminate(RenderList *renderlist) const
-{
-    if (!m_isEnabled)
-        return;
-
-    auto &trias = renderlist->triangles();
-
-    for (auto &t : trias)
-    {
-        if (t.clipped)
-            continue;
-
-        auto material = t.getMaterial();
-        if (!material)
-            continue;
-
-        switch (material->shadeMode)
-        {
-        case Material::SM_FLAT:
-//            t.v(0).color = t.v(1).color = t.v(2).color = m_shader(this, getMaterialColor(material), t.normal());
-            t.v(0).color += shader(material, t.normal(), t.v(0).p);
-            t.v(1).color += shader(material, t.normal(), t.v(0).p);
-            t.v(2).color += shader(material, t.normal(), t.v(0).p);
-            break;
-
-        case Material::SM_GOURAUD:
-            t.v(0).color += shader(material, t.v(0).n, t.v(0).p);
-            t.v(1).color += shader(material, t.v(1).n, t.v(0).p);
-            t.v(2).color += shader(material, t.v(2).n, t.v(0).p);
-            break;
-
-        case Material::SM_UNDEFINED:
-        case Material::SM_PLAIN_COLOR:
-        case Material::SM_WIRE:
-            t.v(0).color = t.v(1).color = t.v(2).color = material->plainColor;
-            break;
-        case Material::SM_TEXTURE:
-            // texture - performing standart flat shading. On rasterizing phaze we modulate texture texels with this color.
-            t.v(0).color += shader(material, t.normal(), t.v(0).p);
-            t.v(1).color += shader(material, t.normal(), t.v(0).p);
-            t.v(2).color += shader(material, t.normal(), t.v(0).p);
-            break;
-        default:
-            break;
-        }
-    }
-}
-
-Color3 AmbientLight::shader(const sptr(Material) material, const math::vec3 &/*normal*/, const math::vec3 &/*pt*/) const
+Color3 AmbientLight::shader(const Material &material, const math::vec3 &/*normal*/, const math::vec3 &/*pt*/) const
 {
     Color3 shadedColor;
-    shadedColor = m_intensity * material->ambientColor;
+    shadedColor = m_intensity * material.ambientColor;
     shadedColor *= (1 / 256.0);     // no /= operator in Color3
 
     return shadedColor;
@@ -95,7 +48,7 @@ AmbientLight::AmbientLight(const Color3 &intensity)
 {
 }
 
-Color3 DirectionalLight::shader(const sptr(Material) material, const math::vec3 &normal, const math::vec3 &/*pt*/) const
+Color3 DirectionalLight::shader(const Material &material, const math::vec3 &normal, const math::vec3 &/*pt*/) const
 {
     Color3 shadedColor;
 
@@ -105,7 +58,7 @@ Color3 DirectionalLight::shader(const sptr(Material) material, const math::vec3
     float dp = normal.dotProduct(m_dir);
     if (dp > 0)
     {
-        shadedColor = m_intensity * material->diffuseColor;
+        shadedColor = m_intensity * material.diffuseColor;
         shadedColor *= (dp / 256.0f);
     }
     else
@@ -121,7 +74,7 @@ DirectionalLight::DirectionalLight(const Color3 &intensity, const math::vec3 &di
     m_dir.normalize();
 }
 
-Color3 PointLight::shader(const sptr(Material) material, const math::vec3 &normal, const math::vec3 &pt) const
+Color3 PointLight::shader(const Material &material, const math::vec3 &normal, const math::vec3 &pt) const
 {
     Color3 shadedColor;
 
@@ -137,7 +90,7 @@ Color3 PointLight::shader(const sptr(Material) material, const math::vec3 &norma
         float atten = m_kc + m_kl * dist + m_kq * dist * dist;
         float i = dp / (dist * atten);
 
-        shadedColor = m_intensity * material->diffuseColor;
+        shadedColor = m_intensity * material.diffuseColor;
         shadedColor *= (i / 256.0f);
     }
     else
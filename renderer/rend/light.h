@@ -10,7 +10,6 @@
 
 #include "../math/vec3.h"
 #include "color.h"
-#include "renderlist.h"
 #include "node.h"
 
 namespace rend
@@ -18,6 +17,8 @@ namespace rend
 
 DECLARE_EXCEPTION(LightException)
 
+struct Material;
+
 class Light : public Node
 {
 public:
@@ -39,7 +40,7 @@ protected:
     bool m_isEnabled;   // on\off
     Color3 m_intensity;
 
-    virtual Color3 shader(const sptr(Material) material, const math::vec3 &normal, const math::vec3 &pt) const = 0;
+    virtual Color3 shader(const Material &material, const math::vec3 &normal, const math::vec3 &pt) const = 0;
 
     Light(const Color3 &intensity);
     virtual ~Light();
@@ -48,19 +49,31 @@ public:
     void turnon() { m_isEnabled = true; }
     void turnoff() { m_isEnabled = false; }
 
+    bool isEnabled() const { return m_isEnabled; }
+
     int getId() const { return m_lightId; }
+    virtual LightType getType() const = 0;
+    const Color3 &getIntensity() const { return m_intensity; }
 
-    virtual void illuminate(RenderList *renderlist) const;
+    //! Adds the light reflected by the point to the color. Does nothing when the light is off.
+    /*! Reference version of one light, frames are lit by Lighting with all lights at once. */
+    void shade(const Material &material, const math::vec3 &normal, const math::vec3 &pt, Color3 &color) const
+    {
+        if (m_isEnabled)
+            color += shader(material, normal, pt);
+    }
 };
 
 //! Ambient light
 class AmbientLight : public Light
 {
 protected:
-    virtual Color3 shader(const sptr(Material) material, const math::vec3 &normal, const math::vec3 &pt) const;
+    virtual Color3 shader(const Material &material, const math::vec3 &normal, const math::vec3 &pt) const;
 
 public:
     AmbientLight(const Color3 &intensity);
+
+    virtual LightType getType() const { return LT_AMBIENT_LIGHT; }
 };
 
 //! Directional light
@@ -68,10 +81,14 @@ class DirectionalLight : public Light
 {
     math::vec3 m_dir;
 
-    virtual Color3 shader(const sptr(Material) material, const math::vec3 &normal, const math::vec3 &pt) const;
+    virtual Color3 shader(const Material &material, const math::vec3 &normal, const math::vec3 &pt) const;
 
 public:
     DirectionalLight(const Color3 &intensity, const math::vec3 &dir);
+
+    virtual LightType getType() const { return LT_DIRECTIONAL_LIGHT; }
+    //! Unit direction, surfaces which normals look along it are lit.
+    const math::vec3 &getDirection() const { return m_dir; }
 };
 
 //! Point light
@@ -79,11 +96,15 @@ class PointLight : public Light
 {
     float m_kc, m_kl, m_kq;
 
-    virtual Color3 shader(const sptr(Material) material, const math::vec3 &normal, const math::vec3 &pt) const;
+    virtual Color3 shader(const Material &material, const math::vec3 &normal, const math::vec3 &pt) const;
 
 public:
     PointLight(const Color3 &intensity, const math::vec3 &pos,
                float kc, float kl, float kq);
+
+    virtual LightType getType() const { return LT_POINT_LIGHT; }
+    //! Constant, linear and quadratic attenuation.
+    void getAttenuation(float &kc, float &kl, float &kq) const { kc = m_kc; kl = m_kl; kq = m_kq; }
 };
 /*
 //! Spot light
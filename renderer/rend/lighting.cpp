@@ -0,0 +1,312 @@
+/*
+ * lighting.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "lighting.h"
+#include "simd.h"
+#include "light.h"
+#include "material.h"
+#include "renderlist.h"
+
+namespace rend
+{
+
+const size_t Lighting::MAX_POINTS;
+
+Lighting::Lighting()
+    : m_directionalCount(0),
+      m_pointCount(0),
+      m_enabled(false)
+{
+    m_ambient[0] = m_ambient[1] = m_ambient[2] = 0.0f;
+}
+
+void Lighting::set(const Lights &lights)
+{
+    m_ambient[0] = m_ambient[1] = m_ambient[2] = 0.0f;
+    m_directionalCount = 0;
+    m_pointCount = 0;
+    m_enabled = false;
+
+    for (const auto &light : lights)
+    {
+        if (!light->isEnabled())
+            continue;
+
+        m_enabled = true;
+
+        const Color3 &intensity = light->getIntensity();
+        float r = (float)intensity[RED];
+        float g = (float)intensity[GREEN];
+        float b = (float)intensity[BLUE];
+
+        switch (light->getType())
+        {
+        case Light::LT_AMBIENT_LIGHT:
+            m_ambient[0] += r;
+            m_ambient[1] += g;
+            m_ambient[2] += b;
+            break;
+
+        case Light::LT_DIRECTIONAL_LIGHT:
+        {
+            if (m_directionalCount == MAX_LIGHTS)
+                break;
+
+            const math::vec3 &dir = static_cast<const DirectionalLight &>(*light).getDirection();
+            size_t i = m_directionalCount++;
+
+            m_dirX[i] = dir.x;
+            m_dirY[i] = dir.y;
+            m_dirZ[i] = dir.z;
+            m_dirR[i] = r;
+            m_dirG[i] = g;
+            m_dirB[i] = b;
+            break;
+        }
+
+        case Light::LT_POINT_LIGHT:
+        {
+            if (m_pointCount == MAX_LIGHTS)
+                break;
+
+            math::vec3 pos = light->getPosition();
+            size_t i = m_pointCount++;
+
+            m_posX[i] = pos.x;
+            m_posY[i] = pos.y;
+            m_posZ[i] = pos.z;
+            static_cast<const PointLight &>(*light).getAttenuation(m_kc[i], m_kl[i], m_kq[i]);
+            m_pointR[i] = r;
+            m_pointG[i] = g;
+            m_pointB[i] = b;
+            break;
+        }
+
+        default:
+            syslog << "Light type" << (int)light->getType() << "is not supported" << logwarn;
+            break;
+        }
+    }
+}
+
+void Lighting::diffuse4(const float *nx, const float *ny, const float *nz,
+                        const float *px, const float *py, const float *pz, float *r, float *g, float *b) const
+{
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 normalX = _mm_loadu_ps(nx);
+    __m128 normalY = _mm_loadu_ps(ny);
+    __m128 normalZ = _mm_loadu_ps(nz);
+
+    __m128 sumR = zero, sumG = zero, sumB = zero;
+
+    for (size_t i = 0; i < m_directionalCount; i++)
+    {
+        // light comes from the side, where the normal looks
+        __m128 dp = _mm_mul_ps(normalX, _mm_set1_ps(m_dirX[i]));
+        dp = _mm_add_ps(dp, _mm_mul_ps(normalY, _mm_set1_ps(m_dirY[i])));
+        dp = _mm_add_ps(dp, _mm_mul_ps(normalZ, _mm_set1_ps(m_dirZ[i])));
+        dp = _mm_max_ps(dp, zero);
+
+        sumR = _mm_add_ps(sumR, _mm_mul_ps(dp, _mm_set1_ps(m_dirR[i])));
+        sumG = _mm_add_ps(sumG, _mm_mul_ps(dp, _mm_set1_ps(m_dirG[i])));
+        sumB = _mm_add_ps(sumB, _mm_mul_ps(dp, _mm_set1_ps(m_dirB[i])));
+    }
+
+    if (m_pointCount)
+    {
+        __m128 pointX = _mm_loadu_ps(px);
+        __m128 pointY = _mm_loadu_ps(py);
+        __m128 pointZ = _mm_loadu_ps(pz);
+
+        for (size_t i = 0; i < m_pointCount; i++)
+        {
+            __m128 lx = _mm_sub_ps(_mm_set1_ps(m_posX[i]), pointX);
+            __m128 ly = _mm_sub_ps(_mm_set1_ps(m_posY[i]), pointY);
+            __m128 lz = _mm_sub_ps(_mm_set1_ps(m_posZ[i]), pointZ);
+
+            __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+            __m128 dist = _mm_sqrt_ps(dist2);
+
+            __m128 dp = _mm_mul_ps(normalX, lx);
+            dp = _mm_add_ps(dp, _mm_mul_ps(normalY, ly));
+            dp = _mm_add_ps(dp, _mm_mul_ps(normalZ, lz));
+
+            // dp / |l| is the cosine, the attenuation is kc + kl * d + kq * d^2
+            __m128 atten = _mm_add_ps(_mm_set1_ps(m_kc[i]),
+                                      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_kl[i]), dist),
+                                                 _mm_mul_ps(_mm_set1_ps(m_kq[i]), dist2)));
+            __m128 denom = _mm_mul_ps(dist, atten);
+
+            __m128 lit = _mm_and_ps(_mm_cmpgt_ps(dp, zero), _mm_cmpgt_ps(denom, zero));
+            __m128 k = _mm_and_ps(_mm_div_ps(dp, denom), lit);
+
+            sumR = _mm_add_ps(sumR, _mm_mul_ps(k, _mm_set1_ps(m_pointR[i])));
+            sumG = _mm_add_ps(sumG, _mm_mul_ps(k, _mm_set1_ps(m_pointG[i])));
+            sumB = _mm_add_ps(sumB, _mm_mul_ps(k, _mm_set1_ps(m_pointB[i])));
+        }
+    }
+
+    _mm_storeu_ps(r, sumR);
+    _mm_storeu_ps(g, sumG);
+    _mm_storeu_ps(b, sumB);
+}
+
+Lighting::LightColor Lighting::reflected(const Material &material, const math::vec3 &normal, const math::vec3 &point) const
+{
+    LightColor light;
+    if (!m_enabled)
+        return light;
+
+    // one point in the first lane
+    float nx[4] = { normal.x }, ny[4] = { normal.y }, nz[4] = { normal.z };
+    float px[4] = { point.x }, py[4] = { point.y }, pz[4] = { point.z };
+    float r[4], g[4], b[4];
+
+    diffuse4(nx, ny, nz, px, py, pz, r, g, b);
+
+    const float scale = 1.0f / 256.0f;
+
+    light.r = (m_ambient[0] * material.ambientColor[RED] + r[0] * material.diffuseColor[RED]) * scale;
+    light.g = (m_ambient[1] * material.ambientColor[GREEN] + g[0] * material.diffuseColor[GREEN]) * scale;
+    light.b = (m_ambient[2] * material.ambientColor[BLUE] + b[0] * material.diffuseColor[BLUE]) * scale;
+
+    return light;
+}
+
+void Lighting::shade(const Material &material, const float *nx, const float *ny, const float *nz,
+                     const float *px, const float *py, const float *pz, const Color3 *base, size_t count, Color3 *out) const
+{
+    assert(count <= MAX_POINTS);
+
+    if (!m_enabled)
+    {
+        std::copy(base, base + count, out);
+        return;
+    }
+
+    const float scale = 1.0f / 256.0f;
+
+    // material colors are applied after the sums
+    float ambientR = m_ambient[0] * material.ambientColor[RED] * scale;
+    float ambientG = m_ambient[1] * material.ambientColor[GREEN] * scale;
+    float ambientB = m_ambient[2] * material.ambientColor[BLUE] * scale;
+    float diffuseR = material.diffuseColor[RED] * scale;
+    float diffuseG = material.diffuseColor[GREEN] * scale;
+    float diffuseB = material.diffuseColor[BLUE] * scale;
+
+    // the tail is padded to four points
+    size_t padded = (count + 3) & ~3;
+    float tail[6][4];
+    float r[MAX_POINTS], g[MAX_POINTS], b[MAX_POINTS];
+
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        if (i + 4 <= count)
+        {
+            diffuse4(nx + i, ny + i, nz + i, px + i, py + i, pz + i, r + i, g + i, b + i);
+            continue;
+        }
+
+        const float *sources[6] = { nx, ny, nz, px, py, pz };
+        for (int s = 0; s < 6; s++)
+        {
+            for (size_t k = 0; k < 4; k++)
+                tail[s][k] = i + k < count ? sources[s][i + k] : 0.0f;
+        }
+
+        diffuse4(tail[0], tail[1], tail[2], tail[3], tail[4], tail[5], r + i, g + i, b + i);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        LightColor light;
+        light.r = ambientR + r[i] * diffuseR;
+        light.g = ambientG + g[i] * diffuseG;
+        light.b = ambientB + b[i] * diffuseB;
+
+        out[i] = add(base[i], light);
+    }
+}
+
+Color3 Lighting::add(const Color3 &base, const LightColor &light)
+{
+    return Color3(std::min(base[RED] + light.r, 255.0f),
+                  std::min(base[GREEN] + light.g, 255.0f),
+                  std::min(base[BLUE] + light.b, 255.0f));
+}
+
+void Lighting::illuminate(RenderList &renderList, size_t from, size_t to) const
+{
+    if (!m_enabled)
+        return;
+
+    RenderList::Triangles &triangles = renderList.triangles();
+
+    for (size_t i = from; i < to; i++)
+    {
+        math::Triangle &t = triangles[i];
+
+        if (t.clipped)
+            continue;
+
+        const Material *material = t.getMaterial();
+        if (!material)
+            continue;
+
+        switch (material->shadeMode)
+        {
+        case Material::SM_FLAT:
+        case Material::SM_TEXTURE:
+        {
+            // one face color, the texture is modulated with it on rasterizing phaze
+            LightColor light = reflected(*material, t.normal(), t.v(0).p);
+
+            for (int k = 0; k < 3; k++)
+                t.v(k).color = add(t.v(k).color, light);
+            break;
+        }
+
+        case Material::SM_GOURAUD:
+        {
+            float nx[3], ny[3], nz[3], px[3], py[3], pz[3];
+            Color3 colors[3];
+
+            for (int k = 0; k < 3; k++)
+            {
+                const math::vertex &v = t.v(k);
+                nx[k] = v.n.x;
+                ny[k] = v.n.y;
+                nz[k] = v.n.z;
+                px[k] = v.p.x;
+                py[k] = v.p.y;
+                pz[k] = v.p.z;
+                colors[k] = v.color;
+            }
+
+            shade(*material, nx, ny, nz, px, py, pz, colors, 3, colors);
+
+            for (int k = 0; k < 3; k++)
+                t.v(k).color = colors[k];
+            break;
+        }
+
+        case Material::SM_UNDEFINED:
+        case Material::SM_PLAIN_COLOR:
+        case Material::SM_WIRE:
+            t.v(0).color = t.v(1).color = t.v(2).color = material->plainColor;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+}
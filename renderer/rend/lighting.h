@@ -0,0 +1,90 @@
+/*
+ * lighting.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include "../math/vec3.h"
+#include "color.h"
+
+namespace rend
+{
+
+class Light;
+class RenderList;
+struct Material;
+
+//! All enabled lights of the frame, which shade a point in one pass.
+/*!
+  * Lights are packed by set() into SoA arrays by their type. The points are shaded four at a time:
+  * every SSE lane is a point, and the lights are added one by one to the float sums. The sum
+  * is modulated by the material and added to the base color with one clamp at the end, so
+  * the result does not depend on the lights order.
+  */
+class Lighting
+{
+public:
+    typedef std::list<sptr(Light)> Lights;
+
+    //! Reflected light, not clamped.
+    struct LightColor
+    {
+        float r, g, b;
+
+        LightColor() : r(0.0f), g(0.0f), b(0.0f) { }
+    };
+
+    //! Points shaded by one shade() call.
+    static const size_t MAX_POINTS = 64;
+
+private:
+    static const size_t MAX_LIGHTS = 8;
+
+    //! Sum of the ambient intensities.
+    float m_ambient[3];
+
+    size_t m_directionalCount;
+    float m_dirX[MAX_LIGHTS], m_dirY[MAX_LIGHTS], m_dirZ[MAX_LIGHTS];
+    float m_dirR[MAX_LIGHTS], m_dirG[MAX_LIGHTS], m_dirB[MAX_LIGHTS];
+
+    size_t m_pointCount;
+    float m_posX[MAX_LIGHTS], m_posY[MAX_LIGHTS], m_posZ[MAX_LIGHTS];
+    float m_kc[MAX_LIGHTS], m_kl[MAX_LIGHTS], m_kq[MAX_LIGHTS];
+    float m_pointR[MAX_LIGHTS], m_pointG[MAX_LIGHTS], m_pointB[MAX_LIGHTS];
+
+    bool m_enabled;
+
+    //! Diffuse intensity sums of four points, without the material.
+    void diffuse4(const float *nx, const float *ny, const float *nz,
+                  const float *px, const float *py, const float *pz, float *r, float *g, float *b) const;
+
+public:
+    Lighting();
+
+    //! Packs the enabled lights. Call when the lights are changed, RenderMgr does it every frame.
+    void set(const Lights &lights);
+
+    //! Some light is enabled.
+    bool enabled() const { return m_enabled; }
+
+    //! Light reflected by the point.
+    LightColor reflected(const Material &material, const math::vec3 &normal, const math::vec3 &point) const;
+
+    //! out = base + reflected light for count (up to MAX_POINTS) points with SoA normals and positions.
+    void shade(const Material &material, const float *nx, const float *ny, const float *nz,
+               const float *px, const float *py, const float *pz, const Color3 *base, size_t count, Color3 *out) const;
+
+    //! Base color plus the light, clamped to 255.
+    static Color3 add(const Color3 &base, const LightColor &light);
+
+    //! Lights triangles [from, to) of the render list, which are built from the world space vertices.
+    void illuminate(RenderList &renderList, size_t from, size_t to) const;
+};
+
+}
+
+#endif // LIGHTING_H
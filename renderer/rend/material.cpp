@@ -14,13 +14,87 @@
 namespace rend
 {
 
+// create the registry before the threads start
+static MaterialRegistry &s_materialRegistry = MaterialRegistry::instance();
+
+MaterialRegistry::MaterialRegistry()
+{
+    memset(m_pages, 0, sizeof(m_pages));
+
+    // page with the null handle
+    m_pages[0] = new Material *[PAGE_SIZE];
+    memset(m_pages[0], 0, PAGE_SIZE * sizeof(Material *));
+    m_nextHandle = 1;
+}
+
+MaterialRegistry::~MaterialRegistry()
+{
+    for (auto page : m_pages)
+        delete [] page;
+}
+
+MaterialRegistry &MaterialRegistry::instance()
+{
+    static MaterialRegistry m_instance;
+
+    return m_instance;
+}
+
+MaterialHandle MaterialRegistry::add(Material *material)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    MaterialHandle handle;
+    if (!m_freeHandles.empty())
+    {
+        handle = m_freeHandles.back();
+        m_freeHandles.pop_back();
+    }
+    else
+    {
+        if (m_nextHandle == PAGE_SIZE * MAX_PAGES)
+            throw MaterialException("Material limit is reached");
+
+        handle = m_nextHandle++;
+
+        Material **&page = m_pages[handle / PAGE_SIZE];
+        if (!page)
+        {
+            page = new Material *[PAGE_SIZE];
+            memset(page, 0, PAGE_SIZE * sizeof(Material *));
+        }
+    }
+
+    m_pages[handle / PAGE_SIZE][handle % PAGE_SIZE] = material;
+
+    return handle;
+}
+
+void MaterialRegistry::remove(MaterialHandle handle)
+{
+    if (handle == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_pages[handle / PAGE_SIZE][handle % PAGE_SIZE] = 0;
+    m_freeHandles.push_back(handle);
+}
+
 Material::Material()
     : shadeMode(SM_WIRE),
       sideType(ONE_SIDE),
       specularColor(0, 0, 0),
       emissiveColor(0, 0, 0),
-      alpha(255)
+      alpha(255),
+      mipFilter(MF_NEAREST)
+{
+    m_handle = MaterialRegistry::instance().add(this);
+}
+
+Material::~Material()
 {
+    MaterialRegistry::instance().remove(m_handle);
 }
 
 sptr(Material) Material::clone() const
@@ -38,6 +112,7 @@ sptr(Material) Material::clone() const
     if (texture)
         newMat->texture = texture->clone();
     newMat->alpha = alpha;
+    newMat->mipFilter = mipFilter;
 
     return newMat;
 }
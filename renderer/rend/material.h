@@ -8,13 +8,54 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <mutex>
+
 #include "color.h"
 #include "../base/resource.h"
 
 namespace rend
 {
 
+DECLARE_EXCEPTION(MaterialException)
+
 class Texture;
+struct Material;
+
+//! Material handle, index in the MaterialRegistry. Zero is the null handle.
+typedef uint32_t MaterialHandle;
+
+//! Table of the alive materials.
+/*!
+  * Every material gets the handle in its ctor and frees it in the dtor. Handles are stable
+  * and a lookup is lock free, so the frame data keeps handles instead of shared pointers.
+  * The material must outlive the frame, which uses its handle.
+  */
+class MaterialRegistry
+{
+    static const size_t PAGE_SIZE = 1024;
+    static const size_t MAX_PAGES = 1024;
+
+    //! Pages are never moved or freed while the registry is alive.
+    Material **m_pages[MAX_PAGES];
+    std::vector<MaterialHandle> m_freeHandles;
+    MaterialHandle m_nextHandle;
+    std::mutex m_mutex;
+
+    MaterialRegistry();
+
+public:
+    ~MaterialRegistry();
+
+    static MaterialRegistry &instance();
+
+    MaterialHandle add(Material *material);
+    void remove(MaterialHandle handle);
+
+    //! Returns material by the handle, null for the null handle.
+    Material *get(MaterialHandle handle) const { return m_pages[handle / PAGE_SIZE][handle % PAGE_SIZE]; }
+
+    NONCOPYABLE(MaterialRegistry)
+};
 
 //! Surface properties.
 /*!
@@ -51,16 +92,34 @@ struct Material : public base::Resource
     Color3 specularColor;
     Color3 emissiveColor;
 
+    //! How minified textures are sampled.
+    enum MipFilter
+    {
+        MF_NONE,            /*!< Base level only. */
+        MF_NEAREST,         /*!< Bilinear filtering of the nearest mip level. */
+        MF_TRILINEAR        /*!< Blend of the two nearest levels. */
+    };
+
     //! Alpha for material [0..255]
     int alpha;
 
+    MipFilter mipFilter;
+
     std::string textureName;
     sptr(Texture) texture;
 
     //! Default ctor.
     Material();
+    //! Dtor.
+    ~Material();
 
     sptr(Material) clone() const;
+
+    //! Handle in the MaterialRegistry.
+    MaterialHandle handle() const { return m_handle; }
+
+private:
+    MaterialHandle m_handle;
 };
 
 }
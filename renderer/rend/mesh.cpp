@@ -31,7 +31,7 @@ void Mesh::appendSubmesh(const VertexBuffer &submesh)
 //    m_submeshes.sort();     // sort by alpha value of material
 }
 
-void Mesh::computeBoundingSphere(const math::M44 &transform)
+void Mesh::computeBoundingSphere()
 {
     int sz = 0;
 
@@ -47,10 +47,6 @@ void Mesh::computeBoundingSphere(const math::M44 &transform)
             points[j] = vb.m_vertices[i].p;
     }
 
-    // apply transformation
-    const math::M33 &rotsc = transform.getM();
-    std::for_each(points.begin(), points.end(), [&](math::vec3 &v) { v = v * rotsc; });
-
     m_boundingSphere.calculate(points);
 }
 
@@ -128,6 +124,15 @@ void Mesh::setSideType(Material::SideType side)
         vb.getMaterial()->sideType = side;      // ?
 }
 
+void Mesh::addLod(const sptr(Mesh) lod, float error)
+{
+    Lod level;
+    level.mesh = lod;
+    level.error = error;
+
+    m_lods.push_back(level);
+}
+
 sptr(Mesh) Mesh::clone() const
 {
     sptr(Mesh) objMesh = std::make_shared<Mesh>();
@@ -141,10 +146,32 @@ sptr(Mesh) Mesh::clone() const
         vb.m_indices = submesh.m_indices;
         vb.m_uvs = submesh.m_uvs;
         vb.m_uvsIndices = submesh.m_uvsIndices;
+        vb.m_facePlanes = submesh.m_facePlanes;
+        vb.m_boundsMin = submesh.m_boundsMin;
+        vb.m_boundsMax = submesh.m_boundsMax;
+        vb.m_clusters = submesh.m_clusters;
 
         objMesh->appendSubmesh(vb);
     }
 
+    // levels share the materials of the clone
+    for (auto &lod : m_lods)
+    {
+        sptr(Mesh) lodMesh = lod.mesh->clone();
+
+        auto material = objMesh->m_submeshes.begin();
+        for (auto &vb : lodMesh->m_submeshes)
+        {
+            if (material == objMesh->m_submeshes.end())
+                break;
+
+            vb.m_material = material->m_material;
+            ++material;
+        }
+
+        objMesh->addLod(lodMesh, lod.error);
+    }
+
     return objMesh;
 }
 
@@ -24,9 +24,20 @@ class Mesh
     //! Mesh consists of some submeshes, which holds vertex data and one material.
     std::list<VertexBuffer> m_submeshes;
 
-    //! Bounding sphere.
+    //! Bounding sphere in the object space.
     BoundingSphere m_boundingSphere;
 
+    //! Simplified copy of the mesh.
+    struct Lod
+    {
+        sptr(Mesh) mesh;
+        //! Max distance to the surface of the mesh in the object space.
+        float error;
+    };
+
+    //! Levels of detail from the finest to the coarsest.
+    std::vector<Lod> m_lods;
+
 public:
     //! Default ctor.
     Mesh();
@@ -36,7 +47,10 @@ public:
     //! Appends submesh to this mesh.
     void appendSubmesh(const VertexBuffer &submesh);
 
-    void computeBoundingSphere(const math::M44 &transform);
+    //! Object space bounding sphere of all submeshes.
+    void computeBoundingSphere();
+    //! Sets the sphere, when the submeshes do not cover the whole object yet.
+    void setBoundingSphere(const BoundingSphere &sphere) { m_boundingSphere = sphere; }
     const BoundingSphere &getBoundingSphere() const;
 
     //! Returns vertex count of all submeshes.
@@ -52,6 +66,13 @@ public:
     const std::list<VertexBuffer> &getSubmeshes() const { return m_submeshes; }
     std::list<VertexBuffer>       &getSubmeshes() { return m_submeshes; }
 
+    //! Appends the coarser level of detail, its submeshes follow the submeshes of this mesh.
+    void addLod(const sptr(Mesh) lod, float error);
+    void clearLods() { m_lods.clear(); }
+    size_t numLods() const { return m_lods.size(); }
+    const sptr(Mesh) &getLod(size_t level) const { return m_lods[level].mesh; }
+    float getLodError(size_t level) const { return m_lods[level].error; }
+
     sptr(Mesh) clone() const;
 
     NONCOPYABLE(Mesh)
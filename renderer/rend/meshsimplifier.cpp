@@ -0,0 +1,446 @@
+/*
+ * meshsimplifier.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "meshsimplifier.h"
+#include "mesh.h"
+
+namespace rend
+{
+
+//! Weight of the planes across the border edges.
+static const double BORDER_WEIGHT = 10.0;
+//! Min cosine between the triangle normals before and after the collapse.
+static const float MIN_NORMAL_COS = 0.2f;
+//! Meshes with less triangles are not simplified.
+static const int MIN_LOD_TRIANGLES = 64;
+
+MeshSimplifier::Quadric::Quadric()
+{
+    std::fill(a, a + 10, 0.0);
+}
+
+void MeshSimplifier::Quadric::addPlane(const math::vec3 &n, double d, double weight)
+{
+    double x = n.x, y = n.y, z = n.z;
+
+    a[0] += weight * x * x; a[1] += weight * x * y; a[2] += weight * x * z; a[3] += weight * x * d;
+    a[4] += weight * y * y; a[5] += weight * y * z; a[6] += weight * y * d;
+    a[7] += weight * z * z; a[8] += weight * z * d;
+    a[9] += weight * d * d;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric &q)
+{
+    for (int i = 0; i < 10; i++)
+        a[i] += q.a[i];
+}
+
+double MeshSimplifier::Quadric::error(const math::vec3 &p) const
+{
+    double x = p.x, y = p.y, z = p.z;
+
+    return x * x * a[0] + 2.0 * x * y * a[1] + 2.0 * x * z * a[2] + 2.0 * x * a[3]
+           + y * y * a[4] + 2.0 * y * z * a[5] + 2.0 * y * a[6]
+           + z * z * a[7] + 2.0 * z * a[8]
+           + a[9];
+}
+
+bool MeshSimplifier::Quadric::optimum(math::vec3 &p) const
+{
+    // solve A * p = -b by the Cramer's rule
+    double det = a[0] * (a[4] * a[7] - a[5] * a[5])
+                 - a[1] * (a[1] * a[7] - a[5] * a[2])
+                 + a[2] * (a[1] * a[5] - a[4] * a[2]);
+
+    double trace = a[0] + a[4] + a[7];
+    if (fabs(det) <= 1e-9 * trace * trace * trace)
+        return false;
+
+    double bx = -a[3], by = -a[6], bz = -a[8];
+
+    p.x = (float)((bx * (a[4] * a[7] - a[5] * a[5]) - a[1] * (by * a[7] - a[5] * bz) + a[2] * (by * a[5] - a[4] * bz)) / det);
+    p.y = (float)((a[0] * (by * a[7] - a[5] * bz) - bx * (a[1] * a[7] - a[5] * a[2]) + a[2] * (a[1] * bz - by * a[2])) / det);
+    p.z = (float)((a[0] * (a[4] * bz - by * a[5]) - a[1] * (a[1] * bz - by * a[2]) + bx * (a[1] * a[5] - a[4] * a[2])) / det);
+
+    return true;
+}
+
+MeshSimplifier::MeshSimplifier(const VertexBuffer &vb)
+    : m_vertices(vb.getVertices()),
+      m_quadrics(vb.getVertices().size()),
+      m_stamps(vb.getVertices().size(), 0),
+      m_vertexFaces(vb.getVertices().size()),
+      m_indices(vb.getIndices().size()),
+      m_faces(vb.getIndices().size() / 3),
+      m_error(0.0f)
+{
+    assert(vb.getType() == VertexBuffer::INDEXEDTRIANGLELIST);
+
+    for (size_t i = 0; i < m_indices.size(); i++)
+        m_indices[i] = (int)vb.getIndices()[i];
+
+    std::vector<uint64_t> edges;
+    edges.reserve(m_indices.size());
+
+    for (size_t face = 0; face < m_faces; face++)
+    {
+        const int *v = &m_indices[face * 3];
+
+        math::vec3 n = (m_vertices[v[1]].p - m_vertices[v[0]].p).crossProduct(m_vertices[v[2]].p - m_vertices[v[0]].p);
+        float length = sqrt(n.dotProduct(n));
+
+        for (int k = 0; k < 3; k++)
+        {
+            m_vertexFaces[v[k]].push_back(face);
+
+            int from = std::min(v[k], v[(k + 1) % 3]);
+            int to = std::max(v[k], v[(k + 1) % 3]);
+            edges.push_back(((uint64_t)from << 32) | (uint64_t)to);
+        }
+
+        // degenerate triangle, e.g. at the pole of a sphere
+        if (math::DCMP(length, 0.0f))
+            continue;
+
+        n /= length;
+        for (int k = 0; k < 3; k++)
+            m_quadrics[v[k]].addPlane(n, -n.dotProduct(m_vertices[v[0]].p), 1.0);
+    }
+
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i < edges.size(); )
+    {
+        size_t count = 1;
+        while (i + count < edges.size() && edges[i + count] == edges[i])
+            count++;
+
+        int from = (int)(edges[i] >> 32);
+        int to = (int)(edges[i] & 0xffffffff);
+
+        // border edge: the plane, which is orthogonal to the triangle and goes through the edge
+        if (count == 1)
+        {
+            for (size_t j = 0; j < m_vertexFaces[from].size(); j++)
+            {
+                const int *v = &m_indices[m_vertexFaces[from][j] * 3];
+                if (v[0] != to && v[1] != to && v[2] != to)
+                    continue;
+
+                math::vec3 n = (m_vertices[v[1]].p - m_vertices[v[0]].p).crossProduct(m_vertices[v[2]].p - m_vertices[v[0]].p);
+                math::vec3 across = (m_vertices[to].p - m_vertices[from].p).crossProduct(n);
+                float length = sqrt(across.dotProduct(across));
+
+                if (!math::DCMP(length, 0.0f))
+                {
+                    across /= length;
+                    double d = -across.dotProduct(m_vertices[from].p);
+                    m_quadrics[from].addPlane(across, d, BORDER_WEIGHT);
+                    m_quadrics[to].addPlane(across, d, BORDER_WEIGHT);
+                }
+
+                break;
+            }
+        }
+
+        i += count;
+    }
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (i == 0 || edges[i] != edges[i - 1])
+            pushCollapse((int)(edges[i] >> 32), (int)(edges[i] & 0xffffffff));
+    }
+}
+
+void MeshSimplifier::pushCollapse(int v0, int v1)
+{
+    Quadric q = m_quadrics[v0];
+    q.add(m_quadrics[v1]);
+
+    const math::vec3 &p0 = m_vertices[v0].p;
+    const math::vec3 &p1 = m_vertices[v1].p;
+    math::vec3 mid = 0.5f * (p0 + p1);
+
+    Collapse collapse;
+    collapse.v0 = v0;
+    collapse.v1 = v1;
+    collapse.stamp0 = m_stamps[v0];
+    collapse.stamp1 = m_stamps[v1];
+
+    // the optimal point, if it is not far away from the edge, or the best of the ends and the middle
+    math::vec3 candidates[4] = { p0, p1, mid, mid };
+    int count = 3;
+
+    math::vec3 optimum;
+    if (q.optimum(optimum))
+    {
+        math::vec3 edge = p1 - p0;
+        math::vec3 offset = optimum - mid;
+        if (offset.dotProduct(offset) <= edge.dotProduct(edge))
+            candidates[count++] = optimum;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        float cost = (float)std::max(q.error(candidates[i]), 0.0);
+        if (i == 0 || cost < collapse.cost)
+        {
+            collapse.cost = cost;
+            collapse.position = candidates[i];
+        }
+    }
+
+    m_queue.push(collapse);
+}
+
+math::vec3 MeshSimplifier::faceNormal(int face, int moved, const math::vec3 &position) const
+{
+    math::vec3 p[3];
+    for (int k = 0; k < 3; k++)
+    {
+        int v = m_indices[face * 3 + k];
+        p[k] = v == moved ? position : m_vertices[v].p;
+    }
+
+    return (p[1] - p[0]).crossProduct(p[2] - p[0]);
+}
+
+bool MeshSimplifier::canCollapse(const Collapse &collapse) const
+{
+    int v0 = collapse.v0, v1 = collapse.v1;
+
+    // the ends must have only the common neighbours of the triangles of the edge
+    std::vector<int> neighbours0, neighbours1;
+    int shared = 0;
+
+    for (int face : m_vertexFaces[v0])
+    {
+        const int *v = &m_indices[face * 3];
+        if (v[0] < 0)
+            continue;
+
+        if (v[0] == v1 || v[1] == v1 || v[2] == v1)
+            shared++;
+
+        for (int k = 0; k < 3; k++)
+            if (v[k] != v0)
+                neighbours0.push_back(v[k]);
+    }
+
+    for (int face : m_vertexFaces[v1])
+    {
+        const int *v = &m_indices[face * 3];
+        if (v[0] < 0)
+            continue;
+
+        for (int k = 0; k < 3; k++)
+            if (v[k] != v1)
+                neighbours1.push_back(v[k]);
+    }
+
+    std::sort(neighbours0.begin(), neighbours0.end());
+    neighbours0.erase(std::unique(neighbours0.begin(), neighbours0.end()), neighbours0.end());
+    std::sort(neighbours1.begin(), neighbours1.end());
+    neighbours1.erase(std::unique(neighbours1.begin(), neighbours1.end()), neighbours1.end());
+
+    std::vector<int> common;
+    std::set_intersection(neighbours0.begin(), neighbours0.end(), neighbours1.begin(), neighbours1.end(),
+                          std::back_inserter(common));
+
+    if ((int)common.size() != shared)
+        return false;
+
+    // triangles, which are left, must not flip or degenerate
+    for (int end = 0; end < 2; end++)
+    {
+        int vertex = end == 0 ? v0 : v1;
+        int other = end == 0 ? v1 : v0;
+
+        for (int face : m_vertexFaces[vertex])
+        {
+            const int *v = &m_indices[face * 3];
+            if (v[0] < 0 || v[0] == other || v[1] == other || v[2] == other)
+                continue;
+
+            math::vec3 before = faceNormal(face, -1, collapse.position);
+            math::vec3 after = faceNormal(face, vertex, collapse.position);
+
+            float lengths = sqrt(before.dotProduct(before) * after.dotProduct(after));
+            if (lengths <= 0.0f || before.dotProduct(after) < MIN_NORMAL_COS * lengths)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void MeshSimplifier::collapse(const Collapse &collapse)
+{
+    int v0 = collapse.v0, v1 = collapse.v1;
+
+    // attributes are interpolated along the edge
+    math::vertex &dst = m_vertices[v0];
+    const math::vertex &src = m_vertices[v1];
+
+    math::vec3 edge = src.p - dst.p;
+    float lengthSq = edge.dotProduct(edge);
+    float t = lengthSq > 0.0f ? std::min(std::max((collapse.position - dst.p).dotProduct(edge) / lengthSq, 0.0f), 1.0f) : 0.0f;
+
+    math::vec3 n = dst.n + t * (src.n - dst.n);
+    if (!n.isZero())
+        dst.n = n.normalize();
+
+    dst.t = dst.t + t * (src.t - dst.t);
+    if (t > 0.5f)
+        dst.color = src.color;
+
+    dst.p = collapse.position;
+
+    // move the triangles of v1 to v0, the triangles of the edge are removed
+    for (int face : m_vertexFaces[v1])
+    {
+        int *v = &m_indices[face * 3];
+        if (v[0] < 0)
+            continue;
+
+        if (v[0] == v0 || v[1] == v0 || v[2] == v0)
+        {
+            v[0] = v[1] = v[2] = -1;
+            m_faces--;
+            continue;
+        }
+
+        for (int k = 0; k < 3; k++)
+            if (v[k] == v1)
+                v[k] = v0;
+
+        m_vertexFaces[v0].push_back(face);
+    }
+
+    std::vector<int> &faces = m_vertexFaces[v0];
+    faces.erase(std::remove_if(faces.begin(), faces.end(), [this](int face) { return m_indices[face * 3] < 0; }), faces.end());
+
+    m_vertexFaces[v1].clear();
+    m_quadrics[v0].add(m_quadrics[v1]);
+    m_stamps[v0]++;
+    m_stamps[v1] = -1;
+
+    m_error = std::max(m_error, (float)sqrt(collapse.cost));
+
+    // new costs of the edges around v0
+    std::vector<int> neighbours;
+    for (int face : faces)
+        for (int k = 0; k < 3; k++)
+            if (m_indices[face * 3 + k] != v0)
+                neighbours.push_back(m_indices[face * 3 + k]);
+
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+    for (int neighbour : neighbours)
+        pushCollapse(v0, neighbour);
+}
+
+void MeshSimplifier::simplify(size_t targetTriangles)
+{
+    while (m_faces > targetTriangles && !m_queue.empty())
+    {
+        Collapse top = m_queue.top();
+        m_queue.pop();
+
+        if (m_stamps[top.v0] != top.stamp0 || m_stamps[top.v1] != top.stamp1)
+            continue;
+
+        if (canCollapse(top))
+            collapse(top);
+    }
+}
+
+void MeshSimplifier::result(VertexBuffer &vb) const
+{
+    std::vector<int> remap(m_vertices.size(), -1);
+    std::vector<math::vertex> vertices;
+    std::vector<int> indices;
+
+    indices.reserve(m_faces * 3);
+
+    for (size_t i = 0; i < m_indices.size(); i++)
+    {
+        int v = m_indices[i];
+        if (v < 0)
+            continue;
+
+        if (remap[v] < 0)
+        {
+            remap[v] = (int)vertices.size();
+            vertices.push_back(m_vertices[v]);
+        }
+
+        indices.push_back(remap[v]);
+    }
+
+    vb.setType(VertexBuffer::INDEXEDTRIANGLELIST);
+    vb.appendVertices(vertices, indices, true);
+}
+
+void MeshSimplifier::buildLods(Mesh &mesh, int maxLods)
+{
+    mesh.clearLods();
+
+    int triangles = mesh.numTriangles();
+    if (triangles < MIN_LOD_TRIANGLES * 2)
+        return;
+
+    // simplifiers continue from the previous level
+    std::vector<sptr(MeshSimplifier)> simplifiers;
+    for (const auto &vb : mesh.getSubmeshes())
+    {
+        if (vb.getType() == VertexBuffer::INDEXEDTRIANGLELIST)
+            simplifiers.push_back(std::make_shared<MeshSimplifier>(vb));
+        else
+            simplifiers.push_back(sptr(MeshSimplifier)());
+    }
+
+    for (int level = 1; level <= maxLods; level++)
+    {
+        auto lod = std::make_shared<Mesh>();
+        float error = 0.0f;
+        auto simplifier = simplifiers.begin();
+
+        for (const auto &vb : mesh.getSubmeshes())
+        {
+            VertexBuffer lodVb;
+
+            if (*simplifier)
+            {
+                (*simplifier)->simplify((size_t)(vb.numIndices() / 3) >> level);
+                (*simplifier)->result(lodVb);
+                error = std::max(error, (*simplifier)->error());
+            }
+            else
+                lodVb = vb;
+
+            lodVb.setMaterial(vb.getMaterial());
+            lod->appendSubmesh(lodVb);
+
+            ++simplifier;
+        }
+
+        // stop, if the collapses are blocked or the level is too small to matter
+        int lodTriangles = lod->numTriangles();
+        if (lodTriangles * 4 > triangles * 3 || lodTriangles < MIN_LOD_TRIANGLES)
+            break;
+
+        mesh.addLod(lod, error);
+        triangles = lodTriangles;
+    }
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+ * meshsimplifier.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <queue>
+
+#include "vertexbuffer.h"
+
+namespace rend
+{
+
+class Mesh;
+
+//! Simplifies the indexed triangle list by the quadric error edge collapses.
+/*!
+  * Every vertex has a quadric: the sum of the squared distances to the planes of its triangles.
+  * The edge, which collapse to the optimal point has the least quadric error, is collapsed first.
+  * Border edges have the planes across them, so the holes and the seams keep their shape.
+  * Collapses, which flip a triangle or make the mesh non-manifold, are skipped.
+  *
+  * The simplifier keeps its state, so every next simplify() continues from the previous result.
+  */
+class MeshSimplifier
+{
+    //! Symmetric 4x4 matrix of the plane equations.
+    struct Quadric
+    {
+        double a[10];
+
+        Quadric();
+
+        void addPlane(const math::vec3 &n, double d, double weight);
+        void add(const Quadric &q);
+        double error(const math::vec3 &p) const;
+        //! Point with the minimal error, false if the matrix is singular.
+        bool optimum(math::vec3 &p) const;
+    };
+
+    struct Collapse
+    {
+        float cost;
+        //! v1 is moved to v0.
+        int v0, v1;
+        //! Stamps of the vertices, the collapse is stale, if they are changed.
+        int stamp0, stamp1;
+        math::vec3 position;
+
+        bool operator< (const Collapse &other) const { return cost > other.cost; }
+    };
+
+    std::vector<math::vertex> m_vertices;
+    std::vector<Quadric> m_quadrics;
+    //! Changes on every collapse to the vertex, -1 for the removed vertices.
+    std::vector<int> m_stamps;
+    //! Triangles of every vertex, may hold the removed triangles.
+    std::vector<std::vector<int> > m_vertexFaces;
+    //! Three indices of every triangle, -1 for the removed triangles.
+    std::vector<int> m_indices;
+    size_t m_faces;
+    float m_error;
+
+    std::priority_queue<Collapse> m_queue;
+
+    //! Not normalized normal of the triangle, which vertex is moved to the position.
+    math::vec3 faceNormal(int face, int moved, const math::vec3 &position) const;
+    void pushCollapse(int v0, int v1);
+    bool canCollapse(const Collapse &collapse) const;
+    void collapse(const Collapse &collapse);
+
+public:
+    //! Takes the triangles of the indexed buffer.
+    MeshSimplifier(const VertexBuffer &vb);
+
+    //! Collapses the edges until the triangles count is not above the target.
+    void simplify(size_t targetTriangles);
+
+    //! Triangles count of the current result.
+    size_t numTriangles() const { return m_faces; }
+    //! Max quadric error of the collapses so far, in the object space units.
+    float error() const { return m_error; }
+
+    //! Indexed buffer of the current result with the material of the source.
+    void result(VertexBuffer &vb) const;
+
+    //! Builds the levels of detail of the mesh, every next one has half the triangles of the previous.
+    /*! Submeshes of the levels follow the submeshes of the mesh and share their materials. */
+    static void buildLods(Mesh &mesh, int maxLods = 4);
+
+    NONCOPYABLE(MeshSimplifier)
+};
+
+}
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,356 @@
+/*
+ * occlusionculler.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "occlusionculler.h"
+#include "simd.h"
+#include "camera.h"
+#include "mesh.h"
+#include "sceneobject.h"
+#include "material.h"
+
+namespace rend
+{
+
+const int OcclusionCuller::BUFFER_WIDTH;
+
+OcclusionCuller::OcclusionCuller()
+    : m_width(0),
+      m_height(0),
+      m_scaleX(1.0f),
+      m_scaleY(1.0f),
+      m_frame(0)
+{
+}
+
+void OcclusionCuller::resize(int viewportWidth, int viewportHeight)
+{
+    // rows are processed by four pixels
+    int width = (std::min(BUFFER_WIDTH, viewportWidth) + 3) & ~3;
+    int height = std::max(1, (int)(viewportHeight * width / (float)viewportWidth + 0.5f));
+
+    m_width = width;
+    m_height = height;
+    m_scaleX = width / (float)viewportWidth;
+    m_scaleY = height / (float)viewportHeight;
+    m_depth.assign(width * height, 0.0f);
+}
+
+void OcclusionCuller::drawTriangle(const float *x, const float *y, const float *iz)
+{
+    int i1 = 1, i2 = 2;
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area < 0.0f)
+    {
+        std::swap(i1, i2);
+        area = -area;
+    }
+
+    if (area < 1e-6f)
+        return;
+
+    int minX = std::max((int)floor(std::min(std::min(x[0], x[1]), x[2])), 0);
+    int maxX = std::min((int)ceil(std::max(std::max(x[0], x[1]), x[2])), m_width - 1);
+    int minY = std::max((int)floor(std::min(std::min(y[0], y[1]), y[2])), 0);
+    int maxY = std::min((int)ceil(std::max(std::max(y[0], y[1]), y[2])), m_height - 1);
+
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // edge functions a * x + b * y + c, positive inside. A pixel is filled, if its center is inside,
+    // so the triangles of a mesh leave no gaps between them
+    const int order[4] = { 0, i1, i2, 0 };
+    float a[3], b[3], c[3];
+
+    for (int e = 0; e < 3; e++)
+    {
+        int from = order[e], to = order[e + 1];
+
+        a[e] = y[from] - y[to];
+        b[e] = x[to] - x[from];
+        c[e] = -a[e] * x[from] - b[e] * y[from];
+    }
+
+    // 1 / z is linear on the screen, the pixel gets its farthest value
+    float dzdx = ((iz[i1] - iz[0]) * (y[i2] - y[0]) - (iz[i2] - iz[0]) * (y[i1] - y[0])) / area;
+    float dzdy = ((iz[i2] - iz[0]) * (x[i1] - x[0]) - (iz[i1] - iz[0]) * (x[i2] - x[0])) / area;
+    float dzc = iz[0] - dzdx * x[0] - dzdy * y[0] - 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+    int firstX = minX & ~3;
+
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 startX = _mm_add_ps(_mm_set1_ps((float)firstX), offsets);
+
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 stepE[3];
+    for (int e = 0; e < 3; e++)
+        stepE[e] = _mm_set1_ps(a[e] * 4.0f);
+
+    const __m128 stepZ = _mm_set1_ps(dzdx * 4.0f);
+
+    for (int py = minY; py <= maxY; py++)
+    {
+        float cy = py + 0.5f;
+
+        __m128 edge[3];
+        for (int e = 0; e < 3; e++)
+            edge[e] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[e]), startX), _mm_set1_ps(b[e] * cy + c[e]));
+
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), startX), _mm_set1_ps(dzdy * cy + dzc));
+
+        float *row = &m_depth[py * m_width];
+
+        for (int px = firstX; px <= maxX; px += 4)
+        {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge[0], zero),
+                                                  _mm_cmpge_ps(edge[1], zero)),
+                                       _mm_cmpge_ps(edge[2], zero));
+
+            if (_mm_movemask_ps(inside))
+            {
+                __m128 stored = _mm_loadu_ps(row + px);
+                _mm_storeu_ps(row + px, _mm_blendv_ps(stored, _mm_max_ps(stored, z), inside));
+            }
+
+            for (int e = 0; e < 3; e++)
+                edge[e] = _mm_add_ps(edge[e], stepE[e]);
+
+            z = _mm_add_ps(z, stepZ);
+        }
+    }
+}
+
+void OcclusionCuller::drawOccluder(const Camera &camera, const SceneObject &obj)
+{
+    sptr(Mesh) mesh = obj.getLodMesh();
+    if (!mesh)
+        return;
+
+    const math::M44 &worldTransform = obj.getTransformation();
+    math::M44 clipTransform = worldTransform * camera.getViewProjectionMatrix();
+
+    // camera in the object space for the back faces, as the render list has it
+    math::M33 rotScale = worldTransform.getM();
+    float det = rotScale.determinant();
+    bool invertible = !math::DCMP(det, 0.0f);
+
+    math::vec3 eye;
+    if (invertible)
+        eye = (camera.getPosition() - worldTransform.getV()) * math::M33(rotScale).invert();
+
+    for (const auto &vb : mesh->getSubmeshes())
+    {
+        size_t verticesCount = vb.numVertices();
+        if (verticesCount == 0)
+            continue;
+
+        size_t trianglesCount;
+        if (vb.getType() == VertexBuffer::INDEXEDTRIANGLELIST)
+            trianglesCount = vb.numIndices() / 3;
+        else if (vb.getType() == VertexBuffer::TRIANGLELIST)
+            trianglesCount = verticesCount / 3;
+        else
+            continue;
+
+        m_x.resize(verticesCount);
+        m_y.resize(verticesCount);
+        m_w.resize(verticesCount);
+        m_flags.resize(verticesCount);
+
+        float *x = &m_x[0];
+        float *y = &m_y[0];
+        float *w = &m_w[0];
+
+        math::TransformPoints(clipTransform, &vb.getVertices()[0].p, sizeof(math::vertex), verticesCount, x, y, 0, w);
+        camera.clipFlags(x, y, w, verticesCount, &m_flags[0]);
+        camera.clipToScreen(x, y, w, verticesCount, x, y);
+
+        // viewport -> buffer, w -> 1 / z
+        for (size_t i = 0; i < verticesCount; i++)
+        {
+            x[i] *= m_scaleX;
+            y[i] *= m_scaleY;
+            w[i] = 1.0f / w[i];
+        }
+
+        const Material *material = vb.getMaterial().get();
+        const std::vector<math::Plane> &planes = vb.getFacePlanes();
+        bool cullBackfaces = invertible
+                             && !(material && material->sideType == Material::TWO_SIDE)
+                             && planes.size() == trianglesCount;
+
+        const VertexBuffer::IndexArray &indices = vb.getIndices();
+        bool indexed = vb.getType() == VertexBuffer::INDEXEDTRIANGLELIST;
+
+        for (size_t t = 0; t < trianglesCount; t++)
+        {
+            if (cullBackfaces)
+            {
+                float dist = planes[t].normal().dotProduct(eye) + planes[t].distance();
+                if (det < 0.0f ? dist >= 0.0f : dist <= 0.0f)
+                    continue;
+            }
+
+            int v[3];
+            for (int k = 0; k < 3; k++)
+                v[k] = indexed ? indices[t * 3 + k] : (int)(t * 3 + k);
+
+            // triangles crossing the near plane are skipped, that only makes the occlusion weaker
+            if ((m_flags[v[0]] | m_flags[v[1]] | m_flags[v[2]]) & Camera::CLIP_NEAR)
+                continue;
+
+            float tx[3] = { x[v[0]], x[v[1]], x[v[2]] };
+            float ty[3] = { y[v[0]], y[v[1]], y[v[2]] };
+            float tz[3] = { w[v[0]], w[v[1]], w[v[2]] };
+
+            drawTriangle(tx, ty, tz);
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(const Camera &camera, const BoundingSphere &sphere) const
+{
+    if (!sphere.valid())
+        return false;
+
+    // corners of the box around the sphere
+    const math::vec3 &c = sphere.center();
+    float r = sphere.radius();
+
+    math::vec3 corners[8];
+    for (int i = 0; i < 8; i++)
+        corners[i] = math::vec3(c.x + (i & 1 ? r : -r), c.y + (i & 2 ? r : -r), c.z + (i & 4 ? r : -r));
+
+    float x[8], y[8], w[8];
+    math::TransformPoints(camera.getViewProjectionMatrix(), corners, sizeof(math::vec3), 8, x, y, 0, w);
+
+    uint8_t flags[8];
+    camera.clipFlags(x, y, w, 8, flags);
+
+    float nearest = w[0];
+    for (int i = 0; i < 8; i++)
+    {
+        // the object is too close to be tested
+        if (flags[i] & Camera::CLIP_NEAR)
+            return false;
+
+        nearest = std::min(nearest, w[i]);
+    }
+
+    camera.clipToScreen(x, y, w, 8, x, y);
+
+    float minX = x[0] * m_scaleX, maxX = minX;
+    float minY = y[0] * m_scaleY, maxY = minY;
+    for (int i = 1; i < 8; i++)
+    {
+        minX = std::min(minX, x[i] * m_scaleX);
+        maxX = std::max(maxX, x[i] * m_scaleX);
+        minY = std::min(minY, y[i] * m_scaleY);
+        maxY = std::max(maxY, y[i] * m_scaleY);
+    }
+
+    int firstX = std::max((int)floor(minX), 0) & ~3;
+    int lastX = std::min((int)floor(maxX), m_width - 1);
+    int firstY = std::max((int)floor(minY), 0);
+    int lastY = std::min((int)floor(maxY), m_height - 1);
+
+    if (firstX > lastX || firstY > lastY)
+        return false;
+
+    // visible, if any pixel has no occluder nearer than the nearest point of the object
+    const __m128 objectZ = _mm_set1_ps(1.0f / nearest);
+
+    for (int py = firstY; py <= lastY; py++)
+    {
+        const float *row = &m_depth[py * m_width];
+
+        for (int px = firstX; px <= lastX; px += 4)
+        {
+            if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + px), objectZ)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+int OcclusionCuller::cull(const Camera &camera, int viewportWidth, int viewportHeight, size_t moved,
+                          std::vector<SceneTree::Visible> &visible)
+{
+    bool hasOccluders = false;
+    for (auto &v : visible)
+        hasOccluders = hasOccluders || (*v.object)->isOccluder();
+
+    if (!hasOccluders || viewportWidth <= 0 || viewportHeight <= 0)
+        return 0;
+
+    bool resized = false;
+    if (m_depth.empty() || m_scaleX != m_width / (float)viewportWidth || m_scaleY != m_height / (float)viewportHeight)
+    {
+        resize(viewportWidth, viewportHeight);
+        resized = true;
+    }
+
+    m_frame++;
+
+    // nothing has moved: the results of the previous frame hold
+    bool still = moved == 0 && !resized && m_lastViewProjection == camera.getViewProjectionMatrix();
+    m_lastViewProjection = camera.getViewProjectionMatrix();
+
+    bool drawn = false;
+    int occluded = 0;
+    size_t count = 0;
+
+    for (size_t i = 0; i < visible.size(); i++)
+    {
+        SceneObject &obj = **visible[i].object;
+        bool hidden = false;
+
+        if (!obj.m_occluder)
+        {
+            bool reuse = obj.m_occlusionSeen == m_frame - 1
+                         && (still || (!obj.m_occluded && m_frame - obj.m_occlusionTested < VISIBLE_FRAMES));
+
+            if (reuse)
+                hidden = obj.m_occluded;
+            else
+            {
+                if (!drawn)
+                {
+                    std::fill(m_depth.begin(), m_depth.end(), 0.0f);
+                    for (auto &v : visible)
+                    {
+                        if ((*v.object)->isOccluder())
+                            drawOccluder(camera, **v.object);
+                    }
+
+                    drawn = true;
+                }
+
+                hidden = isOccluded(camera, obj.bsphere());
+                obj.m_occluded = hidden;
+                obj.m_occlusionTested = m_frame;
+            }
+
+            obj.m_occlusionSeen = m_frame;
+        }
+
+        if (hidden)
+            occluded++;
+        else
+            visible[count++] = visible[i];
+    }
+
+    visible.resize(count);
+
+    return occluded;
+}
+
+}
@@ -0,0 +1,81 @@
+/*
+ * occlusionculler.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include "scenetree.h"
+#include "../math/m44.h"
+
+namespace rend
+{
+
+class Camera;
+class BoundingSphere;
+
+//! Removes the objects hidden behind the occluders.
+/*!
+  * Occluder objects (SceneObject::setOccluder()) are rasterized into a small depth buffer,
+  * which keeps 1 / z of the nearest occluder in every pixel. Other objects are occluded, if
+  * the nearest point of their bounding sphere is farther than the occluders in every pixel
+  * of the projected sphere. Occluders fill the pixels, which centers they cover, with
+  * the farthest depth in the pixel, so only a sliver under a pixel at the occluder silhouette
+  * may be hidden wrongly.
+  *
+  * Results are reused: a visible object is tested again after VISIBLE_FRAMES frames,
+  * an occluded one on every frame. If the camera and the objects have not moved,
+  * all results of the previous frame are reused and the buffer is not rebuilt.
+  */
+class OcclusionCuller
+{
+public:
+    //! Width of the depth buffer, the height follows the viewport aspect.
+    static const int BUFFER_WIDTH = 256;
+    //! Visible objects skip the test for this count of frames.
+    static const int VISIBLE_FRAMES = 4;
+
+private:
+    int m_width, m_height;
+    //! Viewport pixels -> buffer pixels.
+    float m_scaleX, m_scaleY;
+    //! 1 / z of the nearest occluder, 0 if there is no one.
+    std::vector<float> m_depth;
+
+    int m_frame;
+    math::M44 m_lastViewProjection;
+
+    //! Screen coordinates and 1 / z of the occluder vertices.
+    std::vector<float> m_x, m_y, m_w;
+    std::vector<uint8_t> m_flags;
+
+    void resize(int viewportWidth, int viewportHeight);
+    //! Rasterizes the triangle in the buffer coordinates.
+    void drawTriangle(const float *x, const float *y, const float *iz);
+    void drawOccluder(const Camera &camera, const SceneObject &obj);
+    bool isOccluded(const Camera &camera, const BoundingSphere &sphere) const;
+
+public:
+    OcclusionCuller();
+
+    //! Removes the occluded objects from the list, returns their count.
+    /*!
+      * \param moved Count of the objects, which are moved since the last frame.
+      */
+    int cull(const Camera &camera, int viewportWidth, int viewportHeight, size_t moved,
+             std::vector<SceneTree::Visible> &visible);
+
+    //! 1 / z of the occluders in the buffer pixel, for debugging.
+    float depth(int x, int y) const { return m_depth[y * m_width + x]; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    NONCOPYABLE(OcclusionCuller)
+};
+
+}
+
+#endif // OCCLUSIONCULLER_H
@@ -0,0 +1,269 @@
+/*
+ * pagedterrainsceneobject.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "pagedterrainsceneobject.h"
+#include "heightsource.h"
+#include "mesh.h"
+
+namespace rend
+{
+
+PagedTerrainSceneObject::PagedTerrainSceneObject(float width, float height, float vertScale,
+                                                 const sptr(HeightSource) source,
+                                                 const sptr(Texture) texture)
+    : m_source(source),
+      m_loadRadius(std::max(width, height) * 0.25f),
+      m_memoryBudget(64 * 1024 * 1024),
+      m_tilesX(0),
+      m_tilesZ(0),
+      m_isLoading(false),
+      m_quit(false)
+{
+    setName("paged_terrain");
+
+    if (!source || source->columns() < 2 || source->rows() < 2)
+    {
+        syslog << "Height source of the paged terrain is empty" << logerr;
+        return;
+    }
+
+    init(width, height, vertScale, source->columns(), source->rows(), texture);
+
+    const int tileChunks = TILE_CHUNKS;
+    m_tilesX = ((int)m_grid.chunkColumns.size() + tileChunks - 1) / tileChunks;
+    m_tilesZ = ((int)m_grid.chunkRows.size() + tileChunks - 1) / tileChunks;
+
+    // sphere of the whole map, the mesh has only the loaded part of it
+    float halfHeight = vertScale / 2.0f;
+    getMesh()->setBoundingSphere(BoundingSphere(math::vec3(0.0f, halfHeight, 0.0f),
+                                                sqrt(width * width / 4.0f + height * height / 4.0f + halfHeight * halfHeight)));
+
+    m_loader = std::thread(&PagedTerrainSceneObject::loaderMain, this);
+}
+
+PagedTerrainSceneObject::~PagedTerrainSceneObject()
+{
+    if (!m_loader.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wakeUp.notify_all();
+    m_loader.join();
+}
+
+size_t PagedTerrainSceneObject::tileBytes() const
+{
+    // the last chunk may have one more cell, chunks are small enough for 16 bit indices
+    size_t cells = CHUNK_SIZE + 1;
+    size_t vertices = (cells + 1) * (cells + 1);
+    size_t triangles = cells * cells * 2;
+
+    size_t chunkBytes = vertices * sizeof(math::vertex)
+                        + triangles * (sizeof(math::Plane) + 3 * sizeof(uint16_t));
+
+    return chunkBytes * TILE_CHUNKS * TILE_CHUNKS;
+}
+
+void PagedTerrainSceneObject::waitLoading()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_requests.empty() || m_isLoading)
+        m_loaded.wait(lock);
+}
+
+void PagedTerrainSceneObject::loaderMain()
+{
+    const int tileChunks = TILE_CHUNKS;
+
+    for (;;)
+    {
+        TileCoord coord;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (!m_quit && m_requests.empty())
+                m_wakeUp.wait(lock);
+
+            if (m_quit)
+                return;
+
+            coord = m_requests.front();
+            m_requests.pop_front();
+            m_loading = coord;
+            m_isLoading = true;
+        }
+
+        Tile tile;
+        tile.coord = coord;
+
+        int lastX = std::min((coord.first + 1) * tileChunks, (int)m_grid.chunkColumns.size());
+        int lastZ = std::min((coord.second + 1) * tileChunks, (int)m_grid.chunkRows.size());
+
+        for (int z = coord.second * tileChunks; z < lastZ; z++)
+        {
+            for (int x = coord.first * tileChunks; x < lastX; x++)
+            {
+                tile.chunks.push_back(ChunkData());
+                tile.chunks.back().x = x;
+                tile.chunks.back().z = z;
+
+                buildChunk(m_grid, *m_source, tile.chunks.back());
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_ready.push_back(Tile());
+            m_ready.back().coord = tile.coord;
+            m_ready.back().chunks.swap(tile.chunks);
+            m_isLoading = false;
+        }
+
+        m_loaded.notify_all();
+    }
+}
+
+float PagedTerrainSceneObject::tileDistance(const TileCoord &tile, const math::vec3 &point) const
+{
+    const int tileChunks = TILE_CHUNKS;
+
+    int firstX = tile.first * tileChunks;
+    int firstZ = tile.second * tileChunks;
+    int lastX = std::min(firstX + tileChunks, (int)m_grid.chunkColumns.size()) - 1;
+    int lastZ = std::min(firstZ + tileChunks, (int)m_grid.chunkRows.size()) - 1;
+
+    float colStep = m_grid.width / (float)(m_grid.columns - 1);
+    float rowStep = m_grid.height / (float)(m_grid.rows - 1);
+
+    float minX = m_grid.firstColumns[firstX] * colStep - m_grid.width / 2.0f;
+    float maxX = (m_grid.firstColumns[lastX] + m_grid.chunkColumns[lastX]) * colStep - m_grid.width / 2.0f;
+    float minZ = m_grid.firstRows[firstZ] * rowStep - m_grid.height / 2.0f;
+    float maxZ = (m_grid.firstRows[lastZ] + m_grid.chunkRows[lastZ]) * rowStep - m_grid.height / 2.0f;
+
+    float dx = std::max(std::max(minX - point.x, point.x - maxX), 0.0f);
+    float dz = std::max(std::max(minZ - point.z, point.z - maxZ), 0.0f);
+
+    return dx * dx + dz * dz;
+}
+
+void PagedTerrainSceneObject::integrateReady(const std::set<TileCoord> &wanted)
+{
+    std::vector<Tile> ready;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ready.swap(m_ready);
+    }
+
+    for (auto &tile : ready)
+    {
+        // the camera has gone away while the tile was built
+        if (!wanted.count(tile.coord) || !m_resident.insert(tile.coord).second)
+            continue;
+
+        for (auto &chunk : tile.chunks)
+            addChunk(chunk);
+    }
+}
+
+void PagedTerrainSceneObject::evict(const TileCoord &tile)
+{
+    const int tileChunks = TILE_CHUNKS;
+
+    for (int z = tile.second * tileChunks; z < (tile.second + 1) * tileChunks; z++)
+        for (int x = tile.first * tileChunks; x < (tile.first + 1) * tileChunks; x++)
+            removeChunk(x, z);
+
+    m_resident.erase(tile);
+}
+
+void PagedTerrainSceneObject::selectLod(const Camera &camera)
+{
+    if (!m_loader.joinable())
+        return;
+
+    math::vec3 eye;
+    if (!eyePosition(camera, eye))
+        return;
+
+    size_t maxTiles = std::max(m_memoryBudget / tileBytes(), (size_t)1);
+
+    // tiles around the camera, nearest first, as many as the budget allows
+    std::vector<std::pair<float, TileCoord> > wanted;
+    float radius2 = m_loadRadius * m_loadRadius;
+
+    for (int z = 0; z < m_tilesZ; z++)
+    {
+        for (int x = 0; x < m_tilesX; x++)
+        {
+            float distance = tileDistance(TileCoord(x, z), eye);
+            if (distance <= radius2)
+                wanted.push_back(std::make_pair(distance, TileCoord(x, z)));
+        }
+    }
+
+    std::sort(wanted.begin(), wanted.end());
+    if (wanted.size() > maxTiles)
+        wanted.resize(maxTiles);
+
+    std::set<TileCoord> wantedSet;
+    for (auto &tile : wanted)
+        wantedSet.insert(tile.second);
+
+    integrateReady(wantedSet);
+
+    std::deque<TileCoord> requests;
+    for (auto &tile : wanted)
+    {
+        if (!m_resident.count(tile.second))
+            requests.push_back(tile.second);
+    }
+
+    // evict the farthest tiles, which are not wanted, to free the place for the requested ones
+    std::vector<std::pair<float, TileCoord> > unwanted;
+    for (auto &tile : m_resident)
+    {
+        if (!wantedSet.count(tile))
+            unwanted.push_back(std::make_pair(tileDistance(tile, eye), tile));
+    }
+
+    std::sort(unwanted.begin(), unwanted.end());
+
+    while (!unwanted.empty() && m_resident.size() + requests.size() > maxTiles)
+    {
+        evict(unwanted.back().second);
+        unwanted.pop_back();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // the tile, which is being built, and the built ones will come anyway
+        if (m_isLoading)
+            requests.erase(std::remove(requests.begin(), requests.end(), m_loading), requests.end());
+
+        for (auto &tile : m_ready)
+            requests.erase(std::remove(requests.begin(), requests.end(), tile.coord), requests.end());
+
+        // not started requests are replaced, so the queue follows the camera
+        m_requests.swap(requests);
+    }
+
+    m_wakeUp.notify_one();
+
+    selectLevels(camera);
+}
+
+}
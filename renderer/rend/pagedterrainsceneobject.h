@@ -0,0 +1,107 @@
+/*
+ * pagedterrainsceneobject.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef PAGEDTERRAINSCENEOBJECT_H
+#define PAGEDTERRAINSCENEOBJECT_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+
+#include "terrainsceneobject.h"
+
+namespace rend
+{
+
+//! Terrain, which heights are streamed from the source around the camera.
+/*!
+  * Chunks are grouped into square tiles of TILE_CHUNKS x TILE_CHUNKS chunks. Tiles within the
+  * load radius of the camera are built by the loader thread, nearest first, and are added to the mesh
+  * by selectLod() on the next frame. The count of tiles in memory is limited by the memory budget,
+  * the farthest tiles are evicted first.
+  *
+  * Every chunk has its own vertex buffer, so the 16 bit indices are enough for any map size.
+  * Chunks, which neighbours are not loaded, keep the full border of their own level.
+  */
+class PagedTerrainSceneObject : public TerrainSceneObject
+{
+public:
+    //! Chunks count of the tile side.
+    static const int TILE_CHUNKS = 4;
+
+private:
+    typedef std::pair<int, int> TileCoord;
+
+    struct Tile
+    {
+        TileCoord coord;
+        std::vector<ChunkData> chunks;
+    };
+
+    sptr(HeightSource) m_source;
+
+    float m_loadRadius;
+    size_t m_memoryBudget;
+
+    int m_tilesX, m_tilesZ;
+    //! Tiles, which chunks are in the mesh.
+    std::set<TileCoord> m_resident;
+
+    //! Loader state, guarded by the mutex.
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_loaded;
+    std::deque<TileCoord> m_requests;
+    std::vector<Tile> m_ready;
+    TileCoord m_loading;
+    bool m_isLoading;
+    bool m_quit;
+
+    std::thread m_loader;
+
+    void loaderMain();
+
+    //! Squared distance in the XZ plane from the point to the tile.
+    float tileDistance(const TileCoord &tile, const math::vec3 &point) const;
+    //! Adds the built tiles, which are still wanted, to the mesh.
+    void integrateReady(const std::set<TileCoord> &wanted);
+    void evict(const TileCoord &tile);
+
+public:
+    PagedTerrainSceneObject(float width, float height, float vertScale,
+                            const sptr(HeightSource) source,
+                            const sptr(Texture) texture = std::shared_ptr<Texture>());
+    //! Stops the loader.
+    ~PagedTerrainSceneObject();
+
+    //! Tiles, which are closer to the camera than the radius in the object space, are loaded.
+    void    setLoadRadius(float radius) { m_loadRadius = radius; }
+    float   getLoadRadius() const { return m_loadRadius; }
+
+    //! Max bytes of the vertex buffers in memory, one tile is loaded at least.
+    void    setMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+    size_t  getMemoryBudget() const { return m_memoryBudget; }
+
+    //! Upper estimate of the memory of one tile.
+    size_t  tileBytes() const;
+    //! Count of the tiles in the mesh.
+    size_t  residentTiles() const { return m_resident.size(); }
+    //! True if the tile is in the mesh.
+    bool    isResident(int tileX, int tileZ) const { return m_resident.count(TileCoord(tileX, tileZ)) != 0; }
+
+    //! Blocks until all requested tiles are built, they are added by the next selectLod().
+    void    waitLoading();
+
+    //! Pages the tiles in and out, and selects the levels of the chunks.
+    virtual void selectLod(const Camera &camera);
+};
+
+}
+
+#endif // PAGEDTERRAINSCENEOBJECT_H
@@ -9,175 +9,777 @@
 
 #include "renderlist.h"
 
+#include "m33.h"
 #include "m44.h"
+#include "simd.h"
 #include "camera.h"
 #include "vertex.h"
 #include "vertexbuffer.h"
 #include "mesh.h"
 #include "sceneobject.h"
+#include "lighting.h"
+#include "material.h"
 
 namespace rend
 {
 
-void RenderList::createTriangles(const VertexBuffer &vertexBuffer, const math::M44 &transform)
+// object space back face test: the camera is not in front of the triangle plane
+static inline bool facesAway(const math::Plane &plane, const math::vec3 &eye, bool mirrored)
 {
-    static math::Triangle triangle;
+    float dist = plane.normal().dotProduct(eye) + plane.distance();
+
+    return mirrored ? dist >= 0.0f : dist <= 0.0f;
+}
+
+// all triangles of the cluster face away: the whole cluster sphere is behind every plane with the normal in the cone
+static inline bool facesAway(const VertexBuffer::Cluster &cluster, const math::vec3 &eye, bool mirrored)
+{
+    if (cluster.coneCutoff >= 1.0f)
+        return false;
+
+    math::vec3 view = cluster.center - eye;
+    float along = view.dotProduct(cluster.coneAxis);
+
+    // mirrored triangles face the other side
+    if (mirrored)
+        along = -along;
+
+    return along >= cluster.coneCutoff * sqrt(view.dotProduct(view)) + cluster.radius;
+}
+
+template<typename Index>
+size_t RenderList::createIndexedTriangles(const Batch &batch, const Index *indices, size_t begin, size_t end)
+{
+    const VertexBuffer &vertexBuffer = *batch.vertexBuffer;
+    const math::M44 &transform = batch.transform;
+    const Material *material = batch.material;
+    const MaterialHandle materialHandle = material ? material->handle() : 0;
+
+    math::Triangle triangle;
     // all mesh vertices
     const VertexBuffer::VertexArray &vertices = vertexBuffer.getVertices();
-    // mesh indices
-    const VertexBuffer::IndexArray &indices = vertexBuffer.getIndices();
 
     const std::vector<math::vec2> &uvs = vertexBuffer.getUVs();
     const VertexBuffer::IndexArray &uvind = vertexBuffer.getUVIndices();
 
-    size_t verticesSize = vertices.size();
-    size_t indicesSize = indices.size();
-    size_t t = m_lastTriangleIndex;
+    const std::vector<math::Plane> &planes = vertexBuffer.getFacePlanes();
+    size_t culled = 0;
 
-    switch(vertexBuffer.getType())
+    math::Triangle *out = &m_triangles[batch.first];
+
+    for (size_t t = begin; t < end; t++)
     {
-    case VertexBuffer::INDEXEDTRIANGLELIST:
+        size_t face = batch.firstTriangle + t;
 
-        for(size_t ind = 0; ind < indicesSize; ind += 3, t++)
+        // do not copy and transform the back faces at all
+        if (batch.cullBackfaces && facesAway(planes[face], batch.eye, batch.mirrored))
         {
-            if ((ind + 2) >= indicesSize)
-                break;
+            out[t].clipped = true;
+            culled++;
+            continue;
+        }
 
-            // form the triangle
-            triangle.v(0) = vertices[indices[ind + 0]];
-            triangle.v(1) = vertices[indices[ind + 1]];
-            triangle.v(2) = vertices[indices[ind + 2]];
+        size_t ind = face * 3;
 
-            // translate and rotate the triangle
-            // TODO: applying transformation for normals only where changing matrix (do not need store original normals)
-            triangle.applyTransformation(transform);
+        // form the triangle
+        triangle.v(0) = vertices[indices[ind + 0]];
+        triangle.v(1) = vertices[indices[ind + 1]];
+        triangle.v(2) = vertices[indices[ind + 2]];
 
-            if (!uvs.empty() && !uvind.empty())
-            {
-                triangle.v(0).t = uvs[uvind[ind + 0]];
-                triangle.v(1).t = uvs[uvind[ind + 1]];
-                triangle.v(2).t = uvs[uvind[ind + 2]];
-            }
+        // translate and rotate the triangle
+        // TODO: applying transformation for normals only where changing matrix (do not need store original normals)
+        triangle.applyTransformation(transform);
 
-            // set material
-            triangle.setMaterial(vertexBuffer.getMaterial());
+        if (!uvs.empty() && !uvind.empty())
+        {
+            triangle.v(0).t = uvs[uvind[ind + 0]];
+            triangle.v(1).t = uvs[uvind[ind + 1]];
+            triangle.v(2).t = uvs[uvind[ind + 2]];
+        }
 
-            // compute normal for triangle
-            triangle.computeNormal();
+        // set material
+        triangle.setMaterial(materialHandle);
 
-            // save it
-//            m_triangles.push_back(triangle);
-            m_triangles[t] = triangle;
-        }
+        // compute normal for triangle
+        triangle.computeNormal();
+
+        // save it
+        out[t] = triangle;
+    }
+
+    return culled;
+}
+
+size_t RenderList::createTriangles(const Batch &batch, size_t begin, size_t end)
+{
+    const VertexBuffer &vertexBuffer = *batch.vertexBuffer;
+    const math::M44 &transform = batch.transform;
+    const Material *material = batch.material;
+    const MaterialHandle materialHandle = material ? material->handle() : 0;
 
-        m_lastTriangleIndex += t;
+    math::Triangle triangle;
+    // all mesh vertices
+    const VertexBuffer::VertexArray &vertices = vertexBuffer.getVertices();
+    // mesh indices
+    const VertexBuffer::IndexArray &indices = vertexBuffer.getIndices();
+
+    const std::vector<math::Plane> &planes = vertexBuffer.getFacePlanes();
+    size_t culled = 0;
+
+    math::Triangle *out = &m_triangles[batch.first];
+
+    switch(vertexBuffer.getType())
+    {
+    case VertexBuffer::INDEXEDTRIANGLELIST:
+
+        // the loop is built for the index width of the buffer
+        if (indices.wide())
+            culled = createIndexedTriangles(batch, indices.data<uint32_t>(), begin, end);
+        else
+            culled = createIndexedTriangles(batch, indices.data<uint16_t>(), begin, end);
 
         break;
 
     case VertexBuffer::TRIANGLELIST:
 
-        for(size_t v = 0; v < verticesSize; v += 3, t++)
+        for (size_t t = begin; t < end; t++)
         {
-            if ((v + 2) >= verticesSize)
-                break;
+            size_t face = batch.firstTriangle + t;
+
+            if (batch.cullBackfaces && facesAway(planes[face], batch.eye, batch.mirrored))
+            {
+                out[t].clipped = true;
+                culled++;
+                continue;
+            }
 
             // form the triangle
-            triangle.setVertices(&vertices[v]);
+            triangle.setVertices(&vertices[face * 3]);
 
             // translate and rotate the triangle
             triangle.applyTransformation(transform);                    // bottleneck
 
             // set material
-            triangle.setMaterial(vertexBuffer.getMaterial());
+            triangle.setMaterial(materialHandle);
 
             // compute normals
             triangle.computeNormal();                                   // bottleneck
 
             // save it
-//            m_triangles.push_back(triangle);                            // bottleneck
-            m_triangles[t] = triangle;
+            out[t] = triangle;
         }
 
-        m_lastTriangleIndex += t;
-
         break;
 
     case VertexBuffer::UNDEFINED:
     default:
-        syslog << "Can't draw this mesh." << logerr;
         break;
     }
+
+    return culled;
+}
+
+void RenderList::TransformedVertices::resize(size_t size)
+{
+    wx.resize(size);
+    wy.resize(size);
+    wz.resize(size);
+    sx.resize(size);
+    sy.resize(size);
+    z.resize(size);
+    clip.resize(size);
+    color.resize(size);
+}
+
+template<typename Fn>
+void RenderList::forEachBatch(size_t from, size_t to, size_t Batch::*first, size_t Batch::*count, Fn fn) const
+{
+    // first batch, which ends after from
+    auto batch = std::upper_bound(m_batches.begin(), m_batches.end(), from,
+                                  [=](size_t index, const Batch &b) { return index < b.*first + b.*count; });
+
+    for (; batch != m_batches.end() && (*batch).*first < to; ++batch)
+    {
+        size_t begin = std::max(from, (*batch).*first) - (*batch).*first;
+        size_t end = std::min(to, (*batch).*first + (*batch).*count) - (*batch).*first;
+
+        if (begin < end)
+            fn(*batch, begin, end);
+    }
 }
 
-void RenderList::prepare(size_t trianglesCount)
+// world positions are needed only for lighting
+static bool needsWorldPositions(const Material *material, const Lighting &lighting)
 {
-//    m_triangles.clear();
-    m_lastTriangleIndex = 0;
-    if (m_triangles.size() < trianglesCount)
+    if (!material || !lighting.enabled())
+        return false;
+
+    switch (material->shadeMode)
     {
-        m_triangles.resize(trianglesCount);
+    case Material::SM_FLAT:
+    case Material::SM_GOURAUD:
+    case Material::SM_TEXTURE:
+        return true;
+
+    default:
+        return false;
     }
 }
 
-void RenderList::append(const sptr(SceneObject) obj)
+void RenderList::processVertices(const Batch &batch, const Camera &cam, const Lighting &lighting, size_t begin, size_t end)
 {
-    if (!obj->getMesh())
+    const VertexBuffer::VertexArray &vertices = batch.vertexBuffer->getVertices();
+    const Material *material = batch.material;
+    const math::M44 &m = batch.clipTransform;
+
+    bool world = needsWorldPositions(material, lighting);
+    bool gouraud = world && material->shadeMode == Material::SM_GOURAUD;
+
+    TransformedVertices &out = m_vertices;
+
+    size_t first = batch.firstVertex + begin;
+    size_t count = end - begin;
+
+    // submesh vertices
+    begin = first - batch.vertexBase;
+    end = begin + count;
+
+    // object -> clip space, clip z is not used. Clip x and y are projected in place,
+    // clip w is the camera space z
+    float *x = &out.sx[first];
+    float *y = &out.sy[first];
+    float *w = &out.z[first];
+
+    math::TransformPoints(m, &vertices[begin].p, sizeof(math::vertex), count, x, y, 0, w);
+    cam.clipFlags(x, y, w, count, &out.clip[first]);
+
+    // near plane vertices get garbage here, but triangles with them are thrown away
+    cam.clipToScreen(x, y, w, count, x, y);
+
+    if (!world)
         return;
 
-    const std::list<VertexBuffer> &subMeshes = obj->getMesh()->getSubmeshes();
-    const math::M44 &worldTransform = obj->getTransformation();
+    math::TransformPoints(batch.transform, &vertices[begin].p, sizeof(math::vertex), count,
+                          &out.wx[first], &out.wy[first], &out.wz[first], 0);
 
-    for (const auto &vb : subMeshes)
+    if (!gouraud)
+        return;
+
+    // all lights at once for the groups of vertices, normals are gathered to SoA
+    float nx[Lighting::MAX_POINTS], ny[Lighting::MAX_POINTS], nz[Lighting::MAX_POINTS];
+    Color3 base[Lighting::MAX_POINTS];
+
+    for (size_t v = begin; v < end; v += Lighting::MAX_POINTS)
     {
-        // TODO: where to compute vertex normals? Here?? Maybe when we apply transformation for model only?
-        createTriangles(vb, worldTransform);
+        size_t groupSize = std::min(end - v, Lighting::MAX_POINTS);
+        size_t i = batch.vertexBase + v;
+
+        for (size_t k = 0; k < groupSize; k++)
+        {
+            const math::vertex &vertex = vertices[v + k];
+            nx[k] = vertex.n.x;
+            ny[k] = vertex.n.y;
+            nz[k] = vertex.n.z;
+            base[k] = vertex.color;
+        }
+
+        lighting.shade(*material, nx, ny, nz, &out.wx[i], &out.wy[i], &out.wz[i], base, groupSize, &out.color[i]);
     }
 }
 
-void RenderList::zsort()
+math::Triangle *RenderList::assembleTriangles(const Batch &batch, const Lighting &lighting, size_t begin, size_t end,
+                                              math::Triangle *out, CullStats &stats)
 {
-//    m_triangles.sort(math::ZCompareAvg);
+    const VertexBuffer::IndexArray &indices = batch.vertexBuffer->getIndices();
+
+    // the loop is built for the index width of the buffer
+    if (indices.wide())
+        return assembleTriangles(batch, indices.data<uint32_t>(), lighting, begin, end, out, stats);
+
+    return assembleTriangles(batch, indices.data<uint16_t>(), lighting, begin, end, out, stats);
 }
 
-size_t RenderList::getCountOfNotClippedTriangles() const
+template<typename Index>
+math::Triangle *RenderList::assembleTriangles(const Batch &batch, const Index *indices, const Lighting &lighting,
+                                              size_t begin, size_t end, math::Triangle *out, CullStats &stats)
 {
-    return std::count_if(m_triangles.begin(), m_triangles.end(),
-                         [](const math::Triangle &t) -> bool { return !t.clipped; } );
+    const VertexBuffer &vertexBuffer = *batch.vertexBuffer;
+    const Material *material = batch.material;
+    const MaterialHandle materialHandle = material ? material->handle() : 0;
+
+    const VertexBuffer::VertexArray &vertices = vertexBuffer.getVertices();
+
+    const std::vector<math::vec2> &uvs = vertexBuffer.getUVs();
+    const VertexBuffer::IndexArray &uvind = vertexBuffer.getUVIndices();
+    const std::vector<math::Plane> &planes = vertexBuffer.getFacePlanes();
+
+    bool indexed = vertexBuffer.getType() == VertexBuffer::INDEXEDTRIANGLELIST;
+    bool separateUVs = indexed && !uvs.empty() && !uvind.empty();
+    bool twoSide = material && material->sideType == Material::TWO_SIDE;
+    bool testFrustum = !batch.insideFrustum;
+    bool lit = lighting.enabled();
+
+    const TransformedVertices &in = m_vertices;
+
+    for (size_t t = batch.firstTriangle + begin; t < batch.firstTriangle + end; t++)
+    {
+        // back face in the object space, the post-transform buffer is not touched
+        if (batch.cullBackfaces && facesAway(planes[t], batch.eye, batch.mirrored))
+        {
+            stats.backface++;
+            continue;
+        }
+
+        size_t ind = t * 3;
+
+        // vertices of the submesh
+        size_t v0 = indexed ? indices[ind + 0] : ind + 0;
+        size_t v1 = indexed ? indices[ind + 1] : ind + 1;
+        size_t v2 = indexed ? indices[ind + 2] : ind + 2;
+
+        // and of the post-transform buffer
+        size_t i0 = batch.vertexBase + v0;
+        size_t i1 = batch.vertexBase + v1;
+        size_t i2 = batch.vertexBase + v2;
+
+        // behind the projection plane
+        if ((in.clip[i0] | in.clip[i1] | in.clip[i2]) & Camera::CLIP_NEAR)
+        {
+            stats.nearPlane++;
+            continue;
+        }
+
+        // out of fov
+        if (testFrustum && (in.clip[i0] & in.clip[i1] & in.clip[i2]))
+        {
+            stats.frustum++;
+            continue;
+        }
+
+        // back face, front faces are clockwise on the screen (y goes down)
+        if (!twoSide)
+        {
+            float area = (in.sx[i1] - in.sx[i0]) * (in.sy[i2] - in.sy[i0])
+                       - (in.sx[i2] - in.sx[i0]) * (in.sy[i1] - in.sy[i0]);
+
+            if (area <= 0.0f)
+            {
+                stats.backface++;
+                continue;
+            }
+        }
+
+        // visible, emit it
+        math::Triangle &triangle = *out++;
+
+        math::vertex &r0 = triangle.v(0);
+        math::vertex &r1 = triangle.v(1);
+        math::vertex &r2 = triangle.v(2);
+
+        r0.p = math::vec3(in.sx[i0], in.sy[i0], in.z[i0]);
+        r1.p = math::vec3(in.sx[i1], in.sy[i1], in.z[i1]);
+        r2.p = math::vec3(in.sx[i2], in.sy[i2], in.z[i2]);
+
+        if (separateUVs)
+        {
+            r0.t = uvs[uvind[ind + 0]];
+            r1.t = uvs[uvind[ind + 1]];
+            r2.t = uvs[uvind[ind + 2]];
+        }
+        else
+        {
+            r0.t = vertices[v0].t;
+            r1.t = vertices[v1].t;
+            r2.t = vertices[v2].t;
+        }
+
+        r0.color = vertices[v0].color;
+        r1.color = vertices[v1].color;
+        r2.color = vertices[v2].color;
+
+        switch (material ? material->shadeMode : Material::SM_UNDEFINED)
+        {
+        case Material::SM_FLAT:
+        case Material::SM_TEXTURE:
+        {
+            // one face color, the texture is modulated with it on rasterizing phaze
+            if (!lit)
+                break;
+
+            math::vec3 p0(in.wx[i0], in.wy[i0], in.wz[i0]);
+            math::vec3 normal = math::TriangleNormal(p0,
+                                                     math::vec3(in.wx[i1], in.wy[i1], in.wz[i1]),
+                                                     math::vec3(in.wx[i2], in.wy[i2], in.wz[i2]));
+
+            Lighting::LightColor faceLight = lighting.reflected(*material, normal, p0);
+
+            r0.color = Lighting::add(r0.color, faceLight);
+            r1.color = Lighting::add(r1.color, faceLight);
+            r2.color = Lighting::add(r2.color, faceLight);
+            break;
+        }
+
+        case Material::SM_GOURAUD:
+            // the vertices are lit by processVertices()
+            if (!lit)
+                break;
+
+            r0.color = in.color[i0];
+            r1.color = in.color[i1];
+            r2.color = in.color[i2];
+            break;
+
+        case Material::SM_UNDEFINED:
+        case Material::SM_PLAIN_COLOR:
+        case Material::SM_WIRE:
+            if (material && lit)
+                r0.color = r1.color = r2.color = material->plainColor;
+            break;
+
+        default:
+            break;
+        }
+
+        triangle.setMaterial(materialHandle);
+        triangle.clipped = false;
+    }
+
+    return out;
 }
 
-void RenderList::removeBackfaces(const sptr(Camera) cam)
+void RenderList::prepare()
+{
+    m_size = 0;
+    m_lastTriangleIndex = 0;
+    m_lastVertexIndex = 0;
+    m_submeshesCulled = 0;
+    m_clustersCulled = 0;
+    m_batches.clear();
+}
+
+void RenderList::append(const sptr(SceneObject) obj)
+{
+    size_t from = m_lastTriangleIndex;
+
+    reserve(obj);
+    createTriangles(from, m_lastTriangleIndex);
+}
+
+void RenderList::reserve(const sptr(SceneObject) obj, math::FrustumRelation relation)
 {
-    auto t = m_triangles.begin();
+    sptr(Mesh) mesh = obj->getLodMesh();
+    if (!mesh)
+        return;
+
+    reserve(*mesh, obj->getTransformation(), 0, relation);
+}
+
+void RenderList::reserve(const Mesh &mesh, const math::M44 &worldTransform, const Material *material,
+                         math::FrustumRelation relation)
+{
+    const std::list<VertexBuffer> &subMeshes = mesh.getSubmeshes();
+
+    // camera in the object space: world = object * rotScale + translation
+    math::M33 rotScale = worldTransform.getM();
+    float det = rotScale.determinant();
+    bool invertible = m_objectBackfaces && !math::DCMP(det, 0.0f);
+
+    math::vec3 eye;
+    if (invertible)
+        eye = (m_cameraPosition - worldTransform.getV()) * math::M33(rotScale).invert();
+
+    // world radius of the clusters, computed on the first use
+    float scale = -1.0f;
 
-    while (t != m_triangles.end())
+    for (const auto &vb : subMeshes)
     {
-        if (t->normal().isZero())
+        Batch batch;
+        batch.vertexBuffer = &vb;
+        batch.material = material ? material : vb.getMaterial().get();
+        batch.transform = worldTransform;
+        batch.clipTransform = worldTransform * m_viewProjection;
+        batch.first = m_lastTriangleIndex;
+        batch.firstTriangle = 0;
+        batch.firstVertex = m_lastVertexIndex;
+        batch.vertexCount = m_vertexCache ? vb.numVertices() : 0;
+        batch.vertexBase = batch.firstVertex;
+
+        switch (vb.getType())
         {
-            t++;
+        case VertexBuffer::INDEXEDTRIANGLELIST:
+            batch.count = vb.numIndices() / 3;
+            break;
+
+        case VertexBuffer::TRIANGLELIST:
+            batch.count = vb.numVertices() / 3;
+            batch.vertexCount = m_vertexCache ? batch.count * 3 : 0;
+            break;
+
+        default:
+            syslog << "Can't draw this mesh." << logerr;
             continue;
         }
 
-        if (t->getMaterial()->sideType == rend::Material::TWO_SIDE)
+        if (batch.count == 0)
+            continue;
+
+        batch.insideFrustum = relation == math::FRUSTUM_INSIDE;
+
+        if (relation == math::FRUSTUM_INTERSECT && m_frustum)
         {
-            t++;
+            // world space box around the rotated and scaled submesh box
+            math::vec3 center = 0.5f * (vb.getBoundsMin() + vb.getBoundsMax()) * worldTransform;
+            math::vec3 half = 0.5f * (vb.getBoundsMax() - vb.getBoundsMin());
+            math::vec3 extents(fabs(rotScale.x[0][0]) * half.x + fabs(rotScale.x[1][0]) * half.y + fabs(rotScale.x[2][0]) * half.z,
+                               fabs(rotScale.x[0][1]) * half.x + fabs(rotScale.x[1][1]) * half.y + fabs(rotScale.x[2][1]) * half.z,
+                               fabs(rotScale.x[0][2]) * half.x + fabs(rotScale.x[1][2]) * half.y + fabs(rotScale.x[2][2]) * half.z);
+
+            math::FrustumRelation submesh = m_frustum->testBox(center, extents);
+            if (submesh == math::FRUSTUM_OUTSIDE)
+            {
+                m_submeshesCulled++;
+                continue;
+            }
+
+            batch.insideFrustum = submesh == math::FRUSTUM_INSIDE;
+        }
+
+        batch.cullBackfaces = invertible
+                              && !(batch.material && batch.material->sideType == Material::TWO_SIDE)
+                              && vb.getFacePlanes().size() == batch.count;
+        batch.mirrored = det < 0.0f;
+        batch.eye = eye;
+
+        // clusters are tested only if some of them may be culled
+        if (!vb.getClusters().empty() && (batch.cullBackfaces || (!batch.insideFrustum && m_frustum)))
+        {
+            if (scale < 0.0f)
+                scale = rotScale.maxScale();
+
+            reserveClusters(batch, scale);
             continue;
         }
 
-        math::vec3 view = cam->getPosition() - t->v(0).p;
-        view.normalize();
-        float dp = t->normal().dotProduct(view);
+        m_batches.push_back(batch);
+        m_lastTriangleIndex += batch.count;
+        m_lastVertexIndex += batch.vertexCount;
+    }
+
+    if (m_triangles.size() < m_lastTriangleIndex)
+        m_triangles.resize(m_lastTriangleIndex);
+}
 
-        if (dp <= 0)
+void RenderList::reserveClusters(const Batch &submesh, float scale)
+{
+    const VertexBuffer &vb = *submesh.vertexBuffer;
+    bool testFrustum = !submesh.insideFrustum && m_frustum;
+
+    size_t firstBatch = m_batches.size();
+    size_t vertexBegin = (size_t)-1;
+    size_t vertexEnd = 0;
+
+    for (const auto &cluster : vb.getClusters())
+    {
+        bool inside = submesh.insideFrustum;
+
+        if (testFrustum)
         {
-            // TODO:
-            // not erase, just flag it as culled
-            t->clipped = true;
-//            t = m_triangles.erase(t);
-//            continue;
+            math::FrustumRelation relation = m_frustum->testSphere(cluster.center * submesh.transform, cluster.radius * scale);
+            if (relation == math::FRUSTUM_OUTSIDE)
+            {
+                m_clustersCulled++;
+                continue;
+            }
+
+            inside = relation == math::FRUSTUM_INSIDE;
         }
 
-        t++;
+        if (submesh.cullBackfaces && facesAway(cluster, submesh.eye, submesh.mirrored))
+        {
+            m_clustersCulled++;
+            continue;
+        }
+
+        vertexBegin = std::min(vertexBegin, cluster.firstVertex);
+        vertexEnd = std::max(vertexEnd, cluster.lastVertex);
+
+        // extend the last batch by the next cluster
+        if (m_batches.size() > firstBatch)
+        {
+            Batch &last = m_batches.back();
+            if (last.insideFrustum == inside && last.firstTriangle + last.count == cluster.first)
+            {
+                last.count += cluster.count;
+                m_lastTriangleIndex += cluster.count;
+                continue;
+            }
+        }
+
+        Batch batch = submesh;
+        batch.first = m_lastTriangleIndex;
+        batch.firstTriangle = cluster.first;
+        batch.count = cluster.count;
+        batch.insideFrustum = inside;
+
+        m_batches.push_back(batch);
+        m_lastTriangleIndex += cluster.count;
+    }
+
+    if (m_batches.size() == firstBatch || !m_vertexCache)
+        return;
+
+    // vertices used by the visible clusters are processed once, by the first batch
+    size_t vertexCount = vertexEnd - vertexBegin;
+
+    for (size_t b = firstBatch; b < m_batches.size(); b++)
+    {
+        Batch &batch = m_batches[b];
+        batch.vertexBase = m_lastVertexIndex - vertexBegin;
+        batch.firstVertex = b == firstBatch ? m_lastVertexIndex : m_lastVertexIndex + vertexCount;
+        batch.vertexCount = b == firstBatch ? vertexCount : 0;
+    }
+
+    m_lastVertexIndex += vertexCount;
+}
+
+void RenderList::trim()
+{
+    // storage only grows, triangles and vertices after the used ones are left from the previous frames
+    m_size = m_lastTriangleIndex;
+    if (m_vertices.wx.size() < m_lastVertexIndex)
+        m_vertices.resize(m_lastVertexIndex);
+
+    // ranges, which are not assembled, have no survivors
+    AssemblyChunk empty = { 0, CullStats() };
+    m_chunks.assign((m_lastTriangleIndex + ASSEMBLY_CHUNK - 1) / ASSEMBLY_CHUNK, empty);
+}
+
+size_t RenderList::createTriangles(size_t from, size_t to)
+{
+    size_t culled = 0;
+
+    forEachBatch(from, to, &Batch::first, &Batch::count, [&](const Batch &batch, size_t begin, size_t end)
+    {
+        culled += createTriangles(batch, begin, end);
+    });
+
+    return culled;
+}
+
+void RenderList::forEachIntersecting(size_t from, size_t to, const std::function<void(size_t, size_t)> &fn) const
+{
+    forEachBatch(from, to, &Batch::first, &Batch::count, [&](const Batch &batch, size_t begin, size_t end)
+    {
+        if (!batch.insideFrustum)
+            fn(batch.first + begin, batch.first + end);
+    });
+}
+
+void RenderList::processVertices(const Camera &cam, const Lighting &lighting, size_t from, size_t to)
+{
+    forEachBatch(from, to, &Batch::firstVertex, &Batch::vertexCount,
+                 [&](const Batch &batch, size_t begin, size_t end) { processVertices(batch, cam, lighting, begin, end); });
+}
+
+void RenderList::assembleTriangles(const Lighting &lighting, size_t from, size_t to)
+{
+    assert(from % ASSEMBLY_CHUNK == 0);
+
+    AssemblyChunk &chunk = m_chunks[from / ASSEMBLY_CHUNK];
+    chunk.stats = CullStats();
+
+    // survivors overwrite the beginning of the range, triangles are built from the post-transform buffer
+    math::Triangle *first = m_triangles.data() + from;
+    math::Triangle *out = first;
+
+    forEachBatch(from, to, &Batch::first, &Batch::count, [&](const Batch &batch, size_t begin, size_t end)
+    {
+        out = assembleTriangles(batch, lighting, begin, end, out, chunk.stats);
+    });
+
+    chunk.survivors = out - first;
+}
+
+void RenderList::compact()
+{
+    size_t size = 0;
+    m_cullStats = CullStats();
+
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        const AssemblyChunk &chunk = m_chunks[i];
+        size_t from = i * ASSEMBLY_CHUNK;
+
+        // plain memory move, the destination is always before the source
+        if (size != from)
+            std::copy(m_triangles.begin() + from, m_triangles.begin() + from + chunk.survivors, m_triangles.begin() + size);
+
+        size += chunk.survivors;
+        m_cullStats += chunk.stats;
     }
+
+    m_size = size;
+}
+
+void RenderList::zsort()
+{
+//    m_triangles.sort(math::ZCompareAvg);
+}
+
+size_t RenderList::getCountOfNotClippedTriangles() const
+{
+    return std::count_if(m_triangles.begin(), m_triangles.begin() + m_size,
+                         [](const math::Triangle &t) -> bool { return !t.clipped; } );
+}
+
+void RenderList::removeBackfaces(const sptr(Camera) cam)
+{
+    removeBackfaces(cam, 0, m_size);
+}
+
+size_t RenderList::removeBackfaces(const sptr(Camera) cam, size_t from, size_t to)
+{
+    const math::vec3 camPosition = cam->getPosition();
+    size_t culled = 0;
+
+    // normal * view vector of the chunk triangles, the length of the view vector does not change the sign
+    const size_t CHUNK = 256;
+    float dots[CHUNK];
+
+    for (size_t first = from; first < to; first += CHUNK)
+    {
+        size_t count = std::min(CHUNK, to - first);
+        const math::Triangle &head = m_triangles[first];
+
+        math::BackfaceDots(&head.normal(), sizeof(math::Triangle), &head.v(0).p, sizeof(math::Triangle),
+                           count, camPosition, dots);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            math::Triangle &t = m_triangles[first + i];
+
+            if (t.clipped)
+                continue;
+
+            if (t.normal().isZero())
+                continue;
+
+            if (t.getMaterial()->sideType == rend::Material::TWO_SIDE)
+                continue;
+
+            if (dots[i] <= 0)
+            {
+                // TODO:
+                // not erase, just flag it as culled
+                t.clipped = true;
+                culled++;
+//                t = m_triangles.erase(t);
+//                continue;
+            }
+        }
+    }
+
+    return culled;
 }
 
 }
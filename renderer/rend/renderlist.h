@@ -9,6 +9,7 @@
 #define RENDERLIST_H
 
 #include "../math/poly.h"
+#include "../math/frustum.h"
 
 namespace math
 {
@@ -20,38 +21,220 @@ namespace rend
 
 class VertexBuffer;
 class SceneObject;
+class Mesh;
+struct Material;
 class Camera;
-
+class Lighting;
+
+//! Triangles of the frame.
+/*!
+  * Objects are appended in two steps: reserve() remembers the submeshes and their place in the list,
+  * then createTriangles() builds the triangles. The last one works on the triangle ranges, so
+  * the list may be filled by several threads. Other stages also have range versions.
+  *
+  * In the vertex cache mode every unique submesh vertex is transformed, projected and lit once
+  * by processVertices() into the post-transform buffer. Then assembleTriangles() culls the triangles,
+  * which reference that buffer by vertex index, and builds the visible ones for the rasterizer.
+  *
+  * With the object space back face culling the camera position is moved into the space of each object
+  * once, and the triangles are tested against the VertexBuffer face planes before they are built.
+  *
+  * Clustered submeshes are reserved by clusters: the ones outside of the frustum or with all triangles
+  * facing away are skipped, the rest form batches of the continuous triangle ranges. The vertex cache
+  * mode processes the span of the vertices of the visible clusters. Clusters of the indexed buffer
+  * share vertices, so the span is most of the buffer and only the triangle work is saved.
+  */
 class RenderList
 {
 public:
     typedef std::vector<math::Triangle> Triangles;
 
+    //! assembleTriangles() ranges must start at multiples of this.
+    static const size_t ASSEMBLY_CHUNK = 1024;
+
+    //! Triangles rejected by the culling stages.
+    struct CullStats
+    {
+        int nearPlane;
+        int frustum;
+        int backface;
+
+        CullStats() : nearPlane(0), frustum(0), backface(0) { }
+
+        CullStats &operator+= (const CullStats &other)
+        {
+            nearPlane += other.nearPlane;
+            frustum += other.frustum;
+            backface += other.backface;
+            return *this;
+        }
+    };
+
 private:
+    //! Submesh triangles [firstTriangle, firstTriangle + count), which are placed into [first, first + count)
+    //! and vertices processed into [firstVertex, firstVertex + vertexCount) of the post-transform buffer.
+    struct Batch
+    {
+        const VertexBuffer *vertexBuffer;
+        //! Material of the submesh or the one, which replaces it.
+        const Material *material;
+        //! World transformation.
+        math::M44 transform;
+        //! World, view and projection in one.
+        math::M44 clipTransform;
+        size_t first;
+        size_t count;
+        size_t firstTriangle;
+        size_t firstVertex;
+        size_t vertexCount;
+        //! Place of the submesh vertex 0 in the post-transform buffer. Batches of one submesh share it,
+        //! it may wrap around if the processed vertices do not start at the vertex 0.
+        size_t vertexBase;
+        //! Object space back face test is done for this submesh (one-sided material, invertible transformation).
+        bool cullBackfaces;
+        //! The transformation flips triangles winding.
+        bool mirrored;
+        //! Camera position in the object space.
+        math::vec3 eye;
+        //! Submesh is inside of the frustum, its triangles are not tested against the side planes.
+        bool insideFrustum;
+    };
+
+    //! Post-transform vertices of the frame, SoA layout.
+    struct TransformedVertices
+    {
+        //! World space position for back face culling and lighting.
+        std::vector<float> wx, wy, wz;
+        //! Screen space position and camera space Z.
+        std::vector<float> sx, sy, z;
+        //! Camera::ClipFlags.
+        std::vector<uint8_t> clip;
+        //! Lit color, gouraud shading only.
+        std::vector<Color3> color;
+
+        void resize(size_t size);
+    };
+
+    //! Storage of the triangles, it is never shrunk. Only the first m_size of them belong to the frame.
     Triangles m_triangles;
-    int m_lastTriangleIndex;
-
-    void createTriangles(const VertexBuffer &vertexBuffer,
-                         const math::M44 &transform);
+    size_t m_size;
+    std::vector<Batch> m_batches;
+    size_t m_lastTriangleIndex;
+
+    bool m_vertexCache;
+    bool m_objectBackfaces;
+    math::vec3 m_cameraPosition;
+    const math::Frustum *m_frustum;
+    size_t m_submeshesCulled;
+    size_t m_clustersCulled;
+    math::M44 m_viewProjection;
+    TransformedVertices m_vertices;
+    size_t m_lastVertexIndex;
+
+    //! Output of assembleTriangles() for the range starting at the chunk.
+    struct AssemblyChunk
+    {
+        size_t survivors;
+        CullStats stats;
+    };
+
+    std::vector<AssemblyChunk> m_chunks;
+    CullStats m_cullStats;
+
+    //! Calls fn(batch, begin, end) for the batches, which [first, first + count) ranges intersect [from, to).
+    //! begin and end are relative to the batch.
+    template<typename Fn>
+    void forEachBatch(size_t from, size_t to, size_t Batch::*first, size_t Batch::*count, Fn fn) const;
+
+    //! Reserves the visible clusters of the submesh.
+    void reserveClusters(const Batch &submesh, float scale);
+
+    //! Builds triangles [begin, end) of the batch (indices are relative to the batch).
+    //! Returns count of the back faces culled in the object space.
+    size_t createTriangles(const Batch &batch, size_t begin, size_t end);
+    template<typename Index>
+    size_t createIndexedTriangles(const Batch &batch, const Index *indices, size_t begin, size_t end);
+    void processVertices(const Batch &batch, const Camera &cam, const Lighting &lighting, size_t begin, size_t end);
+    //! Writes survivors to out, returns the end of the written triangles.
+    math::Triangle *assembleTriangles(const Batch &batch, const Lighting &lighting, size_t begin, size_t end,
+                                      math::Triangle *out, CullStats &stats);
+    //! Indices are uint16_t or uint32_t, null for the not indexed buffer.
+    template<typename Index>
+    math::Triangle *assembleTriangles(const Batch &batch, const Index *indices, const Lighting &lighting,
+                                      size_t begin, size_t end, math::Triangle *out, CullStats &stats);
 
 public:
     //! Default ctor.
-    RenderList() { m_lastTriangleIndex = 0; }
+    RenderList() { m_size = 0; m_lastTriangleIndex = 0; m_vertexCache = false; m_objectBackfaces = false; m_frustum = 0; m_submeshesCulled = 0; m_clustersCulled = 0; m_lastVertexIndex = 0; }
     //! Dtor.
     ~RenderList() { }
 
-    void prepare(size_t trianglesCount);
+    //! Starts the frame, the list becomes empty.
+    void prepare();
+    //! Reserves place and creates triangles of the object.
     void append(const sptr(SceneObject) obj);
 
+    //! Reserves place for the object triangles, they are built later by createTriangles().
+    /*! Submeshes of the object, which intersects the frustum, are tested one by one. */
+    void reserve(const sptr(SceneObject) obj, math::FrustumRelation relation = math::FRUSTUM_INTERSECT);
+    //! Reserves the mesh with the world transformation, an instance of the shared mesh.
+    /*! The material, if it is not null, replaces the materials of all submeshes. */
+    void reserve(const Mesh &mesh, const math::M44 &worldTransform, const Material *material,
+                 math::FrustumRelation relation);
+    //! Sets the size of the list to the reserved triangles. Call after all objects are appended.
+    void trim();
+    //! Builds reserved triangles [from, to). Also applies world transformation.
+    //! Returns count of the back faces culled in the object space, they are only flagged as clipped.
+    size_t createTriangles(size_t from, size_t to);
+
+    //! Turns on the vertex cache mode. Set before reserve().
+    void setVertexCache(bool enabled) { m_vertexCache = enabled; }
+    bool vertexCache() const { return m_vertexCache; }
+    //! Count of the reserved unique vertices (vertex cache mode).
+    size_t getVerticesCount() const { return m_lastVertexIndex; }
+    //! Camera view and projection matrix of the frame (vertex cache mode). Set before reserve().
+    void setViewProjection(const math::M44 &viewProjection) { m_viewProjection = viewProjection; }
+
+    //! Turns on the back face culling in the object space. Set before reserve().
+    void setObjectBackfaces(bool enabled) { m_objectBackfaces = enabled; }
+    bool objectBackfaces() const { return m_objectBackfaces; }
+    //! Camera position of the frame (object space back face culling). Set before reserve().
+    void setCameraPosition(const math::vec3 &position) { m_cameraPosition = position; }
+    //! View volume to test the submeshes, null turns the test off. Set before reserve().
+    void setFrustum(const math::Frustum *frustum) { m_frustum = frustum; }
+    //! Count of the submeshes, which were not reserved, because they are outside of the frustum.
+    size_t getSubmeshesCulled() const { return m_submeshesCulled; }
+    //! Count of the clusters, which were not reserved, because they are outside of the frustum or face away.
+    size_t getClustersCulled() const { return m_clustersCulled; }
+    //! Calls fn(begin, end) for the parts of the reserved triangles [from, to), which belong to the submeshes
+    //! crossing the frustum. Triangles of other submeshes do not need the frustum culling.
+    void forEachIntersecting(size_t from, size_t to, const std::function<void(size_t, size_t)> &fn) const;
+
+    //! Vertex cache mode: object -> clip -> screen transformation with one matrix per object
+    //! and gouraud lighting of vertices [from, to).
+    void processVertices(const Camera &cam, const Lighting &lighting, size_t from, size_t to);
+    //! Vertex cache mode: culls reserved triangles [from, to) (near plane, frustum, back faces),
+    //! lights the flat ones and builds only the visible ones from the processed vertices.
+    //! Survivors are packed to the beginning of the range, call compact() after all ranges.
+    void assembleTriangles(const Lighting &lighting, size_t from, size_t to);
+    //! Vertex cache mode: moves survivors of all ranges together, so the list holds
+    //! only the visible triangles (the storage is not shrunk). Also sums the culling statistics.
+    void compact();
+    //! Culling statistics of the last compact().
+    const CullStats &getCullStats() const { return m_cullStats; }
+
+    //! Storage of the triangles, may be longer than getSize().
     const Triangles &triangles() const { return m_triangles; }
     Triangles       &triangles() { return m_triangles; }
 
     void zsort();
     void removeBackfaces(const sptr(Camera) cam);
+    //! Returns count of the culled triangles.
+    size_t removeBackfaces(const sptr(Camera) cam, size_t from, size_t to);
 
-    size_t getSize() const { return m_triangles.size(); }
+    size_t getSize() const { return m_size; }
     size_t getCountOfNotClippedTriangles() const;
-    bool empty() const { return m_triangles.empty(); }
+    bool empty() const { return m_size == 0; }
 
     NONCOPYABLE(RenderList)
 };
@@ -14,46 +14,44 @@
 #include "camera.h"
 #include "mesh.h"
 #include "light.h"
+#include "renderlist.h"
 #include "sceneobject.h"
 #include "guiobject.h"
+#include "jobsystem.h"
 #include "software/softwarerenderer.h"
 
 namespace rend
 {
 
+//! Triangles count processed by one job of the frame stages.
+static const int TRIANGLES_PER_JOB = 1024;
+//! Vertices count processed by one job of the vertex cache stage.
+static const int VERTICES_PER_JOB = 2048;
+
 bool cmpSceneObjects(const sptr(SceneObject) o1, const sptr(SceneObject) o2)
 {
     return o1->getMesh()->getSubmeshes().front().getMaterial()->alpha > o2->getMesh()->getSubmeshes().front().getMaterial()->alpha;
 }
 
-size_t RenderMgr::sceneSize() const
-{
-    size_t triangles = 0;
-    for (auto obj : m_sceneObjects)
-    {
-        if (!obj)
-            continue;
-
-        auto mesh = obj->getMesh();
-        if (mesh)
-            triangles += mesh->numTriangles();
-    }
-
-    return triangles;
-}
-
-RenderMgr::RenderMgr(const sptr(Camera) cam, const sptr(Viewport) viewport, RendererMode mode)
-    : m_camera(cam),
+RenderMgr::RenderMgr(const sptr(Camera) cam, const sptr(Viewport) viewport, RendererMode mode,
+                     const RenderOptions &options, sptr(base::JobSystem) jobs)
+    : m_jobs(jobs),
+      m_camera(cam),
       m_viewport(viewport),
-      m_sceneTrianglesCount(0),
+      m_occlusionCulling(options.occlusionCulling),
       m_renderList(0)
 {
+    memset(&m_frameInfo, 0, sizeof(m_frameInfo));
+
     m_camera->setEulerAnglesRotation(0, 0, 0);
 
+    if (!m_jobs)
+        m_jobs = std::make_shared<base::JobSystem>(options.threads);
+
     switch (mode)
     {
     case RM_SOFTWARE:
-        m_renderer = std::make_shared<SoftwareRenderer>(viewport->getWidth(), viewport->getHeight());
+        m_renderer = std::make_shared<SoftwareRenderer>(viewport->getWidth(), viewport->getHeight(), options, m_jobs);
         break;
 
     case RM_OPENGL:
@@ -64,7 +62,11 @@ RenderMgr::RenderMgr(const sptr(Camera) cam, const sptr(Viewport) viewport, Rend
         throw RenderMgrException("Unknown renderer");
     }
 
+    m_renderer->setCoverageTest(options.coverageTest);
+
     m_renderList = new RenderList();
+    m_renderList->setVertexCache(options.vertexCache);
+    m_renderList->setObjectBackfaces(options.objectBackfaces);
 
     // add standard white ambient light
 //    addAmbientLight(Color3(255 * 0.3, 255 * 0.3, 255 * 0.3));
@@ -90,47 +92,156 @@ void RenderMgr::runFrame()
     // 1. Clear buffer.
     m_renderer->beginFrame(m_viewport);
 
-    // allocate mem for the render list
-    m_renderList->prepare(m_sceneTrianglesCount);
+    // camera matrices are rebuilt only when the camera or the viewport change
+    m_renderer->setWorldViewMatrix(m_camera->getWorldToCameraMatrix());
+    m_renderer->setProjectionMatrix(m_camera->getProjectionMatrix());
+
+    // storage of the render list is kept between the frames
+    m_renderList->prepare();
+    m_renderList->setViewProjection(m_camera->getViewProjectionMatrix());
+    m_renderList->setCameraPosition(m_camera->getPosition());
+    m_renderList->setFrustum(&m_camera->getFrustum());
+
+    // lights may be moved or switched between the frames
+    m_lighting.set(m_lights);
 
     // 2. Cull full meshes and form triangles render list.
-    // Also applies world transformation.
-    for (auto obj : m_sceneObjects)
+    // The tree skips the whole groups of objects outside of the frustum. Objects crossing the frustum
+    // are tested by submeshes, the inner ones skip the per-triangle frustum culling.
+    size_t moved = m_sceneTree.update();
+    m_sceneTree.cull(m_camera->getFrustum(), m_visibleObjects);
+
+    m_frameInfo.objectsCulled = (int)(m_sceneTree.size() - m_visibleObjects.size());
+
+    // occluders are drawn with their levels of detail of the frame
+    for (auto &visible : m_visibleObjects)
+        (*visible.object)->selectLod(*m_camera);
+
+    // Objects behind the occluders are removed before any of their triangles are built.
+    m_frameInfo.objectsOccluded = 0;
+    if (m_occlusionCulling)
+        m_frameInfo.objectsOccluded = m_occlusionCuller.cull(*m_camera, m_viewport->getWidth(), m_viewport->getHeight(),
+                                                             moved, m_visibleObjects);
+
+    m_frameInfo.objectsInside = 0;
+    m_frameInfo.instancesCulled = 0;
+    for (auto &visible : m_visibleObjects)
     {
-        if (!obj)
+        if (visible.relation == math::FRUSTUM_INSIDE)
+            m_frameInfo.objectsInside++;
+
+        // shared mesh is reserved once for every visible instance
+        auto instanced = dynamic_cast<InstancedSceneObject *>(visible.object->get());
+        if (!instanced)
+        {
+            m_renderList->reserve(*visible.object, visible.relation);
             continue;
+        }
 
-        if (!m_camera->culled(obj))
-            m_renderList->append(obj);
-    }
-
-    // collect debug information
-    m_frameInfo.trianglesOnFrameStart = m_renderList->getCountOfNotClippedTriangles();
-
-    // 3. Cull back faces.
-    m_renderList->removeBackfaces(m_camera);
-
-    // 4. Lighting.
-    for (auto light : m_lights)
-        light->illuminate(m_renderList);
+        instanced->cullInstances(*m_camera, visible.relation, m_visibleInstances);
+        m_frameInfo.instancesCulled += (int)(instanced->numInstances() - m_visibleInstances.size());
 
-    // 5. World -> Camera transformation. Also cull triangles with negative Z.
-    m_camera->toCamera(m_renderList);
-
-    // 6. Frustum culling.
-    m_camera->frustumCull(m_renderList);
+        for (auto &instance : m_visibleInstances)
+        {
+            m_renderList->reserve(*instanced->getInstanceMesh(instance.lod), instanced->getInstanceWorld(instance.index),
+                                  instanced->getInstance(instance.index).material.get(), instance.relation);
+        }
+    }
+    m_renderList->trim();
+    m_frameInfo.submeshesCulled = (int)m_renderList->getSubmeshesCulled();
+    m_frameInfo.clustersCulled = (int)m_renderList->getClustersCulled();
 
-    // 7. Sort triangles by painter algorithm.
-    /* m_renderList->zsort(); do not need this (using z buffer) */
+    // All the next stages work on the triangle (or vertex) ranges in parallel.
+    const int trianglesCount = (int)m_renderList->getSize();
 
-    // 8. Camera -> Perspective -> Screen transformation.
-    m_camera->toScreen(m_renderList, *m_viewport);
+    // collect debug information
+    m_frameInfo.trianglesOnFrameStart = trianglesCount;
 
-    m_frameInfo.trianglesForRaster = m_renderList->getCountOfNotClippedTriangles();
+    if (m_renderList->vertexCache())
+    {
+        const int verticesCount = (int)m_renderList->getVerticesCount();
+        m_frameInfo.verticesTransformed = verticesCount;
+
+        // 3. Object -> Clip -> Screen transformation and gouraud lighting of each unique vertex.
+        m_jobs->parallelFor(0, verticesCount, VERTICES_PER_JOB, [this](int from, int to)
+        {
+            m_renderList->processVertices(*m_camera, m_lighting, from, to);
+        });
+
+        // 4. Fused near plane, frustum and back face culling and flat lighting. Each job packs
+        // its visible triangles while the vertices are still in the cache, then they are moved together.
+        m_jobs->parallelFor(0, trianglesCount, RenderList::ASSEMBLY_CHUNK,
+                            [this](int from, int to) { m_renderList->assembleTriangles(m_lighting, from, to); });
+        m_renderList->compact();
+
+        const RenderList::CullStats &stats = m_renderList->getCullStats();
+        m_frameInfo.rejectedNearPlane = stats.nearPlane;
+        m_frameInfo.rejectedFrustum = stats.frustum;
+        m_frameInfo.rejectedBackface = stats.backface;
+
+        // only the visible triangles are left
+        m_frameInfo.trianglesForRaster = (int)m_renderList->getSize();
+    }
+    else
+    {
+        m_frameInfo.verticesTransformed = trianglesCount * 3;
+
+        std::atomic<int> nearPlane(0), frustum(0), backface(0);
+
+        // Also applies world transformation. Back faces are not built in the object space culling mode.
+        m_jobs->parallelFor(0, trianglesCount, TRIANGLES_PER_JOB, [this, &backface](int from, int to)
+        {
+            backface += (int)m_renderList->createTriangles(from, to);
+        });
+
+        // 3. Cull back faces.
+        if (!m_renderList->objectBackfaces())
+        {
+            m_jobs->parallelFor(0, trianglesCount, TRIANGLES_PER_JOB, [this, &backface](int from, int to)
+            {
+                backface += (int)m_renderList->removeBackfaces(m_camera, from, to);
+            });
+        }
+
+        // 4. Lighting. Every vertex is shaded once by all lights.
+        m_jobs->parallelFor(0, trianglesCount, TRIANGLES_PER_JOB, [this](int from, int to)
+        {
+            m_lighting.illuminate(*m_renderList, from, to);
+        });
+
+        // 5. World -> Camera transformation. Also cull triangles with negative Z.
+        m_jobs->parallelFor(0, trianglesCount, TRIANGLES_PER_JOB, [this, &nearPlane](int from, int to)
+        {
+            nearPlane += (int)m_camera->toCamera(m_renderList, from, to);
+        });
+
+        // 6. Frustum culling of the submeshes crossing the frustum.
+        m_jobs->parallelFor(0, trianglesCount, TRIANGLES_PER_JOB, [this, &frustum](int from, int to)
+        {
+            m_renderList->forEachIntersecting(from, to, [this, &frustum](size_t begin, size_t end)
+            {
+                frustum += (int)m_camera->frustumCull(m_renderList, begin, end);
+            });
+        });
+
+        // 7. Sort triangles by painter algorithm.
+        /* m_renderList->zsort(); do not need this (using z buffer) */
+
+        // 8. Camera -> Perspective -> Screen transformation.
+        m_jobs->parallelFor(0, trianglesCount, TRIANGLES_PER_JOB,
+                            [this](int from, int to) { m_camera->toScreen(m_renderList, *m_viewport, from, to); });
+
+        m_frameInfo.rejectedNearPlane = nearPlane;
+        m_frameInfo.rejectedFrustum = frustum;
+        m_frameInfo.rejectedBackface = backface;
+        m_frameInfo.trianglesForRaster = trianglesCount - nearPlane - frustum - backface;
+    }
 
     // 9. Rasterize world triangles.
     m_renderer->renderWorld(m_renderList);
 
+    m_frameInfo.duplicateWrites = m_renderer->duplicateWrites();
+
     // 10. Render post effects.
     m_renderer->renderGui(m_guiObjects);
 
@@ -196,6 +307,11 @@ void RenderMgr::resize(int w, int h)
     m_renderer->resize(w, h);
 }
 
+void RenderMgr::setCoverageTest(bool enabled)
+{
+    m_renderer->setCoverageTest(enabled);
+}
+
 void RenderMgr::addSceneObject(sptr(SceneObject) node)
 {
     if (!node)
@@ -205,7 +321,7 @@ void RenderMgr::addSceneObject(sptr(SceneObject) node)
     }
 
     m_sceneObjects.push_back(node);
-    m_sceneTrianglesCount = sceneSize();
+    m_sceneTree.insert(node);
 //    m_sceneObjects.sort();
 
     // TODO: check names
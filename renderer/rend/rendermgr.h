@@ -9,12 +9,18 @@
 #define RENDERMGR_H
 
 #include "rend/color.h"
+#include "rend/renderoptions.h"
+#include "rend/scenetree.h"
+#include "rend/occlusionculler.h"
+#include "rend/instancedsceneobject.h"
+#include "rend/lighting.h"
 #include "math/vec3.h"
 
 namespace base
 {
 
 struct FrameInfo;
+class JobSystem;
 
 }
 
@@ -45,10 +51,22 @@ struct FrameInfo
 {
     int trianglesOnFrameStart;      //
     int trianglesForRaster;
+    int verticesTransformed;        // vertices transformed to the world space
+    int objectsCulled;              // by the bounding sphere
+    int objectsInside;              // do not need the frustum culling
+    int objectsOccluded;            // hidden behind the occluders
+    int instancesCulled;            // instances of the visible objects outside of the frustum
+    int submeshesCulled;            // by the bounding box
+    int clustersCulled;             // by the bounding sphere or the normal cone
+    int rejectedNearPlane;          // triangles rejected by the culling stages
+    int rejectedFrustum;
+    int rejectedBackface;
+    int duplicateWrites;            // pixels written more than once (coverage test mode only)
 };
 
 class RenderMgr
 {
+    sptr(base::JobSystem) m_jobs;
     sptr(AbstractRenderer) m_renderer;
     sptr(Camera) m_camera;
     sptr(Viewport) m_viewport;
@@ -56,26 +74,40 @@ class RenderMgr
     std::list<sptr(SceneObject)> m_sceneObjects;
     std::list<sptr(GuiObject)> m_guiObjects;
     std::list<sptr(Light)> m_lights;
+    //! Enabled lights of the frame, packed for the lighting stages.
+    Lighting m_lighting;
 
-    size_t m_sceneTrianglesCount;
+    //! Hierarchy over the scene objects for the frustum culling.
+    SceneTree m_sceneTree;
+    std::vector<SceneTree::Visible> m_visibleObjects;
+
+    //! Removes the visible objects hidden behind the occluders, if it is enabled.
+    OcclusionCuller m_occlusionCuller;
+    bool m_occlusionCulling;
+
+    //! Instances of the visible instanced object.
+    std::vector<InstancedSceneObject::Visible> m_visibleInstances;
 
     FrameInfo m_frameInfo;
     RenderList *m_renderList;
 
-    //! Returns scene size in triangles.
-    size_t sceneSize() const;
-
 public:
-    RenderMgr(const sptr(Camera) cam, const sptr(Viewport) viewport, RendererMode mode);
+    //! Frame stages and rasterization run on the given job system, or on own one if jobs is null.
+    RenderMgr(const sptr(Camera) cam, const sptr(Viewport) viewport, RendererMode mode,
+              const RenderOptions &options = RenderOptions(),
+              sptr(base::JobSystem) jobs = sptr(base::JobSystem)());
     ~RenderMgr();
 
     void runFrame();
 
     void                addSceneObject(sptr(SceneObject) node);
     sptr(SceneObject)   getSceneObject(const std::string &name);
+    const SceneTree    &getSceneTree() const { return m_sceneTree; }
     void                addGuiObject(sptr(GuiObject) obj);
 
     const FrameInfo    &getLastFrameStats() const { return m_frameInfo; }
+    //! Job system with per-worker utilization counters.
+    sptr(base::JobSystem) getJobs() const { return m_jobs; }
 
     sptr(Light) getLight(int id) const;
 
@@ -86,6 +118,9 @@ public:
 
     void resize(int w, int h);
 
+    //! Test mode: counts pixels written twice by adjacent triangles, see FrameInfo::duplicateWrites.
+    void setCoverageTest(bool enabled);
+
     NONCOPYABLE(RenderMgr)
 };
 
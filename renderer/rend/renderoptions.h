@@ -0,0 +1,54 @@
+/*
+ * renderoptions.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef RENDEROPTIONS_H
+#define RENDEROPTIONS_H
+
+#include "texture.h"
+
+namespace rend
+{
+
+//! Renderer tuning, read from renderer.json.
+struct RenderOptions
+{
+    //! Job system threads count (frame stages, rasterization, loading). 0 means one thread per hardware core.
+    int threads;
+    //! Size of the screen tile in pixels, rounded up to the rasterizer block size.
+    int tileSize;
+    //! Transform, project and light each unique vertex once, see RenderList.
+    bool vertexCache;
+    //! Reject back faces in the object space, before the triangles are transformed, see RenderList.
+    bool objectBackfaces;
+    //! Skip the objects hidden behind the occluders, see OcclusionCuller.
+    bool occlusionCulling;
+    //! Perspective correct texture coordinates only at the ends of 8 pixel spans, affine in between,
+    //! and fully affine triangles when their depth range is small, see TexturedTriangleRasterizer.
+    bool perspectiveSpans;
+    //! The largest allowed texture coordinates error of the affine mapping, in texels.
+    float affineError;
+    //! Order of the texels of the loaded textures, see Texture::Layout.
+    Texture::Layout textureLayout;
+    //! Count the pixel writes, so pixels written twice are reported, see RenderMgr::setCoverageTest().
+    bool coverageTest;
+
+    RenderOptions()
+        : threads(0),
+          tileSize(64),
+          vertexCache(true),
+          objectBackfaces(true),
+          occlusionCulling(true),
+          perspectiveSpans(true),
+          affineError(0.5f),
+          textureLayout(Texture::TL_LINEAR),
+          coverageTest(false)
+    { }
+};
+
+}
+
+#endif // RENDEROPTIONS_H
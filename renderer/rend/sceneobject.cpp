@@ -11,27 +11,47 @@
 
 #include "mesh.h"
 #include "resourcemgr.h"
+#include "scenetree.h"
+#include "camera.h"
 #include "texture.h"
 
 namespace rend
 {
 
 SceneObject::SceneObject(sptr(Mesh) mesh)
-    : m_mesh(mesh)
+    : m_mesh(mesh),
+      m_tree(0),
+      m_treeLeaf(-1),
+      m_lod(0),
+      m_maxScreenError(1.0f),
+      m_occluder(false),
+      m_occluded(false),
+      m_occlusionTested(-1),
+      m_occlusionSeen(-1)
 {
-    m_mesh->computeBoundingSphere(m_worldTransformation);
+    m_mesh->computeBoundingSphere();
 }
 
 SceneObject::~SceneObject()
 {
 }
 
+void SceneObject::transformChanged()
+{
+    if (m_tree)
+        m_tree->markDirty(m_treeLeaf);
+}
+
 BoundingSphere SceneObject::bsphere() const
 {
-    if (!m_mesh)
+    if (!m_mesh || !m_mesh->getBoundingSphere().valid())
         return BoundingSphere();        // return invalid sphere.
 
-    return m_mesh->getBoundingSphere();
+    // world space sphere, which is big enough for any rotation and scale
+    const BoundingSphere &local = m_mesh->getBoundingSphere();
+
+    return BoundingSphere(local.center() * m_worldTransformation,
+                          local.radius() * m_worldTransformation.getM().maxScale());
 }
 
 sptr(Mesh) SceneObject::getMesh()
@@ -44,6 +64,42 @@ const sptr(Mesh) SceneObject::getMesh() const
     return m_mesh;
 }
 
+sptr(Mesh) SceneObject::getLodMesh() const
+{
+    if (m_lod == 0 || !m_mesh || m_lod > m_mesh->numLods())
+        return m_mesh;
+
+    return m_mesh->getLod(m_lod - 1);
+}
+
+size_t SceneObject::lodFor(const BoundingSphere &sphere, const Camera &camera) const
+{
+    if (!m_mesh || m_mesh->numLods() == 0 || m_maxScreenError <= 0.0f || !sphere.valid())
+        return 0;
+
+    float localRadius = m_mesh->getBoundingSphere().radius();
+
+    math::vec3 d = sphere.center() - camera.getPosition();
+    float distance = sqrt(d.dotProduct(d)) - sphere.radius();
+    if (distance <= 0.0f)
+        return 0;
+
+    // projected radius in pixels, errors are relative to the radius
+    float projected = sphere.radius() * camera.pixelsPerUnit() / distance;
+
+    size_t lod = 0;
+    while (lod < m_mesh->numLods()
+           && m_mesh->getLodError(lod) / localRadius * projected <= m_maxScreenError)
+        lod++;
+
+    return lod;
+}
+
+void SceneObject::selectLod(const Camera &camera)
+{
+    m_lod = lodFor(bsphere(), camera);
+}
+
 sptr(SceneObject) SceneObject::clone() const
 {
     sptr(Mesh) newmesh = m_mesh->clone();
@@ -51,6 +107,8 @@ sptr(SceneObject) SceneObject::clone() const
 
     newObj->m_name = m_name + "_clone";
     newObj->m_worldTransformation = m_worldTransformation;
+    newObj->m_maxScreenError = m_maxScreenError;
+    newObj->m_occluder = m_occluder;
 
     return newObj;
 }
@@ -58,32 +116,37 @@ sptr(SceneObject) SceneObject::clone() const
 void SceneObject::setPosition(const math::vec3 &pos)
 {
     Node::setPosition(pos);
+    transformChanged();
 }
 
 void SceneObject::setRotation(const math::vec3 &angles)
 {
     Node::setRotation(angles);
+    transformChanged();
 }
 
 void SceneObject::setRotation(float yaw, float pitch, float roll)
 {
     Node::setRotation(yaw, pitch, roll);
+    transformChanged();
 }
 
 void SceneObject::setScale(const math::vec3 &coeff)
 {
     Node::setScale(coeff);
-
-    // sphere changes only when we scaling the object.
-    m_mesh->computeBoundingSphere(m_worldTransformation);
+    transformChanged();
 }
 
 void SceneObject::setTransformation(const math::M44 &tr)
 {
     Node::setTransformation(tr);
+    transformChanged();
+}
 
-    // sphere changes only when we scaling the object.
-    m_mesh->computeBoundingSphere(m_worldTransformation);
+void SceneObject::resetTransformation()
+{
+    Node::resetTransformation();
+    transformChanged();
 }
 
 void SceneObject::additionalLoading(base::ResourceMgr *const rm)
@@ -109,7 +172,9 @@ void SceneObject::setMesh(sptr(Mesh) mesh)
     }
 
     m_mesh = mesh;
-    m_mesh->computeBoundingSphere(m_worldTransformation);
+    m_mesh->computeBoundingSphere();
+    m_lod = 0;
+    transformChanged();
 }
 
 }
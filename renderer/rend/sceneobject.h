@@ -18,22 +18,70 @@ namespace rend
 {
 
 class Mesh;
+class SceneTree;
+class Camera;
 
 class SceneObject : public Node, public base::Resource
 {
+    friend class SceneTree;
+    friend class OcclusionCuller;
+
     sptr(Mesh) m_mesh;
 
+    //! Tree, which holds the object, and the leaf of it.
+    SceneTree *m_tree;
+    int m_treeLeaf;
+
+    //! Level of detail of the frame, 0 is the mesh itself.
+    size_t m_lod;
+    float m_maxScreenError;
+
+    //! The object hides the others in the occlusion culling.
+    bool m_occluder;
+    //! Last occlusion test result, the frame of it and the last frame, when the object was in the frustum.
+    bool m_occluded;
+    int m_occlusionTested;
+    int m_occlusionSeen;
+
+protected:
+    //! Tells the tree, that the object is moved.
+    void transformChanged();
+
+    //! Coarsest level of detail, which error is not above the max screen error for the world sphere of the mesh.
+    size_t lodFor(const BoundingSphere &sphere, const Camera &camera) const;
+
 public:
-    SceneObject() { }
+    SceneObject() : m_tree(0), m_treeLeaf(-1), m_lod(0), m_maxScreenError(1.0f),
+                    m_occluder(false), m_occluded(false), m_occlusionTested(-1), m_occlusionSeen(-1) { }
     SceneObject(sptr(Mesh) mesh);
     ~SceneObject();
 
     void                setMesh(sptr(Mesh) mesh);
 
-    BoundingSphere      bsphere() const;
+    //! World space sphere around everything, what the object draws.
+    virtual BoundingSphere bsphere() const;
+
+    //! Max error of the level of detail on the screen in pixels, 0 turns the level of detail off.
+    void                setMaxScreenError(float pixels) { m_maxScreenError = pixels; }
+    float               getMaxScreenError() const { return m_maxScreenError; }
+
+    //! Occluders are drawn into the occlusion buffer, they should be big and closed.
+    void                setOccluder(bool occluder) { m_occluder = occluder; }
+    bool                isOccluder() const { return m_occluder; }
+
+    //! Chooses the level of detail for the frame.
+    /*!
+      * Called by RenderMgr for the objects in the frustum, before their triangles are reserved.
+      * Takes the coarsest level of the mesh, which error relative to the bounding sphere
+      * multiplied by the projected sphere radius is not above the max screen error.
+      */
+    virtual void selectLod(const Camera &camera);
 
     sptr(Mesh)          getMesh();
     const sptr(Mesh)    getMesh() const;
+    //! Mesh of the selected level of detail.
+    sptr(Mesh)          getLodMesh() const;
+    size_t              getLod() const { return m_lod; }
 
     sptr(SceneObject)   clone() const;
 
@@ -42,6 +90,7 @@ public:
     virtual void setRotation(float yaw, float pitch, float roll);
     virtual void setScale(const math::vec3 &coeff);
     virtual void setTransformation(const math::M44 &tr);
+    virtual void resetTransformation();
 
     void additionalLoading(base::ResourceMgr * const rm);
 
@@ -0,0 +1,531 @@
+/*
+ * scenetree.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "scenetree.h"
+
+#include "sceneobject.h"
+
+namespace rend
+{
+
+//! Part of the object radius added to the leaf box, so small moves do not change the tree.
+static const float BOX_MARGIN = 0.1f;
+
+static inline math::vec3 minVec(const math::vec3 &a, const math::vec3 &b)
+{
+    return math::vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static inline math::vec3 maxVec(const math::vec3 &a, const math::vec3 &b)
+{
+    return math::vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+static inline float surfaceArea(const math::vec3 &min, const math::vec3 &max)
+{
+    math::vec3 d = max - min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static inline bool contains(const math::vec3 &outerMin, const math::vec3 &outerMax,
+                            const math::vec3 &min, const math::vec3 &max)
+{
+    return outerMin.x <= min.x && outerMin.y <= min.y && outerMin.z <= min.z
+        && max.x <= outerMax.x && max.y <= outerMax.y && max.z <= outerMax.z;
+}
+
+static inline bool overlaps(const math::vec3 &aMin, const math::vec3 &aMax,
+                            const math::vec3 &bMin, const math::vec3 &bMax)
+{
+    return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z
+        && bMin.x <= aMax.x && bMin.y <= aMax.y && bMin.z <= aMax.z;
+}
+
+SceneTree::SceneTree()
+    : m_root(NULL_NODE),
+      m_freeList(NULL_NODE),
+      m_leaves(0),
+      m_nextOrder(0)
+{
+}
+
+SceneTree::~SceneTree()
+{
+    for (auto &node : m_nodes)
+    {
+        if (node.object)
+            node.object->m_tree = 0;
+    }
+}
+
+int SceneTree::allocateNode()
+{
+    int node;
+
+    if (m_freeList != NULL_NODE)
+    {
+        node = m_freeList;
+        m_freeList = m_nodes[node].parent;
+    }
+    else
+    {
+        node = (int)m_nodes.size();
+        m_nodes.push_back(TreeNode());
+    }
+
+    TreeNode &n = m_nodes[node];
+    n.parent = n.left = n.right = NULL_NODE;
+    n.height = 0;
+    n.order = 0;
+    n.dirty = false;
+
+    return node;
+}
+
+void SceneTree::freeNode(int node)
+{
+    TreeNode &n = m_nodes[node];
+    n.object.reset();
+    n.height = -1;
+    n.parent = m_freeList;
+    m_freeList = node;
+}
+
+void SceneTree::fatBox(const SceneObject &obj, math::vec3 &min, math::vec3 &max) const
+{
+    BoundingSphere sphere = obj.bsphere();
+
+    // nothing to draw, keep it in the origin of the object
+    if (!sphere.valid())
+    {
+        min = max = obj.getPosition();
+        return;
+    }
+
+    float r = sphere.radius() * (1.0f + BOX_MARGIN);
+    min = sphere.center() - math::vec3(r, r, r);
+    max = sphere.center() + math::vec3(r, r, r);
+}
+
+void SceneTree::insert(const sptr(SceneObject) obj)
+{
+    if (!obj)
+        return;
+
+    if (obj->m_tree)
+    {
+        syslog << "Object" << obj->getName() << "is already in the scene tree" << logwarn;
+        return;
+    }
+
+    int leaf = allocateNode();
+    TreeNode &n = m_nodes[leaf];
+    n.object = obj;
+    n.order = m_nextOrder++;
+    fatBox(*obj, n.min, n.max);
+
+    obj->m_tree = this;
+    obj->m_treeLeaf = leaf;
+
+    insertLeaf(leaf);
+    m_leaves++;
+}
+
+void SceneTree::remove(const sptr(SceneObject) obj)
+{
+    if (!obj || obj->m_tree != this)
+        return;
+
+    int leaf = obj->m_treeLeaf;
+
+    // forget it in the dirty list
+    if (m_nodes[leaf].dirty)
+        m_dirty.erase(std::find(m_dirty.begin(), m_dirty.end(), leaf));
+
+    removeLeaf(leaf);
+    freeNode(leaf);
+    m_leaves--;
+
+    obj->m_tree = 0;
+}
+
+void SceneTree::markDirty(int leaf)
+{
+    TreeNode &n = m_nodes[leaf];
+
+    if (!n.dirty)
+    {
+        n.dirty = true;
+        m_dirty.push_back(leaf);
+    }
+}
+
+size_t SceneTree::update()
+{
+    size_t moved = m_dirty.size();
+
+    for (int leaf : m_dirty)
+    {
+        TreeNode &n = m_nodes[leaf];
+        n.dirty = false;
+
+        math::vec3 min, max;
+        fatBox(*n.object, min, max);
+
+        // compare with the box without the margin
+        math::vec3 margin = (max - min) * (0.5f * BOX_MARGIN / (1.0f + BOX_MARGIN));
+        if (contains(n.min, n.max, min + margin, max - margin))
+            continue;
+
+        removeLeaf(leaf);
+        m_nodes[leaf].min = min;
+        m_nodes[leaf].max = max;
+        insertLeaf(leaf);
+    }
+
+    m_dirty.clear();
+
+    return moved;
+}
+
+void SceneTree::insertLeaf(int leaf)
+{
+    if (m_root == NULL_NODE)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    const math::vec3 leafMin = m_nodes[leaf].min;
+    const math::vec3 leafMax = m_nodes[leaf].max;
+
+    // find the sibling, which grows the tree surface least
+    int index = m_root;
+    while (!m_nodes[index].isLeaf())
+    {
+        const TreeNode &n = m_nodes[index];
+
+        float area = surfaceArea(n.min, n.max);
+        float combined = surfaceArea(minVec(n.min, leafMin), maxVec(n.max, leafMax));
+
+        // new parent here
+        float cost = 2.0f * combined;
+        // growth of the ancestors, when going down
+        float inheritance = 2.0f * (combined - area);
+
+        float childCost[2];
+        int children[2] = { n.left, n.right };
+        for (int c = 0; c < 2; c++)
+        {
+            const TreeNode &child = m_nodes[children[c]];
+            float childArea = surfaceArea(minVec(child.min, leafMin), maxVec(child.max, leafMax));
+
+            if (child.isLeaf())
+                childCost[c] = childArea + inheritance;
+            else
+                childCost[c] = childArea - surfaceArea(child.min, child.max) + inheritance;
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+
+        index = childCost[0] < childCost[1] ? n.left : n.right;
+    }
+
+    int sibling = index;
+    int oldParent = m_nodes[sibling].parent;
+    int newParent = allocateNode();
+
+    TreeNode &p = m_nodes[newParent];
+    p.parent = oldParent;
+    p.left = sibling;
+    p.right = leaf;
+    p.min = minVec(m_nodes[sibling].min, leafMin);
+    p.max = maxVec(m_nodes[sibling].max, leafMax);
+    p.height = m_nodes[sibling].height + 1;
+
+    if (oldParent != NULL_NODE)
+    {
+        if (m_nodes[oldParent].left == sibling)
+            m_nodes[oldParent].left = newParent;
+        else
+            m_nodes[oldParent].right = newParent;
+    }
+    else
+    {
+        m_root = newParent;
+    }
+
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    refitUp(oldParent);
+}
+
+void SceneTree::removeLeaf(int leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = NULL_NODE;
+        return;
+    }
+
+    int parent = m_nodes[leaf].parent;
+    int grandParent = m_nodes[parent].parent;
+    int sibling = m_nodes[parent].left == leaf ? m_nodes[parent].right : m_nodes[parent].left;
+
+    if (grandParent != NULL_NODE)
+    {
+        // the sibling takes place of the parent
+        if (m_nodes[grandParent].left == parent)
+            m_nodes[grandParent].left = sibling;
+        else
+            m_nodes[grandParent].right = sibling;
+
+        m_nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        refitUp(grandParent);
+    }
+    else
+    {
+        m_root = sibling;
+        m_nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+    }
+
+    m_nodes[leaf].parent = NULL_NODE;
+}
+
+void SceneTree::refitUp(int node)
+{
+    while (node != NULL_NODE)
+    {
+        node = balance(node);
+
+        TreeNode &n = m_nodes[node];
+        const TreeNode &l = m_nodes[n.left];
+        const TreeNode &r = m_nodes[n.right];
+
+        n.height = 1 + std::max(l.height, r.height);
+        n.min = minVec(l.min, r.min);
+        n.max = maxVec(l.max, r.max);
+
+        node = n.parent;
+    }
+}
+
+int SceneTree::balance(int iA)
+{
+    TreeNode &A = m_nodes[iA];
+    if (A.isLeaf() || A.height < 2)
+        return iA;
+
+    int iB = A.left;
+    int iC = A.right;
+    TreeNode &B = m_nodes[iB];
+    TreeNode &C = m_nodes[iC];
+
+    int bal = C.height - B.height;
+
+    // rotate C up
+    if (bal > 1)
+    {
+        int iF = C.left;
+        int iG = C.right;
+        TreeNode &F = m_nodes[iF];
+        TreeNode &G = m_nodes[iG];
+
+        C.left = iA;
+        C.parent = A.parent;
+        A.parent = iC;
+
+        if (C.parent != NULL_NODE)
+        {
+            if (m_nodes[C.parent].left == iA)
+                m_nodes[C.parent].left = iC;
+            else
+                m_nodes[C.parent].right = iC;
+        }
+        else
+        {
+            m_root = iC;
+        }
+
+        // the higher grandchild stays under C
+        int iKeep = F.height > G.height ? iF : iG;
+        int iMove = F.height > G.height ? iG : iF;
+        TreeNode &keep = m_nodes[iKeep];
+        TreeNode &move = m_nodes[iMove];
+
+        C.right = iKeep;
+        A.right = iMove;
+        move.parent = iA;
+
+        A.min = minVec(B.min, move.min);
+        A.max = maxVec(B.max, move.max);
+        A.height = 1 + std::max(B.height, move.height);
+
+        C.min = minVec(A.min, keep.min);
+        C.max = maxVec(A.max, keep.max);
+        C.height = 1 + std::max(A.height, keep.height);
+
+        return iC;
+    }
+
+    // rotate B up
+    if (bal < -1)
+    {
+        int iD = B.left;
+        int iE = B.right;
+        TreeNode &D = m_nodes[iD];
+        TreeNode &E = m_nodes[iE];
+
+        B.left = iA;
+        B.parent = A.parent;
+        A.parent = iB;
+
+        if (B.parent != NULL_NODE)
+        {
+            if (m_nodes[B.parent].left == iA)
+                m_nodes[B.parent].left = iB;
+            else
+                m_nodes[B.parent].right = iB;
+        }
+        else
+        {
+            m_root = iB;
+        }
+
+        int iKeep = D.height > E.height ? iD : iE;
+        int iMove = D.height > E.height ? iE : iD;
+        TreeNode &keep = m_nodes[iKeep];
+        TreeNode &move = m_nodes[iMove];
+
+        B.right = iKeep;
+        A.left = iMove;
+        move.parent = iA;
+
+        A.min = minVec(C.min, move.min);
+        A.max = maxVec(C.max, move.max);
+        A.height = 1 + std::max(C.height, move.height);
+
+        B.min = minVec(A.min, keep.min);
+        B.max = maxVec(A.max, keep.max);
+        B.height = 1 + std::max(A.height, keep.height);
+
+        return iB;
+    }
+
+    return iA;
+}
+
+void SceneTree::collect(int node, math::FrustumRelation relation, std::vector<Visible> &visible, std::vector<int> &stack) const
+{
+    size_t bottom = stack.size();
+    stack.push_back(node);
+
+    while (stack.size() > bottom)
+    {
+        const TreeNode &n = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if (n.isLeaf())
+        {
+            Visible v = { &n.object, relation, n.order };
+            visible.push_back(v);
+            continue;
+        }
+
+        stack.push_back(n.right);
+        stack.push_back(n.left);
+    }
+}
+
+void SceneTree::cull(const math::Frustum &frustum, std::vector<Visible> &visible) const
+{
+    visible.clear();
+    if (m_root == NULL_NODE)
+        return;
+
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(m_root);
+
+    while (!stack.empty())
+    {
+        int index = stack.back();
+        stack.pop_back();
+
+        const TreeNode &n = m_nodes[index];
+
+        math::FrustumRelation relation = frustum.testBox(0.5f * (n.min + n.max), 0.5f * (n.max - n.min));
+
+        if (relation == math::FRUSTUM_OUTSIDE)
+            continue;
+
+        // the whole subtree is visible
+        if (relation == math::FRUSTUM_INSIDE)
+        {
+            collect(index, math::FRUSTUM_INSIDE, visible, stack);
+            continue;
+        }
+
+        if (!n.isLeaf())
+        {
+            stack.push_back(n.right);
+            stack.push_back(n.left);
+            continue;
+        }
+
+        // the sphere is tighter than the box around it
+        BoundingSphere sphere = n.object->bsphere();
+        if (sphere.valid())
+            relation = frustum.testSphere(sphere.center(), sphere.radius());
+
+        if (relation != math::FRUSTUM_OUTSIDE)
+        {
+            Visible v = { &n.object, relation, n.order };
+            visible.push_back(v);
+        }
+    }
+
+    // keep the order, in which objects were added
+    std::sort(visible.begin(), visible.end(), [](const Visible &a, const Visible &b) { return a.order < b.order; });
+}
+
+void SceneTree::query(const math::vec3 &min, const math::vec3 &max, std::vector<sptr(SceneObject)> &result) const
+{
+    if (m_root == NULL_NODE)
+        return;
+
+    std::vector<int> stack;
+    stack.push_back(m_root);
+
+    while (!stack.empty())
+    {
+        const TreeNode &n = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if (!overlaps(n.min, n.max, min, max))
+            continue;
+
+        if (n.isLeaf())
+        {
+            result.push_back(n.object);
+            continue;
+        }
+
+        stack.push_back(n.right);
+        stack.push_back(n.left);
+    }
+}
+
+}
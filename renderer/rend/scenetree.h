@@ -0,0 +1,124 @@
+/*
+ * scenetree.h
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#ifndef SCENETREE_H
+#define SCENETREE_H
+
+#include "../math/vec3.h"
+#include "../math/frustum.h"
+
+namespace rend
+{
+
+class SceneObject;
+
+//! Bounding volume hierarchy over the scene objects.
+/*!
+  * Dynamic AABB tree: every leaf holds one object with a box around its world bounding sphere,
+  * enlarged by a margin. Inner nodes hold the union of their children. Leaves are inserted next to
+  * the sibling, which grows the tree surface least, and rotations keep the tree balanced.
+  *
+  * Node setters mark the objects dirty. update() moves an object in the tree only if it has
+  * left its enlarged box, so small moves cost nothing.
+  *
+  * Frustum culling skips the whole subtrees outside of the frustum, and takes the whole subtrees
+  * inside of it without further tests. So the cost depends on the visible set, not on the scene size.
+  *
+  * Not thread safe, objects should be moved between the frames.
+  */
+class SceneTree
+{
+public:
+    //! Object, which is not outside of the frustum.
+    struct Visible
+    {
+        const sptr(SceneObject) *object;
+        math::FrustumRelation relation;
+        //! Insertion order.
+        size_t order;
+    };
+
+private:
+    static const int NULL_NODE = -1;
+
+    struct TreeNode
+    {
+        //! Box of the leaf object or of the subtree.
+        math::vec3 min, max;
+
+        //! Parent node, or the next free node in the free list.
+        int parent;
+        int left;
+        int right;
+        //! 0 for leaves, -1 for free nodes.
+        int height;
+
+        //! Leaf data.
+        sptr(SceneObject) object;
+        size_t order;
+        bool dirty;
+
+        bool isLeaf() const { return left == NULL_NODE; }
+    };
+
+    std::vector<TreeNode> m_nodes;
+    int m_root;
+    int m_freeList;
+    size_t m_leaves;
+    size_t m_nextOrder;
+
+    //! Leaves, which objects were moved since the last update().
+    std::vector<int> m_dirty;
+
+    int allocateNode();
+    void freeNode(int node);
+
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    //! Rotates the subtree if it is not balanced, returns the new subtree root.
+    int balance(int node);
+    //! Recomputes boxes and heights from the node to the root.
+    void refitUp(int node);
+
+    //! Enlarged box around the object.
+    void fatBox(const SceneObject &obj, math::vec3 &min, math::vec3 &max) const;
+
+    //! Appends leaves of the subtree.
+    void collect(int node, math::FrustumRelation relation, std::vector<Visible> &visible, std::vector<int> &stack) const;
+
+public:
+    //! Default ctor.
+    SceneTree();
+    //! Dtor. Detaches all objects.
+    ~SceneTree();
+
+    //! Adds the object. Object can be in one tree only.
+    void insert(const sptr(SceneObject) obj);
+    //! Removes the object.
+    void remove(const sptr(SceneObject) obj);
+    //! Called by the object, when its transformation is changed.
+    void markDirty(int leaf);
+
+    //! Refits the moved objects, returns their count.
+    size_t update();
+
+    //! Objects, which bounding spheres are not outside of the frustum, in the insertion order.
+    void cull(const math::Frustum &frustum, std::vector<Visible> &visible) const;
+    //! Objects, which enlarged boxes intersect the box.
+    void query(const math::vec3 &min, const math::vec3 &max, std::vector<sptr(SceneObject)> &result) const;
+
+    //! Count of the objects.
+    size_t size() const { return m_leaves; }
+    //! Height of the tree, 0 for one object.
+    int height() const { return m_root == NULL_NODE ? 0 : m_nodes[m_root].height; }
+
+    NONCOPYABLE(SceneTree)
+};
+
+}
+
+#endif // SCENETREE_H
@@ -24,7 +24,7 @@ class FlatTriangleRasterizer : public TriangleRasterizer
 public:
     FlatTriangleRasterizer() { }
 
-    void drawTriangle(const math::Triangle &t, FrameBuffer *fb);
+    void drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip);
 };
 
 }
@@ -22,7 +22,7 @@ class GouraudTriangleRasterizer : public TriangleRasterizer
 public:
     GouraudTriangleRasterizer() { }
 
-    void drawTriangle(const math::Triangle &t, FrameBuffer *fb);
+    void drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip);
 };
 
 }
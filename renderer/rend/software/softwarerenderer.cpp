@@ -18,18 +18,28 @@
 #include "flattrianglerasterizer.h"
 #include "gouraudtrianglerasterizer.h"
 #include "texturedtrianglerasterizer.h"
+#include "jobsystem.h"
 #include "m44.h"
 
 namespace rend
 {
 
-SoftwareRenderer::SoftwareRenderer(int width, int height)
+SoftwareRenderer::SoftwareRenderer(int width, int height, const RenderOptions &options, sptr(base::JobSystem) jobs)
     : m_fb(new FrameBuffer(width, height)),
       m_wire(new WireframeTriangleRasterizer()),
       m_flat(new FlatTriangleRasterizer()),
       m_gouraud(new GouraudTriangleRasterizer()),
-      m_text(new TexturedTriangleRasterizer())
+      m_text(new TexturedTriangleRasterizer(options.perspectiveSpans, options.affineError)),
+      m_jobs(jobs),
+      m_tileSize(0),
+      m_tilesX(0),
+      m_tilesY(0)
 {
+    // tiles must be aligned to the rasterizer blocks, otherwise the picture depends on the tiling
+    const int block = TriangleRasterizer::BLOCK_SIZE;
+    m_tileSize = std::max((options.tileSize + block - 1) / block * block, block);
+
+    syslog << "Rasterizer tile size:" << m_tileSize << logmess;
 }
 
 SoftwareRenderer::~SoftwareRenderer()
@@ -46,13 +56,42 @@ SoftwareRenderer::~SoftwareRenderer()
         delete m_text;
 }
 
-void SoftwareRenderer::renderWorld(const RenderList *rendlist)
+TriangleRasterizer *SoftwareRenderer::getRasterizer(const math::Triangle &t) const
 {
+    switch(t.getMaterial()->shadeMode)
+    {
+    case Material::SM_WIRE:
+        return m_wire;
+
+    case Material::SM_PLAIN_COLOR:
+    case Material::SM_FLAT:
+        return m_flat;
+
+    case Material::SM_GOURAUD:
+        return m_gouraud;
+
+    case Material::SM_TEXTURE:
+        return m_text;
+
+    default:
+        return 0;
+    }
+}
+
+void SoftwareRenderer::binTriangles(const RenderList *rendlist)
+{
+    m_tilesX = (m_fb->width() + m_tileSize - 1) / m_tileSize;
+    m_tilesY = (m_fb->height() + m_tileSize - 1) / m_tileSize;
+
+    m_bins.resize(m_tilesX * m_tilesY);
+    for (auto &bin : m_bins)
+        bin.clear();
+
     const auto &trias = rendlist->triangles();
-    TriangleRasterizer *rasterizer = 0;
+    const auto end = trias.rend();
 
     // painter's algorithm
-    for (auto t = trias.rbegin(); t != trias.rend(); ++t)
+    for (auto t = end - rendlist->getSize(); t != end; ++t)
     {
         if (t->clipped)
             continue;
@@ -63,35 +102,58 @@ void SoftwareRenderer::renderWorld(const RenderList *rendlist)
             continue;
         }
 
-        switch(t->getMaterial()->shadeMode)
+        if (!getRasterizer(*t))
         {
-        case Material::SM_WIRE:
-            rasterizer = m_wire;
-            break;
+            syslog << "Unsupported shading mode." << logdebug;
+            continue;
+        }
 
-        case Material::SM_PLAIN_COLOR:
-        case Material::SM_FLAT:
-            rasterizer = m_flat;
-            break;
+        // conservative bounds with one pixel margin for the lines rounding,
+        // the rasterizer does exact clipping
+        float minX = std::min(t->v(0).p.x, std::min(t->v(1).p.x, t->v(2).p.x)) - 1.0f;
+        float maxX = std::max(t->v(0).p.x, std::max(t->v(1).p.x, t->v(2).p.x)) + 1.0f;
+        float minY = std::min(t->v(0).p.y, std::min(t->v(1).p.y, t->v(2).p.y)) - 1.0f;
+        float maxY = std::max(t->v(0).p.y, std::max(t->v(1).p.y, t->v(2).p.y)) + 1.0f;
 
-        case Material::SM_GOURAUD:
-            rasterizer = m_gouraud;
-            break;
+        // also rejects NaN
+        if (!(maxX >= 0.0f && maxY >= 0.0f && minX < m_fb->width() && minY < m_fb->height()))
+            continue;
 
-        case Material::SM_TEXTURE:
-            rasterizer = m_text;
-            break;
+        int tx0 = std::max((int)std::max(minX, 0.0f) / m_tileSize, 0);
+        int ty0 = std::max((int)std::max(minY, 0.0f) / m_tileSize, 0);
+        int tx1 = std::min((int)std::min(maxX, (float)m_fb->width()) / m_tileSize, m_tilesX - 1);
+        int ty1 = std::min((int)std::min(maxY, (float)m_fb->height()) / m_tileSize, m_tilesY - 1);
 
-        default:
-            syslog << "Unsupported shading mode." << logdebug;
-            break;
-        }
-
-        if (rasterizer)
-            rasterizer->drawTriangle(*t, m_fb);
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+                m_bins[ty * m_tilesX + tx].push_back(&(*t));
     }
 }
 
+void SoftwareRenderer::drawTile(int tile)
+{
+    int tx = tile % m_tilesX;
+    int ty = tile / m_tilesX;
+
+    ScreenRect clip(tx * m_tileSize, ty * m_tileSize,
+                    std::min((tx + 1) * m_tileSize, m_fb->width()),
+                    std::min((ty + 1) * m_tileSize, m_fb->height()));
+
+    for (auto t : m_bins[tile])
+        getRasterizer(*t)->drawTriangle(*t, m_fb, clip);
+}
+
+void SoftwareRenderer::renderWorld(const RenderList *rendlist)
+{
+    binTriangles(rendlist);
+
+    m_jobs->parallelFor(0, m_tilesX * m_tilesY, 1, [this](int from, int to)
+    {
+        for (int tile = from; tile < to; tile++)
+            drawTile(tile);
+    });
+}
+
 void SoftwareRenderer::renderGui(const std::list<sptr(GuiObject)> &guiObjects)
 {
     for (auto &obj : guiObjects)
@@ -123,12 +185,22 @@ void SoftwareRenderer::resize(int w, int h)
     m_fb->resize(w, h);
 }
 
-void SoftwareRenderer::setWorldViewMatrix(const math::M44 &m)
+void SoftwareRenderer::setWorldViewMatrix(const math::M44 &/*m*/)
+{
+}
+
+void SoftwareRenderer::setProjectionMatrix(const math::M44 &/*m*/)
+{
+}
+
+void SoftwareRenderer::setCoverageTest(bool enabled)
 {
+    m_fb->setCoverageTest(enabled);
 }
 
-void SoftwareRenderer::setProjectionMatrix(const math::M44 &m)
+int SoftwareRenderer::duplicateWrites() const
 {
+    return m_fb->duplicateWrites();
 }
 
 }
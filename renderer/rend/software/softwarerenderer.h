@@ -9,6 +9,22 @@
 #define SOFTWARERENDERER_H
 
 #include "abstractrenderer.h"
+#include "renderoptions.h"
+#include "m44.h"
+
+namespace math
+{
+
+class Triangle;
+
+}
+
+namespace base
+{
+
+class JobSystem;
+
+}
 
 namespace rend
 {
@@ -20,7 +36,14 @@ class WireframeTriangleRasterizer;
 class FlatTriangleRasterizer;
 class GouraudTriangleRasterizer;
 class TexturedTriangleRasterizer;
+class TriangleRasterizer;
 
+//! Sort-middle tiled renderer.
+/*!
+  * Screen space triangles are binned into square tiles, then tiles are rasterized in parallel.
+  * Every tile owns its part of the color and depth buffers and draws its triangles in the
+  * render list order, so the picture does not depend on the threads count.
+  */
 class SoftwareRenderer : public AbstractRenderer
 {
     FrameBuffer *m_fb;
@@ -31,8 +54,21 @@ class SoftwareRenderer : public AbstractRenderer
     GouraudTriangleRasterizer       *m_gouraud;
     TexturedTriangleRasterizer      *m_text;
 
+    sptr(base::JobSystem) m_jobs;
+
+    //! Tile size in pixels, multiple of the rasterizer block size.
+    int m_tileSize;
+    int m_tilesX, m_tilesY;
+    //! Triangles overlapping each tile, in the drawing order.
+    std::vector<std::vector<const math::Triangle *> > m_bins;
+
+    TriangleRasterizer *getRasterizer(const math::Triangle &t) const;
+
+    void binTriangles(const RenderList *rendlist);
+    void drawTile(int tile);
+
 public:
-    SoftwareRenderer(int width, int height);
+    SoftwareRenderer(int width, int height, const RenderOptions &options, sptr(base::JobSystem) jobs);
     ~SoftwareRenderer();
 
     virtual void renderWorld(const RenderList *rendlist);
@@ -43,8 +79,12 @@ public:
 
     virtual void resize(int w, int h);
 
+    //! No-ops: RenderList transforms the triangles to the screen space before they get here.
     virtual void setWorldViewMatrix(const math::M44 &m);
     virtual void setProjectionMatrix(const math::M44 &m);
+
+    virtual void setCoverageTest(bool enabled);
+    virtual int duplicateWrites() const;
 };
 
 }
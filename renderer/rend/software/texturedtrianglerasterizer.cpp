@@ -15,204 +15,272 @@
 #include "vec3.h"
 #include "color.h"
 #include "texture.h"
+#include "material.h"
 
 #define BILINEAR_FILTERING 1
 
 namespace rend
 {
 
-union Interpolant
+//! Cheap log2, exact for powers of two and linear in between.
+inline float fastLog2(float x)
 {
-    __declspec(align(16)) struct { float du, dv, dx, dz; };
-    __declspec(align(16)) __m128 v;
+    union { float f; int32_t i; } bits;
+    bits.f = x;
 
-    Interpolant() : v() { _mm_set_ps1(0.f); }
-};
-
-inline Color3 bilerpFilter(const Texture *texture, float u, float v)
-{
-    u *= texture->width() - 1.f;
-    v *= texture->height() - 1.f;
-
-    int ui = (int)floor(u);
-    int vi = (int)floor(v);
-    float du = u - ui;
-    float dv = v - vi;
+    float exponent = (float)(((bits.i >> 23) & 0xFF) - 127);
+    bits.i = (bits.i & 0x007FFFFF) | 0x3F800000;       // mantissa in [1, 2)
 
-    Color3 p0 = texture->at(ui, vi) * (1.f - du) * (1.f - dv);
-    Color3 p1 = texture->at(ui + 1, vi) * du * (1.f - dv);
-    Color3 p2 = texture->at(ui, vi + 1) * (1.f - du) * dv;
-    Color3 p3 = texture->at(ui + 1, vi + 1) * du * dv;
-
-    return p0 + p1 + p2 + p3;
+    return exponent + bits.f - 1.0f;
 }
 
-void TexturedTriangleRasterizer::drawTriangle(const math::Triangle &t, FrameBuffer *fb)
+inline void sampleLevel(const Texture *texture, const float *u, const float *v, int count, uint32_t *colors)
 {
-    math::vertex v0 = t.v(0);
-    math::vertex v1 = t.v(1);
-    math::vertex v2 = t.v(2);
-
-    static Color3 textel;
-
-    // if triangle isn't on a screen
-    /*if (v2.p.y < fb->yorig() || v0.p.y > fb->height() ||
-       (v0.p.x < fb->xorig() && v1.p.x < fb->xorig() && v2.p.x < fb->xorig()) ||
-       (v0.p.x > fb->width() && v1.p.x > fb->width() && v2.p.x > fb->width()))
-        return;*/
-
-    if (!t.getMaterial()->texture)
-        return;
+#if BILINEAR_FILTERING
+    texture->sampleBilinear(u, v, count, colors);
+#else
+    for (int i = 0; i < count; i++)
+    {
+        int ww = u[i] * float(texture->width() - 1);
+        int hh = v[i] * float(texture->height() - 1);
 
-    auto material = t.getMaterial();
-    Texture *texture = material->texture.get();
-    int alpha = material->alpha;
-    int texWidth = texture->width();
-    int texHeight = texture->height();
+        colors[i] = texture->texel(ww, hh);
+    }
+#endif
+}
 
-    // CW order
-    if (v1.p.y < v0.p.y)
-        std::swap(v1, v0);
-    if (v2.p.y < v0.p.y)
-        std::swap(v0, v2);
-    if (v1.p.y < v2.p.y)
-        std::swap(v1, v2);
+//! Perspective correct texture mapping, modulated by the lighting color.
+/*!
+  * Rows of the block are sampled at once by Texture::sampleBilinear. Mip level is chosen per row
+  * from the exact screen derivatives of u and v in its first pixel, which follow from the u/z, v/z
+  * and 1/z planes: du/dx = (d(u/z)/dx - u * d(1/z)/dx) * z.
+  *
+  * Affine interpolation between the points with depths z0 < z1 is off by up to
+  * (sqrt(r) - 1) / (sqrt(r) + 1), r = z1 / z0, of the texture coordinates difference between them.
+  * The triangle or the row is mapped affinely only when this error is below maxError texels.
+  */
+struct TextureShader
+{
+    static const int MAX_PIXELS = TriangleRasterizer::BLOCK_SIZE;
+
+    const Texture *texture;
+    Material::MipFilter mipFilter;
+    // flat shading: every vertex has the same color; 16 bit b g r a of two pixels
+    __m128i light;
+    // uv/z planes
+    Gradient u, v;
+    // 1/z steps
+    float dwdx, dwdy;
+    // base level size in texels
+    float width, height;
+    // u and v planes are linear in the screen space
+    bool affine;
+    // rows are divided by z only at the ends
+    bool spans;
+    float maxError;
+
+    TextureShader(const TriangleSetup &s, const Texture *tex, Material::MipFilter filter,
+                  bool perspectiveSpans, float affineError)
+        : texture(tex),
+          mipFilter(tex->levels() > 1 ? filter : Material::MF_NONE),
+          dwdx(s.invz.dadx),
+          dwdy(s.invz.dady),
+          width(tex->width() - 1.f),
+          height(tex->height() - 1.f),
+          affine(false),
+          spans(perspectiveSpans),
+          maxError(affineError)
+    {
+        const math::vertex &v0 = *s.v[0];
+        const math::vertex &v1 = *s.v[1];
+        const math::vertex &v2 = *s.v[2];
 
-    Interpolant leftInt;
-    Interpolant rightInt;
+        const Color3 &c = v0.color;
+        light = _mm_setr_epi16((short)c[BLUE], (short)c[GREEN], (short)c[RED], 0,
+                               (short)c[BLUE], (short)c[GREEN], (short)c[RED], 0);
 
-    // Interpolating 1/z values.
-    leftInt.dx = v2.p.x - v0.p.x;
-    leftInt.du = v2.t.x / v2.p.z - v0.t.x / v0.p.z;
-    leftInt.dv = v2.t.y / v2.p.z - v0.t.y / v0.p.z;
-    leftInt.dz = 1.0f / v2.p.z - 1.0f / v0.p.z;
+        if (spans)
+        {
+            float zmin = std::min(std::min(v0.p.z, v1.p.z), v2.p.z);
+            float zmax = std::max(std::max(v0.p.z, v1.p.z), v2.p.z);
 
-    rightInt.dx = v1.p.x - v0.p.x;
-    rightInt.du = v1.t.x / v1.p.z - v0.t.x / v0.p.z;
-    rightInt.dv = v1.t.y / v1.p.z - v0.t.y / v0.p.z;
-    rightInt.dz = 1.0f / v1.p.z - 1.0f / v0.p.z;
+            float extentU = std::max(std::max(v0.t.x, v1.t.x), v2.t.x) - std::min(std::min(v0.t.x, v1.t.x), v2.t.x);
+            float extentV = std::max(std::max(v0.t.y, v1.t.y), v2.t.y) - std::min(std::min(v0.t.y, v1.t.y), v2.t.y);
 
-    float dy1 = v2.p.y - v0.p.y;
-    float dy2 = v1.p.y - v0.p.y;
+            affine = zmin > 0.0f && affineMappingError(zmax / zmin, extentU, extentV) <= maxError;
+        }
 
-    leftInt.v = _mm_div_ps(leftInt.v, _mm_set_ps1(dy1));
-    rightInt.v = _mm_div_ps(rightInt.v, _mm_set_ps1(dy2));
+        if (affine)
+        {
+            u = s.gradient(v0.t.x, v1.t.x, v2.t.x);
+            v = s.gradient(v0.t.y, v1.t.y, v2.t.y);
+            dwdx = dwdy = 0.0f;
+            return;
+        }
 
-    Interpolant leftIntC;
-    Interpolant rightIntC;
+        u = s.gradient(v0.t.x / v0.p.z, v1.t.x / v1.p.z, v2.t.x / v2.p.z);
+        v = s.gradient(v0.t.y / v0.p.z, v1.t.y / v1.p.z, v2.t.y / v2.p.z);
+    }
 
-    if (leftInt.dx < rightInt.dx)
+    //! Error in texels of the affine mapping between depths with ratio r >= 1 and the given uv difference.
+    float affineMappingError(float r, float du, float dv) const
     {
-        leftIntC = leftInt;
-        rightIntC = rightInt;
+        return TexturedTriangleRasterizer::affineMappingError(r) * std::max(fabsf(du) * width, fabsf(dv) * height);
     }
-    else
+
+    //! Log2 of the texel footprint of the pixel, negative when the texture is magnified.
+    float lod(float tu, float tv, float z) const
     {
-        leftIntC = rightInt;
-        rightIntC = leftInt;
-    }
+        float dudx = (u.dadx - tu * dwdx) * z * width;
+        float dvdx = (v.dadx - tv * dwdx) * z * height;
+        float dudy = (u.dady - tu * dwdy) * z * width;
+        float dvdy = (v.dady - tv * dwdy) * z * height;
 
-    Interpolant start, end;
-    start.dx = v0.p.x; start.du = v0.t.x / v0.p.z; start.dv = v0.t.y / v0.p.z; start.dz = 1.0f / v0.p.z;
-    end = start;
+        float rho2 = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+        if (rho2 <= 1.0f)
+            return 0.0f;
 
-    Interpolant p, pdelta;
+        return 0.5f * fastLog2(rho2);
+    }
 
-    int x, y;
-    for (y = (int)v0.p.y; y < (int)v2.p.y; y++)
+    //! a + (b - a) * t / 256 for every channel of the packed colors.
+    static uint32_t lerp(uint32_t a, uint32_t b, uint32_t t)
     {
-        pdelta.v = _mm_sub_ps(end.v, start.v);
-        pdelta.dx = 0;
+        uint32_t rb = (((a & 0x00FF00FF) * (256 - t) + (b & 0x00FF00FF) * t) >> 8) & 0x00FF00FF;
+        uint32_t ag = (((a >> 8) & 0x00FF00FF) * (256 - t) + ((b >> 8) & 0x00FF00FF) * t) & 0xFF00FF00;
 
-        pdelta.v = _mm_div_ps(pdelta.v, _mm_set_ps1(end.dx - start.dx));
+        return rb | ag;
+    }
 
-        p = start;
+    //! Divides by z only the first and the last pixels of the row, when the error allows it.
+    bool perspectiveSpan(float x, float y, const float *invz, int first, int last, float *tu, float *tv) const
+    {
+        if (!spans || last == first)
+            return false;
 
-        for (x = (int)start.dx; x < (int)end.dx; x++)
-        {
-            float u = p.du / 1.0f / p.dz;
-            float v = p.dv / 1.0f / p.dz;
+        float z0 = 1.0f / invz[first];
+        float z1 = 1.0f / invz[last];
+        float u0 = u.at(x + first, y) * z0, v0 = v.at(x + first, y) * z0;
+        float u1 = u.at(x + last, y) * z1, v1 = v.at(x + last, y) * z1;
 
-#if BILINEAR_FILTERING
-            textel = bilerpFilter(texture, u, v);
-#else
-            int ww = u * float(texWidth - 1);
-            int hh = v * float(texHeight - 1);
+        float r = z0 > z1 ? z0 / z1 : z1 / z0;
+        if (!(affineMappingError(r, u1 - u0, v1 - v0) <= maxError))
+            return false;
 
-            textel = texture->at(ww, hh);
-#endif
-            // modulate by rgb of first vertex (flat shading)
-            textel = textel * v0.color;
-            textel *= (1.0 / 256.0);        // no /= operator in Color3
+        float du = (u1 - u0) / (last - first);
+        float dv = (v1 - v0) / (last - first);
 
-            fb->wpixel(x, y, textel, p.dz, alpha);
-
-            p.v = _mm_add_ps(p.v, pdelta.v);
-            p.dx = 0;
+        for (int i = 0; i <= last; i++)
+        {
+            tu[i] = u0 + du * (i - first);
+            tv[i] = v0 + dv * (i - first);
         }
 
-        start.v = _mm_add_ps(start.v, leftIntC.v);
-        end.v = _mm_add_ps(end.v, rightIntC.v);
+        return true;
     }
 
-    // Now for the bottom of the triangle
-    if (leftInt.dx < rightInt.dx)
+    void shadeRow(float x, float y, const float *invz, int mask, uint32_t *colors) const
     {
-        leftIntC.dx = v1.p.x - v2.p.x;
-        leftIntC.du = v1.t.x / v1.p.z - v2.t.x / v2.p.z;
-        leftIntC.dv = v1.t.y / v1.p.z - v2.t.y / v2.p.z;
-        leftIntC.dz = 1.0f / v1.p.z - 1.0f / v2.p.z;
+        float tu[MAX_PIXELS], tv[MAX_PIXELS];
+        int count = 0, first = -1;
 
-        leftIntC.v = _mm_div_ps(leftIntC.v, _mm_set_ps1(v1.p.y - v2.p.y));
-
-        start.dx = v2.p.x; start.du = v2.t.x / v2.p.z; start.dv = v2.t.y / v2.p.z; start.dz = 1.0f / v2.p.z;
-    }
-    else
-    {
-        rightIntC.dx = v1.p.x - v2.p.x;
-        rightIntC.du = v1.t.x / v1.p.z - v2.t.x / v2.p.z;
-        rightIntC.dv = v1.t.y / v1.p.z - v2.t.y / v2.p.z;
-        rightIntC.dz = 1.0f / v1.p.z - 1.0f / v2.p.z;
+        for (int i = 0; mask >> i; i++)
+        {
+            if (!(mask & (1 << i)))
+                continue;
 
-        rightIntC.v = _mm_div_ps(rightIntC.v, _mm_set_ps1(v1.p.y - v2.p.y));
+            if (first < 0)
+                first = i;
+            count = i + 1;
+        }
 
-        end.dx = v2.p.x; end.du = v2.t.x / v2.p.z; end.dv = v2.t.y / v2.p.z; end.dz = 1.0f / v2.p.z;
-    }
+        int last = count - 1;
+        float z = 1.0f;
 
-    for (y = (int)v2.p.y; y< (int)v1.p.y; y++)
-    {
-        pdelta.v = _mm_sub_ps(end.v, start.v);
-        pdelta.dx = 0;
+        if (affine)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                tu[i] = u.at(x + i, y);
+                tv[i] = v.at(x + i, y);
+            }
+        }
+        else if (!perspectiveSpan(x, y, invz, first, last, tu, tv))
+        {
+            // masked pixels are sampled too, but with the valid coordinates
+            for (int i = 0; i < count; i++)
+            {
+                if (!(mask & (1 << i)))
+                {
+                    tu[i] = tv[i] = 0.0f;
+                    continue;
+                }
+
+                float pz = 1.0f / invz[i];
+                tu[i] = u.at(x + i, y) * pz;
+                tv[i] = v.at(x + i, y) * pz;
+            }
+        }
 
-        pdelta.v = _mm_div_ps(pdelta.v, _mm_set_ps1(end.dx - start.dx));
+        if (!affine)
+            z = 1.0f / invz[first];
 
-        p = start;
-        for (x = (int)start.dx; x < (int)end.dx; x++)
+        switch (mipFilter)
+        {
+        case Material::MF_NEAREST:
         {
-            float u = p.du / 1.0f / p.dz;
-            float v = p.dv / 1.0f / p.dz;
+            int level = (int)(lod(tu[first], tv[first], z) + 0.5f);
+            sampleLevel(texture->level(level), tu, tv, count, colors);
+            break;
+        }
 
-#if BILINEAR_FILTERING
-            textel = bilerpFilter(texture, u, v);
-#else
-            int ww = u * float(texWidth - 1);
-            int hh = v * float(texHeight - 1);
+        case Material::MF_TRILINEAR:
+        {
+            float l = lod(tu[first], tv[first], z);
+            int level = (int)l;
+            uint32_t t = (uint32_t)((l - level) * 256.0f);
+
+            sampleLevel(texture->level(level), tu, tv, count, colors);
+            if (t > 0 && level + 1 < texture->levels())
+            {
+                uint32_t next[MAX_PIXELS];
+                sampleLevel(texture->level(level + 1), tu, tv, count, next);
+
+                for (int i = 0; i < count; i++)
+                    colors[i] = lerp(colors[i], next[i], t);
+            }
+            break;
+        }
 
-            textel = texture->at(ww, hh);
-#endif
-            // modulate by rgb of first vertex (flat shading)
-            textel = textel * v0.color;
-            textel *= (1.0 / 256.0);        // no /= operator in Color3
+        default:
+            sampleLevel(texture, tu, tv, count, colors);
+            break;
+        }
 
-            fb->wpixel(x, y, textel, p.dz, alpha);
+        // modulate by rgb of first vertex (flat shading), two pixels at a time
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < count; i += 2)
+        {
+            __m128i texels = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(colors + i));
+            __m128i modulated = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(texels, zero), light), 8);
 
-            p.v = _mm_add_ps(p.v, pdelta.v);
-            p.dx = 0;
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(colors + i), _mm_packus_epi16(modulated, zero));
         }
-
-        start.v = _mm_add_ps(start.v, leftIntC.v);
-        end.v = _mm_add_ps(end.v, rightIntC.v);
     }
+};
+
+void TexturedTriangleRasterizer::drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip)
+{
+    const Material *material = t.getMaterial();
+    if (!material->texture)
+        return;
+
+    TriangleSetup s;
+    if (!setup(t, clip, s))
+        return;
+
+    TextureShader shader(s, material->texture.get(), material->mipFilter, m_perspectiveSpans, m_affineError);
+    rasterize(s, fb, shader, material->alpha);
 }
 
 }
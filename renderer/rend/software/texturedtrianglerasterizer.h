@@ -13,16 +13,34 @@
 namespace rend
 {
 
-//! Draws textured triangle (without perspective correctness).
+//! Draws perspective correct textured triangle.
 /**
-  *
+  * With perspective spans the texture coordinates are divided by z only at the ends of every
+  * row of the rasterizer block and interpolated linearly in between. Triangles, which depth range
+  * is small enough, are mapped affinely without any divides. Either happens only while the error
+  * of the affine mapping stays below the given number of texels.
   */
 class TexturedTriangleRasterizer : public TriangleRasterizer
 {
+    bool m_perspectiveSpans;
+    float m_affineError;
+
 public:
-    TexturedTriangleRasterizer() { }
+    TexturedTriangleRasterizer(bool perspectiveSpans = false, float affineError = 0.5f)
+        : m_perspectiveSpans(perspectiveSpans),
+          m_affineError(affineError)
+    { }
+
+    void drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip);
+
+    //! Largest error of the affine mapping between depths with ratio r >= 1, as a part of the
+    //! texture coordinates difference between them.
+    static float affineMappingError(float r)
+    {
+        float sr = sqrtf(r);
 
-    void drawTriangle(const math::Triangle &t, FrameBuffer *fb);
+        return (sr - 1.0f) / (sr + 1.0f);
+    }
 };
 
 }
@@ -9,11 +9,22 @@
 
 #include "trianglerasterizer.h"
 
+#include "poly.h"
 #include "vertex.h"
 
 namespace rend
 {
 
+Gradient TriangleSetup::gradient(float a0, float a1, float a2) const
+{
+    Gradient g;
+    g.dadx = ((a1 - a0) * (y[2] - y[0]) - (a2 - a0) * (y[1] - y[0])) * invArea;
+    g.dady = ((a2 - a0) * (x[1] - x[0]) - (a1 - a0) * (x[2] - x[0])) * invArea;
+    g.a0 = a0 - g.dadx * x[0] - g.dady * y[0];
+
+    return g;
+}
+
 void TriangleRasterizer::makeCCWTriangle(math::vertex &p1, math::vertex &p2, math::vertex &p3)
 {
     // sort vertices (CCW order: p1 (top), p2, p3 (bottom))
@@ -27,5 +38,85 @@ void TriangleRasterizer::makeCCWTriangle(math::vertex &p1, math::vertex &p2, mat
         std::swap(p2, p3);
 }
 
+bool TriangleRasterizer::setup(const math::Triangle &t, const ScreenRect &clip, TriangleSetup &s) const
+{
+    s.v[0] = &t.v(0);
+    s.v[1] = &t.v(1);
+    s.v[2] = &t.v(2);
+
+    // snap to 28.4 fixed point
+    int X[3], Y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const math::vec3 &p = s.v[i]->p;
+
+        // also rejects NaN coordinates
+        if (!(fabs(p.x) < TriangleSetup::GUARD_BAND && fabs(p.y) < TriangleSetup::GUARD_BAND))
+            return false;
+
+        X[i] = (int)floor(p.x * TriangleSetup::SUBPIXEL_ONE + 0.5f);
+        Y[i] = (int)floor(p.y * TriangleSetup::SUBPIXEL_ONE + 0.5f);
+    }
+
+    int64_t area = (int64_t)(X[1] - X[0]) * (Y[2] - Y[0]) - (int64_t)(X[2] - X[0]) * (Y[1] - Y[0]);
+
+    // degenerate after snapping
+    if (area == 0)
+        return false;
+
+    // make edge functions positive inside
+    if (area < 0)
+    {
+        std::swap(s.v[1], s.v[2]);
+        std::swap(X[1], X[2]);
+        std::swap(Y[1], Y[2]);
+        area = -area;
+    }
+
+    s.wide = false;
+
+    for (int e = 0; e < 3; e++)
+    {
+        int a = e, b = (e + 1) % 3;
+
+        s.A[e] = Y[a] - Y[b];
+        s.B[e] = X[b] - X[a];
+        s.C[e] = -((int64_t)s.A[e] * X[a] + (int64_t)s.B[e] * Y[a]);
+
+        // top-left fill rule: pixel centers exactly on the edge are owned by the top and left edges only
+        bool topLeft = s.A[e] > 0 || (s.A[e] == 0 && s.B[e] > 0);
+        if (!topLeft)
+            s.C[e] -= 1;
+
+        if (abs(s.A[e]) >= TriangleSetup::FAST_EDGE_LIMIT || abs(s.B[e]) >= TriangleSetup::FAST_EDGE_LIMIT)
+            s.wide = true;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        s.x[i] = (float)X[i] / TriangleSetup::SUBPIXEL_ONE;
+        s.y[i] = (float)Y[i] / TriangleSetup::SUBPIXEL_ONE;
+    }
+
+    // area is in 1/256 pixel units
+    s.invArea = (float)(TriangleSetup::SUBPIXEL_ONE * TriangleSetup::SUBPIXEL_ONE) / (float)area;
+
+    // pixel px is in the box if its center px * 16 + 8 lies between min and max coordinates
+    const int half = TriangleSetup::SUBPIXEL_ONE / 2;
+    int minX = std::min(X[0], std::min(X[1], X[2])), maxX = std::max(X[0], std::max(X[1], X[2]));
+    int minY = std::min(Y[0], std::min(Y[1], Y[2])), maxY = std::max(Y[0], std::max(Y[1], Y[2]));
+
+    s.minX = std::max((minX - half + TriangleSetup::SUBPIXEL_ONE - 1) >> TriangleSetup::SUBPIXEL_BITS, clip.x0);
+    s.minY = std::max((minY - half + TriangleSetup::SUBPIXEL_ONE - 1) >> TriangleSetup::SUBPIXEL_BITS, clip.y0);
+    s.maxX = std::min(((maxX - half) >> TriangleSetup::SUBPIXEL_BITS) + 1, clip.x1);
+    s.maxY = std::min(((maxY - half) >> TriangleSetup::SUBPIXEL_BITS) + 1, clip.y1);
+
+    if (s.minX >= s.maxX || s.minY >= s.maxY)
+        return false;
+
+    s.invz = s.gradient(1.0f / s.v[0]->p.z, 1.0f / s.v[1]->p.z, 1.0f / s.v[2]->p.z);
+
+    return true;
 }
 
+}
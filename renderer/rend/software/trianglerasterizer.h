@@ -8,6 +8,8 @@
 #ifndef TRIANGLERASTERIZER_H
 #define TRIANGLERASTERIZER_H
 
+#include "framebuffer.h"
+
 namespace math
 {
 
@@ -21,23 +23,282 @@ namespace rend
 
 class FrameBuffer;
 
+//! Screen area the rasterizer is allowed to touch: [x0, x1) x [y0, y1).
+struct ScreenRect
+{
+    int x0, y0, x1, y1;
+
+    ScreenRect(int X0 = 0, int Y0 = 0, int X1 = 0, int Y1 = 0) : x0(X0), y0(Y0), x1(X1), y1(Y1) { }
+};
+
+//! Plane equation of the screen space attribute: a(x, y) = a0 + dadx * x + dady * y.
+struct Gradient
+{
+    float a0, dadx, dady;
+
+    float at(float x, float y) const { return a0 + dadx * x + dady * y; }
+};
+
+//! Triangle prepared for the half-space traversal.
+/*!
+  * Vertices are snapped to 28.4 fixed point (1/16 pixel) and edge functions are evaluated
+  * exactly in integers at the pixel centers. Pixels lying exactly on the edge belong to the
+  * triangle only when the edge is a top or a left one, so every pixel on an edge shared by
+  * two triangles is written once.
+  */
+struct TriangleSetup
+{
+    //! Sub-pixel precision bits.
+    static const int SUBPIXEL_BITS = 4;
+    static const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+    //! Vertices must be inside of [-GUARD_BAND; GUARD_BAND] pixels, so 28.4 coordinates fit 32 bits.
+    static const int GUARD_BAND = 1 << 25;
+    //! Edges with |A|, |B| below this limit are stepped in 32 bits inside of the block.
+    static const int FAST_EDGE_LIMIT = 1 << 21;
+
+    //! Edge functions E(X, Y) = A * X + B * Y + C of 28.4 coordinates. Non-negative inside of the triangle.
+    /*! C already includes the top-left fill rule bias. */
+    int A[3], B[3];
+    int64_t C[3];
+    //! Vertices in counter-clockwise (screen space) order.
+    const math::vertex *v[3];
+    //! Snapped vertex positions in pixels.
+    float x[3], y[3];
+    //! 1 / (doubled triangle area).
+    float invArea;
+    //! Pixels bounding box, clipped to the screen rect: [minX, maxX) x [minY, maxY).
+    int minX, minY, maxX, maxY;
+    //! Interpolated 1/z.
+    Gradient invz;
+    //! Some edge is too long for 32-bit stepping, pixels are tested with 64-bit math.
+    bool wide;
+
+    //! Edge function in the center of pixel (px, py).
+    int64_t edge(int e, int px, int py) const
+    {
+        return (int64_t)A[e] * (px * SUBPIXEL_ONE + SUBPIXEL_ONE / 2) +
+               (int64_t)B[e] * (py * SUBPIXEL_ONE + SUBPIXEL_ONE / 2) + C[e];
+    }
+
+    //! Builds plane equation of the attribute with values a0, a1, a2 in v[0], v[1], v[2].
+    Gradient gradient(float a0, float a1, float a2) const;
+};
+
+//! Base of the shaders of one pixel at a time.
+/*!
+  * Derived is a functor with signature Color3 (float x, float y, float invz), which is called
+  * for the pixel center.
+  */
+template<typename Derived>
+struct PixelShader
+{
+    void shadeRow(float x, float y, const float *invz, int mask, uint32_t *colors) const
+    {
+        const Derived &shader = static_cast<const Derived &>(*this);
+
+        for (int i = 0; mask >> i; i++)
+        {
+            if (!(mask & (1 << i)))
+                continue;
+
+            Color3 color = shader(x + i, y, invz[i]);
+            colors[i] = RgbToInt(color[RED] & 0xFF, color[GREEN] & 0xFF, color[BLUE] & 0xFF);
+        }
+    }
+};
+
 //! Abstract triangle rasterizer.
 /**
   * There are maybe flat, gouraud, wireframe, textured triangle rasterizers and the list goes on.
+  * Solid rasterizers share the half-space traversal: triangle's bounding box is walked by 8x8 blocks,
+  * blocks outside of any edge are rejected, edges which contain the whole block are not tested,
+  * and pixels are tested 4 at a time with SSE.
   */
 class TriangleRasterizer
 {
 protected:
     void makeCCWTriangle(math::vertex &p1, math::vertex &p2, math::vertex &p3);
 
+    //! Computes edge functions, bounding box and 1/z plane. Returns false if there is nothing to draw.
+    bool setup(const math::Triangle &t, const ScreenRect &clip, TriangleSetup &s) const;
+
+    //! Walks the triangle and writes shaded pixels into the framebuffer.
+    /*!
+      * Shader has the method shadeRow(float x, float y, const float *invz, int mask, uint32_t *colors),
+      * which is called once for every row of the block. The pixels x + i with bit i in the mask
+      * passed edge and depth tests, x and y are the center of the first pixel. Shaders of one pixel
+      * at a time derive from PixelShader.
+      */
+    template<typename Shader>
+    void rasterize(const TriangleSetup &s, FrameBuffer *fb, const Shader &shader, int alpha) const;
+
 public:
+    //! Traversal block size. Must be a multiple of 4.
+    /*!
+      * Blocks are aligned to the screen grid, so when the clip rect is aligned to the block
+      * size, the pixels get exactly the same values as without clipping.
+      */
+    static const int BLOCK_SIZE = 8;
+
     TriangleRasterizer() { }
     virtual ~TriangleRasterizer() { }
 
-    //! Draws given triangle into framebuffer.
-    virtual void drawTriangle(const math::Triangle &t, FrameBuffer *fb) = 0;
+    //! Draws part of the given triangle which lies inside of the clip rect into framebuffer.
+    /*!
+      * Calls for the different clip rects may go in parallel, so implementations must not
+      * keep any state between the calls.
+      */
+    virtual void drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip) = 0;
 };
 
+template<typename Shader>
+void TriangleRasterizer::rasterize(const TriangleSetup &s, FrameBuffer *fb, const Shader &shader, int alpha) const
+{
+    const int width = fb->width();
+    float *zbuffer = fb->zbuffer();
+    uint8_t *coverage = fb->coverage();
+
+    const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+
+    // edge steps between pixels
+    int64_t stepX[3], stepY[3];
+    for (int e = 0; e < 3; e++)
+    {
+        stepX[e] = (int64_t)s.A[e] * TriangleSetup::SUBPIXEL_ONE;
+        stepY[e] = (int64_t)s.B[e] * TriangleSetup::SUBPIXEL_ONE;
+    }
+    const __m128 dzdx = _mm_set1_ps(s.invz.dadx);
+    const __m128 dzdx4 = _mm_set1_ps(s.invz.dadx * 4.0f);
+
+    for (int by = s.minY & ~(BLOCK_SIZE - 1); by < s.maxY; by += BLOCK_SIZE)
+    {
+        for (int bx = s.minX & ~(BLOCK_SIZE - 1); bx < s.maxX; bx += BLOCK_SIZE)
+        {
+            // test block corners (pixel centers) against each edge
+            bool rejected = false;
+            bool partial[3];
+            int64_t origin[3];
+
+            for (int e = 0; e < 3; e++)
+            {
+                origin[e] = s.edge(e, bx, by);
+                int64_t dx = stepX[e] * (BLOCK_SIZE - 1);
+                int64_t dy = stepY[e] * (BLOCK_SIZE - 1);
+
+                int inside = (origin[e] >= 0) + (origin[e] + dx >= 0) +
+                             (origin[e] + dy >= 0) + (origin[e] + dx + dy >= 0);
+
+                if (inside == 0)
+                {
+                    rejected = true;
+                    break;
+                }
+                partial[e] = inside != 4;
+            }
+
+            if (rejected)
+                continue;
+
+            // part of the block inside of the bounding box
+            int xs = std::max(bx, s.minX), xe = std::min(bx + BLOCK_SIZE, s.maxX);
+            int ys = std::max(by, s.minY), ye = std::min(by + BLOCK_SIZE, s.maxY);
+
+            // edges crossing the block are stepped relative to the block origin, the others contain
+            // the whole block and are not tested at all
+            int rowStart[3], rowStep[3];
+            __m128i laneSteps[3], stepX4[3];
+            for (int e = 0; e < 3; e++)
+            {
+                if (partial[e] && !s.wide)
+                {
+                    int sx = (int)stepX[e];
+                    rowStart[e] = (int)(origin[e] + (xs - bx) * stepX[e] + (ys - by) * stepY[e]);
+                    rowStep[e] = (int)stepY[e];
+                    laneSteps[e] = _mm_set_epi32(3 * sx, 2 * sx, sx, 0);
+                    stepX4[e] = _mm_set1_epi32(4 * sx);
+                }
+                else
+                {
+                    rowStart[e] = rowStep[e] = 0;
+                    laneSteps[e] = stepX4[e] = _mm_setzero_si128();
+                }
+            }
+
+            for (int y = ys; y < ye; y++)
+            {
+                float py = y + 0.5f;
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)xs), laneOffsets);
+
+                // incremental edge functions and 1/z along the row
+                __m128i edge[3];
+                for (int e = 0; e < 3; e++)
+                {
+                    edge[e] = _mm_add_epi32(_mm_set1_epi32(rowStart[e]), laneSteps[e]);
+                    rowStart[e] += rowStep[e];
+                }
+                __m128 z = _mm_add_ps(_mm_mul_ps(dzdx, px), _mm_set1_ps(s.invz.dady * py + s.invz.a0));
+
+                // coverage and depth of the row are tested 4 pixels at a time, then the row is shaded at once
+                int rowMask = 0;
+                float zs[BLOCK_SIZE];
+
+                for (int x = xs; x < xe; x += 4)
+                {
+                    int mask = (xe - x) >= 4 ? 0xF : (1 << (xe - x)) - 1;
+
+                    if (!s.wide)
+                    {
+                        __m128i in = _mm_and_si128(_mm_cmpgt_epi32(edge[0], minusOne),
+                                     _mm_and_si128(_mm_cmpgt_epi32(edge[1], minusOne), _mm_cmpgt_epi32(edge[2], minusOne)));
+                        mask &= _mm_movemask_ps(_mm_castsi128_ps(in));
+                    }
+                    else
+                    {
+                        for (int i = 0; i < 4; i++)
+                            for (int e = 0; e < 3; e++)
+                                if (partial[e] && s.edge(e, x + i, y) < 0)
+                                    mask &= ~(1 << i);
+                    }
+
+                    int pos = y * width + x;
+
+                    if (mask && alpha == 255)
+                        mask &= _mm_movemask_ps(_mm_cmpgt_ps(z, _mm_loadu_ps(zbuffer + pos)));     // NOTE: this is 1/z buffer
+
+                    _mm_storeu_ps(zs + (x - xs), z);
+                    rowMask |= mask << (x - xs);
+
+                    for (int e = 0; e < 3; e++)
+                        edge[e] = _mm_add_epi32(edge[e], stepX4[e]);
+                    z = _mm_add_ps(z, dzdx4);
+                }
+
+                if (!rowMask)
+                    continue;
+
+                uint32_t colors[BLOCK_SIZE];
+                shader.shadeRow(xs + 0.5f, py, zs, rowMask, colors);
+
+                int pos = y * width + xs;
+                for (int i = 0; i < xe - xs; i++)
+                {
+                    if (!(rowMask & (1 << i)))
+                        continue;
+
+                    fb->blendAndStore(pos + i, RedFromInt(colors[i]), GreenFromInt(colors[i]), BlueFromInt(colors[i]), alpha);
+
+                    if (alpha == 255)
+                        zbuffer[pos + i] = zs[i];
+
+                    if (coverage && coverage[pos + i] != 0xFF)
+                        coverage[pos + i]++;
+                }
+            }
+        }
+    }
+}
+
 }
 
 #endif // TRIANGLERASTERIZER_H
@@ -260,7 +260,7 @@ bool WireframeTriangleRasterizer::clipLine(math::vec3 &p1, math::vec3 &p2, Frame
     return true;
 }
 
-void WireframeTriangleRasterizer::drawLine(const math::vertex &p1, const math::vertex &p2, FrameBuffer *fb)
+void WireframeTriangleRasterizer::drawLine(const math::vertex &p1, const math::vertex &p2, FrameBuffer *fb, const ScreenRect &clip)
 {
     math::vec3 pc1(p1.p), pc2(p2.p);
 
@@ -279,22 +279,30 @@ void WireframeTriangleRasterizer::drawLine(const math::vertex &p1, const math::v
         int dy = y1 - y0;
 
         int xInc, yInc;
+        int xStep, yStep;
         if (dx >= 0)
-            xInc = 1;
+            xInc = xStep = 1;
         else
         {
-            xInc = -1;
+            xInc = xStep = -1;
             dx = -dx;
         }
 
         if (dy >= 0)
+        {
             yInc = cols;
+            yStep = 1;
+        }
         else
         {
             yInc = -cols;
+            yStep = -1;
             dy = -dy;
         }
 
+        // the whole line is walked, but only pixels inside of the clip rect are written
+        int x = x0, y = y0;
+
         int dx2 = dx * 2;
         int dy2 = dy * 2;
 
@@ -304,16 +312,19 @@ void WireframeTriangleRasterizer::drawLine(const math::vertex &p1, const math::v
 
             for (int index = 0; index <= dx; index++)
             {
-                fb->wpixel(pixNum, p1.color);
+                if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1)
+                    fb->wpixel(pixNum, p1.color);
 
                 if (error >= 0)
                 {
                     error -= dx2;
                     pixNum += yInc;
+                    y += yStep;
                 }
 
                 error += dy2;
                 pixNum += xInc;
+                x += xStep;
             }
         }
         else
@@ -322,26 +333,29 @@ void WireframeTriangleRasterizer::drawLine(const math::vertex &p1, const math::v
 
             for (int index = 0; index <= dy; index++)
             {
-                fb->wpixel(pixNum, p1.color);
+                if (x >= clip.x0 && x < clip.x1 && y >= clip.y0 && y < clip.y1)
+                    fb->wpixel(pixNum, p1.color);
 
                 if (error >= 0)
                 {
                     error -= dy2;
                     pixNum += xInc;
+                    x += xStep;
                 }
 
                 error += dx2;
                 pixNum += yInc;
+                y += yStep;
             }
         }
     }
 }
 
-void WireframeTriangleRasterizer::drawTriangle(const math::Triangle &t, FrameBuffer *fb)
+void WireframeTriangleRasterizer::drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip)
 {
-    drawLine(t.v(0), t.v(1), fb);
-    drawLine(t.v(1), t.v(2), fb);
-    drawLine(t.v(2), t.v(0), fb);
+    drawLine(t.v(0), t.v(1), fb, clip);
+    drawLine(t.v(1), t.v(2), fb, clip);
+    drawLine(t.v(2), t.v(0), fb, clip);
 }
 
 }
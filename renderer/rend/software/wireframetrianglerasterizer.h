@@ -20,12 +20,12 @@ class WireframeTriangleRasterizer : public TriangleRasterizer
 {
     //! This functions draw lines.
     bool clipLine(math::vec3 &p1, math::vec3 &p2, FrameBuffer *fb);
-    void drawLine(const math::vertex &p1, const math::vertex &p2, FrameBuffer *fb);
+    void drawLine(const math::vertex &p1, const math::vertex &p2, FrameBuffer *fb, const ScreenRect &clip);
 
 public:
     WireframeTriangleRasterizer() { }
 
-    void drawTriangle(const math::Triangle &t, FrameBuffer *fb);
+    void drawTriangle(const math::Triangle &t, FrameBuffer *fb, const ScreenRect &clip);
 };
 
 }
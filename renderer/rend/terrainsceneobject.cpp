@@ -10,122 +10,453 @@
 #include "terrainsceneobject.h"
 #include "texture.h"
 #include "mesh.h"
-#include "vertexbuffer.h"
+#include "camera.h"
+#include "heightsource.h"
 
 namespace rend
 {
 
+// splits cells into chunks, a remainder of one cell is joined to the last chunk
+static std::vector<int> chunkSizes(int cells)
+{
+    const int size = TerrainSceneObject::CHUNK_SIZE;
+    std::vector<int> sizes;
+
+    for (int first = 0; first < cells; first += size)
+        sizes.push_back(std::min(size, cells - first));
+
+    if (sizes.size() > 1 && sizes.back() < 2)
+    {
+        sizes[sizes.size() - 2] += sizes.back();
+        sizes.pop_back();
+    }
+
+    return sizes;
+}
+
+// levels, which steps divide the chunk and leave an inner part for the border strips
+static int levelsCount(int columns, int rows)
+{
+    int levels = 1;
+
+    for (int step = 2; columns % step == 0 && rows % step == 0 && columns / step >= 2 && rows / step >= 2; step *= 2)
+        levels++;
+
+    return levels;
+}
+
+TerrainSceneObject::TerrainSceneObject()
+{
+    setMaxScreenError(2.0f);
+    setOccluder(true);
+}
+
 TerrainSceneObject::TerrainSceneObject(float width, float height, float vertScale,
                                        const sptr(Texture) heightMap,
                                        const sptr(Texture) texture)
 {
+    setMaxScreenError(2.0f);
+    setOccluder(true);
+
     if (!heightMap)
         return;
 
     // set name
     setName(std::string("terrain_") + heightMap->getName());
 
-    int columns = heightMap->width();
-    int rows = heightMap->height();
+    if (heightMap->width() < 2 || heightMap->height() < 2)
+    {
+        syslog << "Height map" << heightMap->getName() << "is too small" << logerr;
+        return;
+    }
+
+    init(width, height, vertScale, heightMap->width(), heightMap->height(), texture);
+
+    TextureHeightSource source(heightMap);
+
+    for (int z = 0; z < (int)m_grid.chunkRows.size(); z++)
+    {
+        for (int x = 0; x < (int)m_grid.chunkColumns.size(); x++)
+        {
+            ChunkData data;
+            data.x = x;
+            data.z = z;
+
+            buildChunk(m_grid, source, data);
+            addChunk(data);
+        }
+    }
+
+    // full resolution until the first frame
+    triangulate();
+
+    getMesh()->computeBoundingSphere();
+}
+
+void TerrainSceneObject::init(float width, float height, float vertScale, int columns, int rows, const sptr(Texture) texture)
+{
+    m_grid.columns = columns;
+    m_grid.rows = rows;
+    m_grid.width = width;
+    m_grid.height = height;
+    m_grid.vertScale = vertScale;
+    m_grid.textured = texture != nullptr;
+
+    m_grid.chunkColumns = chunkSizes(columns - 1);
+    m_grid.chunkRows = chunkSizes(rows - 1);
+
+    m_grid.firstColumns.assign(1, 0);
+    for (size_t i = 1; i < m_grid.chunkColumns.size(); i++)
+        m_grid.firstColumns.push_back(m_grid.firstColumns.back() + m_grid.chunkColumns[i - 1]);
 
-    float colStep = width / (float)(columns - 1);
-    float rowStep = height / (float)(rows - 1);
+    m_grid.firstRows.assign(1, 0);
+    for (size_t i = 1; i < m_grid.chunkRows.size(); i++)
+        m_grid.firstRows.push_back(m_grid.firstRows.back() + m_grid.chunkRows[i - 1]);
+
+    m_material = std::make_shared<rend::Material>();
+    m_material->plainColor = rend::Color3(255, 255, 255);
+    m_material->ambientColor = rend::Color3(255, 255, 255);
+    m_material->diffuseColor = rend::Color3(255, 255, 255);
 
-    float colStepText = 0.0, rowStepText = 0.0;
     if (texture)
     {
-        colStepText = ((float)texture->width() - 1) / (columns - 1.0);
-        rowStepText = ((float)texture->height() - 1) / (rows - 1.0);
+        m_material->texture = texture;
+        m_material->shadeMode = rend::Material::SM_TEXTURE;
     }
+    else
+        m_material->shadeMode = rend::Material::SM_GOURAUD;
+
+    m_material->sideType = rend::Material::ONE_SIDE;
+
+    setMesh(std::make_shared<rend::Mesh>());
+}
+
+void TerrainSceneObject::buildChunk(const Grid &grid, const HeightSource &source, ChunkData &data)
+{
+    int chunkColumns = grid.chunkColumns[data.x];
+    int chunkRows = grid.chunkRows[data.z];
+    int firstCol = grid.firstColumns[data.x];
+    int firstRow = grid.firstRows[data.z];
+
+    float colStep = grid.width / (float)(grid.columns - 1);
+    float rowStep = grid.height / (float)(grid.rows - 1);
+
+    // samples of the chunk with one more around it for the normals
+    int stride = chunkColumns + 3;
+    std::vector<float> heights(stride * (chunkRows + 3));
+    source.read(firstCol - 1, firstRow - 1, stride, chunkRows + 3, &heights[0]);
 
-    // store all vertices
-    std::vector<math::vertex> vertices;      // FIXME: allocate mem before
-    std::vector<math::vec2> uvs;
-    for (int currRow = 0; currRow < rows; currRow++)
+    auto heightAt = [&](int col, int row) -> float
     {
-        for (int currCol = 0; currCol < columns; currCol++)
+        return heights[(row - firstRow + 1) * stride + col - firstCol + 1] * grid.vertScale;
+    };
+
+    // vertices of the chunk, the border ones are repeated in the neighbours
+    std::vector<math::vertex> &vertices = data.vertices;
+    vertices.clear();
+    vertices.reserve((chunkColumns + 1) * (chunkRows + 1));
+
+    for (int z = 0; z <= chunkRows; z++)
+    {
+        for (int x = 0; x <= chunkColumns; x++)
         {
+            int col = firstCol + x;
+            int row = firstRow + z;
+
             math::vertex v;
 
-            v.p.x = currCol * colStep - (width / 2.0f);      // (0;0) point is the center of the map
-            v.p.z = currRow * rowStep - (height / 2.0f);
+            v.p.x = col * colStep - (grid.width / 2.0f);      // (0;0) point is the center of the map
+            v.p.z = row * rowStep - (grid.height / 2.0f);
+            v.p.y = heightAt(col, row);
 
-            // XYNTA:
-            v.p.y = (float)heightMap->at(currCol, currRow)[RED] / 255.0f;
-            v.p.y *= vertScale;
+            // normal of the whole map, so the chunk borders are lit the same way
+            float dx = (heightAt(col + 1, row) - heightAt(col - 1, row)) / ((std::min(col + 1, grid.columns - 1) - std::max(col - 1, 0)) * colStep);
+            float dz = (heightAt(col, row + 1) - heightAt(col, row - 1)) / ((std::min(row + 1, grid.rows - 1) - std::max(row - 1, 0)) * rowStep);
+            v.n = math::vec3(-dx, 1.0f, -dz);
+            v.n.normalize();
 
-            if (texture)
+            if (grid.textured)
             {
-                math::vec2 uv;
-                uv.x = currCol * colStepText;
-                uv.y = currRow * rowStepText;
+                v.t.x = col / (grid.columns - 1.0f);
+                v.t.y = row / (grid.rows - 1.0f);
+            }
+
+            vertices.push_back(v);
+        }
+    }
 
-                uv.x /= float(texture->width() - 1.);   // normalize
-                uv.y /= float(texture->height() - 1.);   // normalize
+    // height error of every level: the biggest difference between the vertex
+    // and the coarse triangles, which cover it
+    int levels = levelsCount(chunkColumns, chunkRows);
+    data.errors.assign(levels, 0.0f);
 
-                uvs.push_back(uv);
+    auto local = [&](int x, int z) -> float { return vertices[z * (chunkColumns + 1) + x].p.y; };
+
+    for (int level = 1; level < levels; level++)
+    {
+        int step = 1 << level;
+        float error = data.errors[level - 1];
+
+        for (int z = 0; z <= chunkRows; z++)
+        {
+            for (int x = 0; x <= chunkColumns; x++)
+            {
+                int x0 = std::min(x / step * step, chunkColumns - step);
+                int z0 = std::min(z / step * step, chunkRows - step);
+                float fx = (x - x0) / (float)step;
+                float fz = (z - z0) / (float)step;
+
+                float h00 = local(x0, z0);
+                float h10 = local(x0 + step, z0);
+                float h01 = local(x0, z0 + step);
+                float h11 = local(x0 + step, z0 + step);
+
+                // cells are split by the (x0, z0) - (x0 + step, z0 + step) diagonal
+                float coarse = fz >= fx ? h00 + fz * (h01 - h00) + fx * (h11 - h01)
+                                        : h00 + fx * (h10 - h00) + fz * (h11 - h10);
+
+                error = std::max(error, (float)fabs(coarse - local(x, z)));
             }
+        }
 
-            vertices.push_back(v);
+        data.errors[level] = error;
+    }
+}
+
+void TerrainSceneObject::addChunk(ChunkData &data)
+{
+    std::pair<int, int> key(data.x, data.z);
+    if (m_chunkGrid.find(key) != m_chunkGrid.end())
+        return;
+
+    // filled in place, the buffer is not copied
+    std::list<VertexBuffer> &submeshes = getMesh()->getSubmeshes();
+    submeshes.push_back(VertexBuffer(VertexBuffer::INDEXEDTRIANGLELIST));
+    submeshes.back().appendVertices(data.vertices, true);
+    submeshes.back().setMaterial(m_material);
+
+    Chunk chunk;
+    chunk.x = data.x;
+    chunk.z = data.z;
+    chunk.columns = m_grid.chunkColumns[data.x];
+    chunk.rows = m_grid.chunkRows[data.z];
+    chunk.errors.swap(data.errors);
+    chunk.vertexBuffer = --submeshes.end();
+    chunk.level = 0;
+    chunk.builtLevel = -1;
+
+    m_chunks.push_back(chunk);
+    auto it = --m_chunks.end();
+    m_chunkGrid[key] = it;
+
+    // link with the neighbours, which are in the mesh
+    static const int offsets[SIDES_COUNT][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+
+    for (int side = 0; side < SIDES_COUNT; side++)
+    {
+        auto found = m_chunkGrid.find(std::make_pair(data.x + offsets[side][0], data.z + offsets[side][1]));
+        Chunk *neighbour = found != m_chunkGrid.end() ? &*found->second : 0;
+
+        it->neighbours[side] = neighbour;
+        if (neighbour)
+            neighbour->neighbours[(side + 2) % SIDES_COUNT] = &*it;
+    }
+}
+
+void TerrainSceneObject::removeChunk(int x, int z)
+{
+    auto found = m_chunkGrid.find(std::make_pair(x, z));
+    if (found == m_chunkGrid.end())
+        return;
+
+    Chunk &chunk = *found->second;
+
+    for (int side = 0; side < SIDES_COUNT; side++)
+    {
+        if (chunk.neighbours[side])
+            chunk.neighbours[side]->neighbours[(side + 2) % SIDES_COUNT] = 0;
+    }
+
+    getMesh()->getSubmeshes().erase(chunk.vertexBuffer);
+    m_chunks.erase(found->second);
+    m_chunkGrid.erase(found);
+}
+
+int TerrainSceneObject::chunkLevel(int x, int z) const
+{
+    auto found = m_chunkGrid.find(std::make_pair(x, z));
+
+    return found != m_chunkGrid.end() ? found->second->level : -1;
+}
+
+const VertexBuffer::IndexArray &TerrainSceneObject::pattern(int columns, int rows, int level, const int (&steps)[SIDES_COUNT])
+{
+    uint64_t key = (uint64_t)columns | ((uint64_t)rows << 16) | ((uint64_t)level << 32);
+    for (int side = 0; side < SIDES_COUNT; side++)
+        key |= (uint64_t)steps[side] << (36 + side * 7);
+
+    auto found = m_patterns.find(key);
+    if (found != m_patterns.end())
+        return found->second;
+
+    VertexBuffer::IndexArray &indices = m_patterns[key];
+    int step = 1 << level;
+
+    // triangle with the same winding, as the full resolution grid has
+    auto add = [&](int x0, int z0, int x1, int z1, int x2, int z2)
+    {
+        if ((x1 - x0) * (z2 - z0) - (z1 - z0) * (x2 - x0) > 0)
+        {
+            std::swap(x1, x2);
+            std::swap(z1, z2);
         }
+
+        indices.push_back(z0 * (columns + 1) + x0);
+        indices.push_back(z1 * (columns + 1) + x1);
+        indices.push_back(z2 * (columns + 1) + x2);
+    };
+
+    auto cell = [&](int x, int z, int s)
+    {
+        add(x, z, x, z + s, x + s, z + s);
+        add(x, z, x + s, z + s, x + s, z);
+    };
+
+    // map of one cell width, only the full resolution is possible
+    if (columns / step < 2 || rows / step < 2)
+    {
+        for (int z = 0; z < rows; z += step)
+            for (int x = 0; x < columns; x += step)
+                cell(x, z, step);
+
+        return indices;
     }
 
-    // create triangles
-    std::vector<int> indices;
-    std::vector<int> uvInds;
-    for (int poly = 0; poly < ((columns - 1) * (rows - 1)); poly++)
+    // inner part
+    for (int z = step; z < rows - step; z += step)
+        for (int x = step; x < columns - step; x += step)
+            cell(x, z, step);
+
+    // border strips between the chunk side with the step of the side and the inner part with the own step
+    for (int side = 0; side < SIDES_COUNT; side++)
     {
-        int basePolyInd = (poly % (columns - 1)) + (columns * (poly / (columns - 1)));
+        bool alongX = side == BOTTOM || side == TOP;
+        int length = alongX ? columns : rows;
+        int outer = side == BOTTOM || side == LEFT ? 0 : (alongX ? rows : columns);
+        int inner = side == BOTTOM || side == LEFT ? step : outer - step;
 
-        indices.push_back(basePolyInd);
-        indices.push_back(basePolyInd + columns);
-        indices.push_back(basePolyInd + columns + 1);
+        auto point = [&](int across, int along, int &x, int &z)
+        {
+            x = alongX ? along : across;
+            z = alongX ? across : along;
+        };
 
-        indices.push_back(basePolyInd);
-        indices.push_back(basePolyInd + columns + 1);
-        indices.push_back(basePolyInd + 1);
+        int outerPos = 0;
+        int innerPos = step;
 
-        if (texture)
+        // zip two rows by the position along the side
+        while (outerPos < length || innerPos < length - step)
         {
-            uvInds.push_back(basePolyInd);
-            uvInds.push_back(basePolyInd + columns);
-            uvInds.push_back(basePolyInd + columns + 1);
+            bool advanceOuter = innerPos >= length - step
+                                || (outerPos < length && outerPos + steps[side] <= innerPos + step);
 
-            uvInds.push_back(basePolyInd);
-            uvInds.push_back(basePolyInd + columns + 1);
-            uvInds.push_back(basePolyInd + 1);
+            int x0, z0, x1, z1, x2, z2;
+
+            if (advanceOuter)
+            {
+                point(outer, outerPos, x0, z0);
+                point(outer, outerPos + steps[side], x1, z1);
+                point(inner, innerPos, x2, z2);
+                outerPos += steps[side];
+            }
+            else
+            {
+                point(outer, outerPos, x0, z0);
+                point(inner, innerPos + step, x1, z1);
+                point(inner, innerPos, x2, z2);
+                innerPos += step;
+            }
+
+            add(x0, z0, x1, z1, x2, z2);
         }
     }
 
-    VertexBuffer vb;
+    return indices;
+}
 
-    vb.setType(rend::VertexBuffer::INDEXEDTRIANGLELIST);
-    if (texture)
-        vb.appendVertices(vertices, indices, uvs, uvInds);
-    else
-        vb.appendVertices(vertices, indices);
+void TerrainSceneObject::triangulate()
+{
+    for (auto &chunk : m_chunks)
+    {
+        // sides use the step of the coarser neighbour
+        int steps[SIDES_COUNT];
+        for (int side = 0; side < SIDES_COUNT; side++)
+        {
+            int level = chunk.level;
+            if (chunk.neighbours[side])
+                level = std::max(level, chunk.neighbours[side]->level);
+
+            steps[side] = 1 << level;
+        }
 
-    auto material = std::make_shared<rend::Material>();
-    material->plainColor = rend::Color3(255, 255, 255);
-    material->ambientColor = rend::Color3(255, 255, 255);
-    material->diffuseColor = rend::Color3(255, 255, 255);
+        if (chunk.builtLevel == chunk.level && std::equal(steps, steps + SIDES_COUNT, chunk.builtSteps))
+            continue;
 
-    if (texture)
-    {
-        material->texture = texture;
-        material->shadeMode = rend::Material::SM_TEXTURE;
+        chunk.vertexBuffer->setIndices(pattern(chunk.columns, chunk.rows, chunk.level, steps));
+        chunk.builtLevel = chunk.level;
+        std::copy(steps, steps + SIDES_COUNT, chunk.builtSteps);
     }
-    else
-        material->shadeMode = rend::Material::SM_GOURAUD;
+}
 
-    material->sideType = rend::Material::ONE_SIDE;
+bool TerrainSceneObject::eyePosition(const Camera &camera, math::vec3 &eye) const
+{
+    math::M33 rotScale = m_worldTransformation.getM();
+    if (math::DCMP(rotScale.determinant(), 0.0f))
+        return false;
 
-    vb.setMaterial(material);
+    eye = (camera.getPosition() - m_worldTransformation.getV()) * rotScale.invert();
+    return true;
+}
 
-    auto mesh = std::make_shared<rend::Mesh>();
-    mesh->appendSubmesh(vb);
+void TerrainSceneObject::selectLevels(const Camera &camera)
+{
+    if (m_chunks.empty())
+        return;
 
-    setMesh(mesh);
+    // camera in the object space, the errors and the distances are compared there
+    math::vec3 eye;
+    if (!eyePosition(camera, eye))
+        return;
+
+    float pixels = camera.pixelsPerUnit();
+
+    for (auto &chunk : m_chunks)
+    {
+        chunk.level = 0;
+
+        if (getMaxScreenError() <= 0.0f)
+            continue;
+
+        // distance to the chunk box
+        const math::vec3 &min = chunk.vertexBuffer->getBoundsMin();
+        const math::vec3 &max = chunk.vertexBuffer->getBoundsMax();
+        math::vec3 d(std::max(std::max(min.x - eye.x, eye.x - max.x), 0.0f),
+                     std::max(std::max(min.y - eye.y, eye.y - max.y), 0.0f),
+                     std::max(std::max(min.z - eye.z, eye.z - max.z), 0.0f));
+        float distance = sqrt(d.dotProduct(d));
+
+        // error / distance * pixels is the error on the screen
+        while (chunk.level + 1 < (int)chunk.errors.size()
+               && chunk.errors[chunk.level + 1] * pixels <= getMaxScreenError() * distance)
+            chunk.level++;
+    }
+
+    triangulate();
+}
+
+void TerrainSceneObject::selectLod(const Camera &camera)
+{
+    selectLevels(camera);
 }
 
 }
@@ -9,18 +9,118 @@
 #define TERRAINSCENEOBJECT_H
 
 #include "sceneobject.h"
+#include "vertexbuffer.h"
 
 namespace rend
 {
 
 class Texture;
+class HeightSource;
+struct Material;
 
+//! Heightmap terrain with geomipmapping.
+/*!
+  * The grid is split into chunks of CHUNK_SIZE x CHUNK_SIZE cells, every chunk is a submesh,
+  * so it is culled by the frustum alone. Level L of the chunk takes every 2^L-th vertex.
+  * The level is the coarsest one, which height error projects to less than the max screen error.
+  *
+  * Chunk borders are triangulated with the step of the coarser of two neighbours,
+  * so they have the same vertices on both sides and there are no cracks.
+  */
 class TerrainSceneObject : public SceneObject
 {
+public:
+    //! Cells count of the chunk side.
+    static const int CHUNK_SIZE = 32;
+
+protected:
+    enum { BOTTOM, RIGHT, TOP, LEFT, SIDES_COUNT };
+
+    //! Height samples placement in the object space and the chunks of cells.
+    struct Grid
+    {
+        int columns, rows;
+        float width, height, vertScale;
+        bool textured;
+        //! Cells of every chunk column and row, and the first cell of it.
+        std::vector<int> chunkColumns, chunkRows;
+        std::vector<int> firstColumns, firstRows;
+    };
+
+    //! Chunk, which is built without the mesh.
+    struct ChunkData
+    {
+        int x, z;
+        std::vector<math::vertex> vertices;
+        //! Max height error of every level, does not decrease.
+        std::vector<float> errors;
+    };
+
+    struct Chunk
+    {
+        //! Chunk column and row.
+        int x, z;
+        //! Cells of the chunk.
+        int columns, rows;
+        //! Neighbour chunks by the sides, null if there is no one.
+        Chunk *neighbours[SIDES_COUNT];
+        std::vector<float> errors;
+        //! Submesh of the chunk.
+        std::list<VertexBuffer>::iterator vertexBuffer;
+
+        //! Level of the frame.
+        int level;
+        //! Current triangulation: level and the steps of the sides.
+        int builtLevel;
+        int builtSteps[SIDES_COUNT];
+    };
+
+    typedef std::map<std::pair<int, int>, std::list<Chunk>::iterator> ChunkGrid;
+
+    Grid m_grid;
+    sptr(Material) m_material;
+    std::list<Chunk> m_chunks;
+    ChunkGrid m_chunkGrid;
+
+    //! For the subclasses, which call init().
+    TerrainSceneObject();
+
+    //! Sets the grid and the material, creates the empty mesh.
+    void init(float width, float height, float vertScale, int columns, int rows, const sptr(Texture) texture);
+
+    //! Builds vertices and errors of the chunk data.x, data.z. May be called from any thread.
+    static void buildChunk(const Grid &grid, const HeightSource &source, ChunkData &data);
+    //! Adds the chunk submesh and links it with the neighbours.
+    void addChunk(ChunkData &data);
+    //! Removes the chunk submesh.
+    void removeChunk(int x, int z);
+
+    //! Camera position in the object space, false if the transformation is degenerate.
+    bool eyePosition(const Camera &camera, math::vec3 &eye) const;
+    //! Chooses the chunk levels and rebuilds the changed chunks.
+    void selectLevels(const Camera &camera);
+
+    //! Triangles of the chunk with the side steps, indices are z * (columns + 1) + x.
+    const VertexBuffer::IndexArray &pattern(int columns, int rows, int level, const int (&steps)[SIDES_COUNT]);
+
+private:
+    //! Triangulations of the chunks, by the size, level and side steps.
+    std::map<uint64_t, VertexBuffer::IndexArray> m_patterns;
+
+    //! Rebuilds the triangles of the chunks, which level or neighbours are changed.
+    void triangulate();
+
 public:
     TerrainSceneObject(float width, float height, float vertScale,
                        const sptr(Texture) heightMap,
                        const sptr(Texture) texture = std::shared_ptr<Texture>());
+
+    //! Count of the chunks in the mesh.
+    size_t  numChunks() const { return m_chunks.size(); }
+    //! Level of the chunk on the last frame, -1 if it is not in the mesh.
+    int     chunkLevel(int x, int z) const;
+
+    virtual void selectLod(const Camera &camera);
 };
 
 }
@@ -9,30 +9,270 @@
 
 #include "texture.h"
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 namespace rend
 {
 
-const Color3 Texture::BLACK;
-
 Texture::Texture(const std::vector<Color3> &pixels, int width, int height)
-    : m_pixels(pixels),
+    : m_data(pixels.size() * sizeof(uint32_t)),
+      m_format(TF_RGBA8),
+      m_layout(TL_LINEAR),
       m_width(width),
-      m_height(height)
+      m_height(height),
+      m_tilesPerRow(0)
 {
+    uint32_t *texels = reinterpret_cast<uint32_t *>(m_data.data());
+
+    for (size_t i = 0; i < pixels.size(); i++)
+        texels[i] = pixels[i].color();
+}
+
+Texture::Texture(Format format, const std::vector<uint8_t> &data, int width, int height)
+    : m_data(data),
+      m_format(format),
+      m_layout(TL_LINEAR),
+      m_width(width),
+      m_height(height),
+      m_tilesPerRow(0)
+{
+    if (m_data.size() != size_t(width * height * BytesPerTexel(format)))
+        throw TextureException("Texture data size doesn't match the dimensions.");
 }
 
 Texture::~Texture()
 {
 }
 
+// weights of the 2x2 footprint from the 8 bit fractions, they sum up to 256;
+// each weight is repeated in both 16 bit halves of the lane
+static inline void bilinearWeights(__m128i fu, __m128i fv, __m128i w[4])
+{
+    const __m128i one = _mm_set1_epi32(256);
+    __m128i iu = _mm_sub_epi32(one, fu);
+    __m128i iv = _mm_sub_epi32(one, fv);
+
+    w[0] = _mm_srli_epi32(_mm_mullo_epi32(iu, iv), 8);
+    w[1] = _mm_srli_epi32(_mm_mullo_epi32(fu, iv), 8);
+    w[2] = _mm_srli_epi32(_mm_mullo_epi32(iu, fv), 8);
+    w[3] = _mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(one, w[0]), w[1]), w[2]);
+
+    for (int k = 0; k < 4; k++)
+        w[k] = _mm_or_si128(w[k], _mm_slli_epi32(w[k], 16));
+}
+
+// r and b, then a and g of a packed texel are 16 bit pairs, so a channel times a weight up to 256
+// and the sum of four such products fit the 16 bits
+static inline __m128i bilinearBlend(const __m128i t[4], const __m128i w[4])
+{
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    __m128i rb = _mm_setzero_si128(), ag = _mm_setzero_si128();
+
+    for (int k = 0; k < 4; k++)
+    {
+        rb = _mm_add_epi16(rb, _mm_mullo_epi16(_mm_and_si128(t[k], mask), w[k]));
+        ag = _mm_add_epi16(ag, _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(t[k], 8), mask), w[k]));
+    }
+
+    return _mm_or_si128(_mm_srli_epi16(rb, 8), _mm_andnot_si128(mask, ag));
+}
+
+#ifdef __AVX2__
+static inline void bilinearWeights(__m256i fu, __m256i fv, __m256i w[4])
+{
+    const __m256i one = _mm256_set1_epi32(256);
+    __m256i iu = _mm256_sub_epi32(one, fu);
+    __m256i iv = _mm256_sub_epi32(one, fv);
+
+    w[0] = _mm256_srli_epi32(_mm256_mullo_epi32(iu, iv), 8);
+    w[1] = _mm256_srli_epi32(_mm256_mullo_epi32(fu, iv), 8);
+    w[2] = _mm256_srli_epi32(_mm256_mullo_epi32(iu, fv), 8);
+    w[3] = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_sub_epi32(one, w[0]), w[1]), w[2]);
+
+    for (int k = 0; k < 4; k++)
+        w[k] = _mm256_or_si256(w[k], _mm256_slli_epi32(w[k], 16));
+}
+
+static inline __m256i bilinearBlend(const __m256i t[4], const __m256i w[4])
+{
+    const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+    __m256i rb = _mm256_setzero_si256(), ag = _mm256_setzero_si256();
+
+    for (int k = 0; k < 4; k++)
+    {
+        rb = _mm256_add_epi16(rb, _mm256_mullo_epi16(_mm256_and_si256(t[k], mask), w[k]));
+        ag = _mm256_add_epi16(ag, _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(t[k], 8), mask), w[k]));
+    }
+
+    return _mm256_or_si256(_mm256_srli_epi16(rb, 8), _mm256_andnot_si256(mask, ag));
+}
+#endif
+
+void Texture::sampleBilinear(const float *u, const float *v, size_t count, uint32_t *colors) const
+{
+    const __m128 scaleU = _mm_set1_ps(m_width - 1.f);
+    const __m128 scaleV = _mm_set1_ps(m_height - 1.f);
+    const __m128 fraction = _mm_set1_ps(256.0f);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i width = _mm_set1_epi32(m_width);
+    const __m128i height = _mm_set1_epi32(m_height);
+    const __m128i tileMask = _mm_set1_epi32(TILE_SIZE - 1);
+    const __m128i tilesPerRow = _mm_set1_epi32(m_tilesPerRow);
+
+    size_t i = 0;
+
+#ifdef __AVX2__
+    if (m_format == TF_RGBA8)
+    {
+        const __m256 scaleU8 = _mm256_set1_ps(m_width - 1.f);
+        const __m256 scaleV8 = _mm256_set1_ps(m_height - 1.f);
+        const __m256 fraction8 = _mm256_set1_ps(256.0f);
+        const __m256i minusOne8 = _mm256_set1_epi32(-1);
+        const __m256i width8 = _mm256_set1_epi32(m_width);
+        const __m256i height8 = _mm256_set1_epi32(m_height);
+        const __m256i tileMask8 = _mm256_set1_epi32(TILE_SIZE - 1);
+        const __m256i tilesPerRow8 = _mm256_set1_epi32(m_tilesPerRow);
+        const int *base = reinterpret_cast<const int *>(m_data.data());
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 fu = _mm256_mul_ps(_mm256_loadu_ps(u + i), scaleU8);
+            __m256 fv = _mm256_mul_ps(_mm256_loadu_ps(v + i), scaleV8);
+            __m256 flu = _mm256_floor_ps(fu);
+            __m256 flv = _mm256_floor_ps(fv);
+
+            __m256i weights[4];
+            bilinearWeights(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(fu, flu), fraction8)),
+                            _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(fv, flv), fraction8)), weights);
+
+            __m256i x[2], y[2], validX[2], validY[2];
+            x[0] = _mm256_cvttps_epi32(flu);
+            y[0] = _mm256_cvttps_epi32(flv);
+            x[1] = _mm256_sub_epi32(x[0], minusOne8);
+            y[1] = _mm256_sub_epi32(y[0], minusOne8);
+
+            for (int k = 0; k < 2; k++)
+            {
+                validX[k] = _mm256_and_si256(_mm256_cmpgt_epi32(x[k], minusOne8), _mm256_cmpgt_epi32(width8, x[k]));
+                validY[k] = _mm256_and_si256(_mm256_cmpgt_epi32(y[k], minusOne8), _mm256_cmpgt_epi32(height8, y[k]));
+            }
+
+            // texels (x0 y0) (x1 y0) (x0 y1) (x1 y1), the ones out of the texture are not loaded
+            __m256i texels[4];
+            for (int k = 0; k < 4; k++)
+            {
+                __m256i tx = x[k & 1], ty = y[k >> 1];
+                __m256i index;
+
+                if (m_layout == TL_LINEAR)
+                    index = _mm256_add_epi32(_mm256_mullo_epi32(ty, width8), tx);
+                else
+                {
+                    __m256i tile = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(ty, TILE_BITS), tilesPerRow8),
+                                                    _mm256_srai_epi32(tx, TILE_BITS));
+                    index = _mm256_add_epi32(_mm256_slli_epi32(tile, 2 * TILE_BITS),
+                                             _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(ty, tileMask8), TILE_BITS),
+                                                              _mm256_and_si256(tx, tileMask8)));
+                }
+
+                __m256i valid = _mm256_and_si256(validX[k & 1], validY[k >> 1]);
+                texels[k] = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, index, valid, 4);
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(colors + i), bilinearBlend(texels, weights));
+        }
+    }
+#endif
+
+    // the tail is padded to four points
+    float tailU[4], tailV[4];
+    uint32_t tailColors[4];
+
+    for (; i < count; i += 4)
+    {
+        const float *pu = u + i, *pv = v + i;
+        uint32_t *out = colors + i;
+        size_t n = std::min(count - i, size_t(4));
+
+        if (n < 4)
+        {
+            for (size_t k = 0; k < 4; k++)
+            {
+                tailU[k] = k < n ? pu[k] : 0.0f;
+                tailV[k] = k < n ? pv[k] : 0.0f;
+            }
+            pu = tailU;
+            pv = tailV;
+            out = tailColors;
+        }
+
+        __m128 fu = _mm_mul_ps(_mm_loadu_ps(pu), scaleU);
+        __m128 fv = _mm_mul_ps(_mm_loadu_ps(pv), scaleV);
+        __m128 flu = _mm_floor_ps(fu);
+        __m128 flv = _mm_floor_ps(fv);
+
+        __m128i weights[4];
+        bilinearWeights(_mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(fu, flu), fraction)),
+                        _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(fv, flv), fraction)), weights);
+
+        __m128i x[2], y[2], validX[2], validY[2];
+        x[0] = _mm_cvttps_epi32(flu);
+        y[0] = _mm_cvttps_epi32(flv);
+        x[1] = _mm_sub_epi32(x[0], minusOne);
+        y[1] = _mm_sub_epi32(y[0], minusOne);
+
+        for (int k = 0; k < 2; k++)
+        {
+            validX[k] = _mm_and_si128(_mm_cmpgt_epi32(x[k], minusOne), _mm_cmpgt_epi32(width, x[k]));
+            validY[k] = _mm_and_si128(_mm_cmpgt_epi32(y[k], minusOne), _mm_cmpgt_epi32(height, y[k]));
+        }
+
+        // texels (x0 y0) (x1 y0) (x0 y1) (x1 y1), the ones out of the texture are not loaded
+        __m128i texels[4];
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i tx = x[k & 1], ty = y[k >> 1];
+            __m128i index;
+
+            if (m_layout == TL_LINEAR)
+                index = _mm_add_epi32(_mm_mullo_epi32(ty, width), tx);
+            else
+            {
+                __m128i tile = _mm_add_epi32(_mm_mullo_epi32(_mm_srai_epi32(ty, TILE_BITS), tilesPerRow),
+                                             _mm_srai_epi32(tx, TILE_BITS));
+                index = _mm_add_epi32(_mm_slli_epi32(tile, 2 * TILE_BITS),
+                                      _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(ty, tileMask), TILE_BITS),
+                                                    _mm_and_si128(tx, tileMask)));
+            }
+
+            int indices[4], valid[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(indices), index);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(valid), _mm_and_si128(validX[k & 1], validY[k >> 1]));
+
+            texels[k] = _mm_set_epi32(valid[3] ? load(indices[3]) : 0, valid[2] ? load(indices[2]) : 0,
+                                      valid[1] ? load(indices[1]) : 0, valid[0] ? load(indices[0]) : 0);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), bilinearBlend(texels, weights));
+
+        if (n < 4)
+            std::copy(tailColors, tailColors + n, colors + i);
+    }
+}
+
 std::vector<Color3> Texture::getLine(int y, int xStart, int xEnd) const
 {
     std::vector<Color3> retRes;
     if (y >= m_height || xStart >= m_width || xStart > xEnd)
         return retRes;
 
-    retRes.assign(m_pixels.begin() + y * m_width + xStart,
-                  m_pixels.begin() + y * m_width + (xEnd == 0 ? m_width : xEnd));
+    int end = xEnd == 0 ? m_width : xEnd;
+
+    retRes.reserve(end - xStart);
+    for (int x = xStart; x < end; x++)
+        retRes.push_back(at(x, y));
 
     return retRes;
 }
@@ -56,9 +296,97 @@ std::vector<Color3> Texture::getBlock(int x, int y, int width, int height) const
     return retRes;
 }
 
+void Texture::generateMips()
+{
+    m_mips.clear();
+
+    int bpp = BytesPerTexel(m_format);
+    const Texture *prev = this;
+
+    while (prev->m_width > 1 || prev->m_height > 1)
+    {
+        int width = std::max(prev->m_width / 2, 1);
+        int height = std::max(prev->m_height / 2, 1);
+
+        std::vector<uint8_t> data(width * height * bpp);
+        uint8_t *out = data.data();
+
+        for (int y = 0; y < height; y++)
+        {
+            // the last row or column of an odd sized level is repeated
+            int y0 = std::min(2 * y, prev->m_height - 1);
+            int y1 = std::min(2 * y + 1, prev->m_height - 1);
+
+            for (int x = 0; x < width; x++)
+            {
+                int x0 = std::min(2 * x, prev->m_width - 1);
+                int x1 = std::min(2 * x + 1, prev->m_width - 1);
+
+                const uint8_t *p00 = prev->raw() + prev->index(x0, y0) * bpp;
+                const uint8_t *p10 = prev->raw() + prev->index(x1, y0) * bpp;
+                const uint8_t *p01 = prev->raw() + prev->index(x0, y1) * bpp;
+                const uint8_t *p11 = prev->raw() + prev->index(x1, y1) * bpp;
+
+                // every byte is a channel in both formats
+                for (int c = 0; c < bpp; c++)
+                    *out++ = (uint8_t)((p00[c] + p10[c] + p01[c] + p11[c] + 2) / 4);
+            }
+        }
+
+        m_mips.push_back(std::make_shared<Texture>(m_format, data, width, height));
+        m_mips.back()->setLayout(m_layout);
+        prev = m_mips.back().get();
+    }
+}
+
+void Texture::setLayout(Layout layout)
+{
+    for (auto &mip : m_mips)
+        mip->setLayout(layout);
+
+    if (layout == m_layout)
+        return;
+
+    int bpp = BytesPerTexel(m_format);
+    int tilesPerRow = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesPerColumn = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+
+    // the other texture describes the new layout
+    Texture reordered(m_format, std::vector<uint8_t>(), 0, 0);
+    reordered.m_layout = layout;
+    reordered.m_width = m_width;
+    reordered.m_height = m_height;
+    reordered.m_tilesPerRow = tilesPerRow;
+
+    if (layout == TL_TILED)
+        reordered.m_data.resize(tilesPerRow * tilesPerColumn * TILE_SIZE * TILE_SIZE * bpp);
+    else
+        reordered.m_data.resize(m_width * m_height * bpp);
+
+    for (int y = 0; y < m_height; y++)
+    {
+        for (int x = 0; x < m_width; x++)
+            memcpy(&reordered.m_data[reordered.index(x, y) * bpp], &m_data[index(x, y) * bpp], bpp);
+    }
+
+    m_data.swap(reordered.m_data);
+    m_layout = layout;
+    m_tilesPerRow = tilesPerRow;
+}
+
 sptr(Texture) Texture::clone() const
 {
-    return std::make_shared<Texture>(m_pixels, m_width, m_height);
+    sptr(Texture) newTex = std::make_shared<Texture>(m_format, std::vector<uint8_t>(), 0, 0);
+
+    newTex->m_data = m_data;
+    newTex->m_layout = m_layout;
+    newTex->m_width = m_width;
+    newTex->m_height = m_height;
+    newTex->m_tilesPerRow = m_tilesPerRow;
+    for (const auto &mip : m_mips)
+        newTex->m_mips.push_back(mip->clone());
+
+    return newTex;
 }
 
 }
@@ -16,45 +16,139 @@ namespace rend
 
 DECLARE_EXCEPTION(TextureException)
 
+//! Image with packed texels.
+/*!
+  * RGBA8 texels are 32 bit integers in the same A8R8G8B8 format as RgbaToInt() and the frame buffer,
+  * so a sampler can unpack four channels of a texel at once. R8 textures keep one byte per texel
+  * (height maps), their texels are read as gray colors.
+  *
+  * Minified textures are sampled from the mip levels, which are built by generateMips().
+  * A texture without them has just one level, itself.
+  */
 class Texture : public base::Resource
 {
-    std::vector<Color3> m_pixels;
-    static const Color3 BLACK;
+public:
+    enum Format
+    {
+        TF_RGBA8,       /*!< 4 bytes per texel. */
+        TF_R8           /*!< 1 byte per texel. */
+    };
+
+    //! Order of the texels in memory.
+    enum Layout
+    {
+        TL_LINEAR,      /*!< Row by row. */
+        TL_TILED        /*!< Row by row of TILE_SIZE x TILE_SIZE tiles, each tile is row by row. */
+    };
+
+    //! A tile of RGBA8 texels is one 64 byte cache line, so is the 2x2 footprint of bilinear filter
+    //! in 9 cases of 16, and vertical steps touch the same lines as the horizontal ones.
+    static const int TILE_BITS = 2;
+    static const int TILE_SIZE = 1 << TILE_BITS;
+
+private:
+    std::vector<uint8_t> m_data;
+    Format m_format;
+    Layout m_layout;
 
     int m_width, m_height;
+    //! Tiles in a row, the data of the tiled texture is padded to the whole tiles.
+    int m_tilesPerRow;
+
+    //! Levels 1, 2, ... of the mip chain, each one is half of the previous one.
+    std::vector<sptr(Texture)> m_mips;
 
 public:
+    //! Packs the colors to RGBA8.
     Texture(const std::vector<Color3> &pixels, int width, int height);
+    //! Takes the texels row by row, data size must be width * height * BytesPerTexel(format).
+    Texture(Format format, const std::vector<uint8_t> &data, int width, int height);
     ~Texture();
 
-    const Color3 &at(int x, int y) const
+    static int BytesPerTexel(Format format) { return format == TF_R8 ? 1 : 4; }
+
+    //! Packed A8R8G8B8 texel by its index(), without the range check.
+    uint32_t load(int index) const
+    {
+        if (m_format == TF_R8)
+        {
+            uint32_t value = m_data[index];
+            return RgbToInt(value, value, value);
+        }
+
+        return reinterpret_cast<const uint32_t *>(m_data.data())[index];
+    }
+
+    //! Index of texel (x, y) in the data.
+    int index(int x, int y) const
+    {
+        if (m_layout == TL_LINEAR)
+            return y * m_width + x;
+
+        int tile = (y >> TILE_BITS) * m_tilesPerRow + (x >> TILE_BITS);
+        return (tile << (2 * TILE_BITS)) + ((y & (TILE_SIZE - 1)) << TILE_BITS) + (x & (TILE_SIZE - 1));
+    }
+
+    //! Packed A8R8G8B8 texel, zero (black) out of range.
+    uint32_t texel(int x, int y) const
     {
         if (x >= m_width || y >= m_height || x < 0 || y < 0)
-            return BLACK;//throw TextureException("Out of range while getting texel.");
+            return 0;
 
-        return m_pixels[y * m_width + x];
+        return load(index(x, y));
+    }
+
+    Color3 at(int x, int y) const
+    {
+        return Color3(texel(x, y));
     }
 
-    const Color3 &at(int pos) const
+    Color3 at(int pos) const
     {
         if (pos < 0 || pos >= (m_width * m_height))
-            return BLACK;
+            return Color3();
 
-        return m_pixels[pos];
+        return at(pos % m_width, pos / m_width);
     }
 
+    //! Bilinear filtering at count points (u[i], v[i]) in [0, 1], colors are packed A8R8G8B8.
+    /*!
+      * Texels out of the texture are black, as in texel(). Weights are 8 bit fractions, points are
+      * filtered 8 at a time with AVX2 (gathering the texels) and 4 at a time with SSE4.1.
+      */
+    void sampleBilinear(const float *u, const float *v, size_t count, uint32_t *colors) const;
+
     // Getting pixels
     std::vector<Color3> getLine(int y, int xStart = 0, int xEnd = 0) const;
     std::vector<Color3> getBlock(int x, int y, int width, int height) const;
 
-    const Color3 *raw() const
+    //! Texels in the format and the layout of the texture.
+    const uint8_t *raw() const
     {
-        return &m_pixels[0];
+        return m_data.data();
     }
 
+    //! Reorders the texels of the texture and its mip levels.
+    void setLayout(Layout layout);
+
+    Format format() const { return m_format; }
+    Layout layout() const { return m_layout; }
     int width() const { return m_width; }
     int height() const { return m_height; }
 
+    //! Builds the mip chain down to 1x1 by averaging 2x2 texels. Levels share the format.
+    void generateMips();
+    //! Count of the mip levels including the base one.
+    int levels() const { return 1 + (int)m_mips.size(); }
+    //! Mip level, zero is this texture. The level is clamped to the chain.
+    const Texture *level(int lod) const
+    {
+        if (lod <= 0 || m_mips.empty())
+            return this;
+
+        return m_mips[std::min(lod, (int)m_mips.size()) - 1].get();
+    }
+
     sptr(Texture) clone() const;
 };
 
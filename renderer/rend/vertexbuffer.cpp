@@ -37,7 +37,8 @@ void VertexBuffer::appendVertices(const std::vector<math::vertex> &vertices, con
                                   bool isNormalsComputed)
 {
     std::copy(uvs.begin(), uvs.end(), std::back_inserter(m_uvs));
-    std::copy(uvinds.begin(), uvinds.end(), std::back_inserter(m_uvsIndices));
+    for (size_t i = 0; i < uvinds.size(); i++)
+        m_uvsIndices.push_back(uvinds[i]);
 
     appendVertices(vertices, indices, isNormalsComputed);
 }
@@ -46,10 +47,17 @@ void VertexBuffer::appendVertices(const std::vector<math::vertex> &vertices, con
                                   bool isNormalsComputed)
 {
     std::copy(vertices.begin(), vertices.end(), std::back_inserter(m_vertices));
-    std::copy(indices.begin(), indices.end(), std::back_inserter(m_indices));
+
+    m_indices.reserve(m_indices.size() + indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        m_indices.push_back(indices[i]);
 
     if (!isNormalsComputed)
         computeVertexNormals();
+
+    computeFacePlanes();
+    computeBoundingBox();
+    buildClusters();
 }
 
 void VertexBuffer::appendVertices(const std::vector<math::vertex> &vertices,
@@ -59,47 +67,71 @@ void VertexBuffer::appendVertices(const std::vector<math::vertex> &vertices,
 
     if (!isNormalsComputed)
         computeVertexNormals();
+
+    computeFacePlanes();
+    computeBoundingBox();
+    buildClusters();
 }
 
-void VertexBuffer::computeVertexNormals()
+void VertexBuffer::setIndices(const IndexArray &indices)
 {
-    std::vector<int> polysTouchVertex(m_vertices.size());
+    assert(m_type == INDEXEDTRIANGLELIST);
 
-    // clear normals for all vertices
-    std::for_each(m_vertices.begin(), m_vertices.end(), [](math::vertex &v) { v.n.zero(); } );
+    m_indices = indices;
+    m_uvsIndices.clear();
+    m_clusters.clear();
 
-    switch(m_type)
-    {
-    case INDEXEDTRIANGLELIST:
+    computeFacePlanes();
+}
 
-        for(size_t ind = 0; ind < m_indices.size(); ind += 3)
-        {
-            size_t vindex0 = m_indices[ind];
-            size_t vindex1 = m_indices[ind + 1];
-            size_t vindex2 = m_indices[ind + 2];
+template<typename Index>
+void VertexBuffer::computeIndexedNormals(const Index *indices)
+{
+    std::vector<int> polysTouchVertex(m_vertices.size());
 
-            polysTouchVertex[vindex0]++;
-            polysTouchVertex[vindex1]++;
-            polysTouchVertex[vindex2]++;
+    for(size_t ind = 0; ind < m_indices.size(); ind += 3)
+    {
+        size_t vindex0 = indices[ind];
+        size_t vindex1 = indices[ind + 1];
+        size_t vindex2 = indices[ind + 2];
 
-            math::vec3 u = m_vertices[vindex1].p - m_vertices[vindex0].p;
-            math::vec3 v = m_vertices[vindex2].p - m_vertices[vindex0].p;
+        polysTouchVertex[vindex0]++;
+        polysTouchVertex[vindex1]++;
+        polysTouchVertex[vindex2]++;
 
-            math::vec3 normal = u.crossProduct(v);
+        math::vec3 u = m_vertices[vindex1].p - m_vertices[vindex0].p;
+        math::vec3 v = m_vertices[vindex2].p - m_vertices[vindex0].p;
 
-            m_vertices[vindex0].n += normal;
-            m_vertices[vindex1].n += normal;
-            m_vertices[vindex2].n += normal;
-        }
+        math::vec3 normal = u.crossProduct(v);
 
-        for (size_t vertex = 0; vertex < m_vertices.size(); vertex++)
+        m_vertices[vindex0].n += normal;
+        m_vertices[vindex1].n += normal;
+        m_vertices[vindex2].n += normal;
+    }
+
+    for (size_t vertex = 0; vertex < m_vertices.size(); vertex++)
+    {
+        if (polysTouchVertex[vertex] >= 1)
         {
-            if (polysTouchVertex[vertex] >= 1)
-            {
-                m_vertices[vertex].n /= polysTouchVertex[vertex];
-                m_vertices[vertex].n.normalize();
-            }
+            m_vertices[vertex].n /= polysTouchVertex[vertex];
+            m_vertices[vertex].n.normalize();
         }
+    }
+}
+
+void VertexBuffer::computeVertexNormals()
+{
+    // clear normals for all vertices
+    std::for_each(m_vertices.begin(), m_vertices.end(), [](math::vertex &v) { v.n.zero(); } );
+
+    switch(m_type)
+    {
+    case INDEXEDTRIANGLELIST:
+
+        if (m_indices.wide())
+            computeIndexedNormals(m_indices.data<uint32_t>());
+        else
+            computeIndexedNormals(m_indices.data<uint16_t>());
         break;
 
     case TRIANGLELIST:
@@ -143,6 +175,303 @@ void VertexBuffer::computeVertexNormals()
     }
 }
 
+void VertexBuffer::computeFacePlanes()
+{
+    m_facePlanes.clear();
+
+    switch (m_type)
+    {
+    case INDEXEDTRIANGLELIST:
+    case TRIANGLELIST:
+    {
+        bool indexed = m_type == INDEXEDTRIANGLELIST;
+        size_t count = indexed ? m_indices.size() / 3 : m_vertices.size() / 3;
+        m_facePlanes.reserve(count);
+
+        for (size_t t = 0; t < count; t++)
+        {
+            const math::vec3 &p0 = m_vertices[indexed ? m_indices[t * 3 + 0] : t * 3 + 0].p;
+            const math::vec3 &p1 = m_vertices[indexed ? m_indices[t * 3 + 1] : t * 3 + 1].p;
+            const math::vec3 &p2 = m_vertices[indexed ? m_indices[t * 3 + 2] : t * 3 + 2].p;
+
+            // same orientation as the triangle normal
+            m_facePlanes.push_back(math::Plane((p1 - p0).crossProduct(p2 - p0), p0));
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void VertexBuffer::computeBoundingBox()
+{
+    if (m_vertices.empty())
+    {
+        m_boundsMin.zero();
+        m_boundsMax.zero();
+        return;
+    }
+
+    m_boundsMin = m_boundsMax = m_vertices[0].p;
+
+    for (const auto &v : m_vertices)
+    {
+        m_boundsMin.set(std::min(m_boundsMin.x, v.p.x), std::min(m_boundsMin.y, v.p.y), std::min(m_boundsMin.z, v.p.z));
+        m_boundsMax.set(std::max(m_boundsMax.x, v.p.x), std::max(m_boundsMax.y, v.p.y), std::max(m_boundsMax.z, v.p.z));
+    }
+}
+
+// interleaves the lower 10 bits with two zero bits
+static uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// position on the Z-order curve inside of the box
+static uint32_t mortonCode(const math::vec3 &p, const math::vec3 &min, const math::vec3 &size)
+{
+    uint32_t code = 0;
+    const float *pv = &p.x, *minv = &min.x, *sizev = &size.x;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float rel = sizev[axis] > 0.0f ? (pv[axis] - minv[axis]) / sizev[axis] : 0.0f;
+        uint32_t cell = (uint32_t)std::min(std::max(rel * 1023.0f, 0.0f), 1023.0f);
+        code |= spreadBits(cell) << axis;
+    }
+
+    return code;
+}
+
+void VertexBuffer::reorderTriangles(const std::vector<size_t> &order)
+{
+    bool indexed = m_type == INDEXEDTRIANGLELIST;
+
+    std::vector<math::Plane> planes;
+    IndexArray indices, uvIndices;
+    VertexArray vertices;
+    planes.reserve(order.size());
+
+    bool moveUVs = m_uvsIndices.size() == order.size() * 3;
+
+    for (size_t t : order)
+    {
+        planes.push_back(m_facePlanes[t]);
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (indexed)
+                indices.push_back(m_indices[t * 3 + k]);
+            else
+                vertices.push_back(m_vertices[t * 3 + k]);
+
+            if (moveUVs)
+                uvIndices.push_back(m_uvsIndices[t * 3 + k]);
+        }
+    }
+
+    m_facePlanes.swap(planes);
+    if (indexed)
+        m_indices.swap(indices);
+    else
+        std::copy(vertices.begin(), vertices.end(), m_vertices.begin());
+    if (moveUVs)
+        m_uvsIndices.swap(uvIndices);
+}
+
+void VertexBuffer::buildClusters()
+{
+    m_clusters.clear();
+
+    if (m_type != INDEXEDTRIANGLELIST && m_type != TRIANGLELIST)
+        return;
+
+    bool indexed = m_type == INDEXEDTRIANGLELIST;
+    size_t count = m_facePlanes.size();
+
+    if (count <= CLUSTER_TRIANGLES * 2)
+        return;
+
+    auto corner = [&](size_t t, int k) -> size_t { return indexed ? m_indices[t * 3 + k] : t * 3 + k; };
+
+    std::vector<math::vec3> centroids(count);
+    for (size_t t = 0; t < count; t++)
+        centroids[t] = (m_vertices[corner(t, 0)].p + m_vertices[corner(t, 1)].p + m_vertices[corner(t, 2)].p) / 3.0f;
+
+    // new clusters start near the previous ones
+    std::vector<uint32_t> codes(count);
+    std::vector<size_t> seeds(count);
+    for (size_t t = 0; t < count; t++)
+    {
+        codes[t] = mortonCode(centroids[t], m_boundsMin, m_boundsMax - m_boundsMin);
+        seeds[t] = t;
+    }
+    std::stable_sort(seeds.begin(), seeds.end(), [&](size_t a, size_t b) { return codes[a] < codes[b]; });
+
+    // triangles of every vertex
+    std::vector<size_t> adjacencyFirst(m_vertices.size() + 1, 0);
+    std::vector<size_t> adjacency(count * 3);
+    for (size_t t = 0; t < count; t++)
+        for (int k = 0; k < 3; k++)
+            adjacencyFirst[corner(t, k) + 1]++;
+    for (size_t v = 0; v < m_vertices.size(); v++)
+        adjacencyFirst[v + 1] += adjacencyFirst[v];
+    {
+        std::vector<size_t> fill(adjacencyFirst.begin(), adjacencyFirst.end() - 1);
+        for (size_t t = 0; t < count; t++)
+            for (int k = 0; k < 3; k++)
+                adjacency[fill[corner(t, k)]++] = t;
+    }
+
+    // grow clusters from the seeds: take the neighbour triangle, which is closest to the cluster center
+    // and looks in the same direction, so the clusters get small spheres and narrow normal cones
+    const size_t NONE = (size_t)-1;
+    std::vector<size_t> order;
+    std::vector<size_t> clusterStarts;
+    std::vector<size_t> frontier;
+    std::vector<size_t> stamp(count, NONE);
+    std::vector<bool> assigned(count, false);
+    size_t nextSeed = 0;
+
+    order.reserve(count);
+
+    while (order.size() < count)
+    {
+        size_t cluster = clusterStarts.size();
+        clusterStarts.push_back(order.size());
+        frontier.clear();
+
+        math::vec3 centerSum, normalSum;
+        size_t size = 0;
+
+        while (size < CLUSTER_TRIANGLES && order.size() < count)
+        {
+            // no neighbours left, continue with the nearest triangle by the curve
+            if (frontier.empty())
+            {
+                while (assigned[seeds[nextSeed]])
+                    nextSeed++;
+
+                frontier.push_back(seeds[nextSeed]);
+                stamp[seeds[nextSeed]] = cluster;
+            }
+
+            size_t best = 0;
+            if (size > 0)
+            {
+                math::vec3 center = centerSum / (float)size;
+                math::vec3 axis = normalSum;
+                axis.normalize();
+
+                float bestScore = 0.0f;
+                for (size_t i = 0; i < frontier.size(); i++)
+                {
+                    size_t t = frontier[i];
+                    math::vec3 d = centroids[t] - center;
+                    float score = d.dotProduct(d) * (2.0f - m_facePlanes[t].normal().dotProduct(axis));
+
+                    if (i == 0 || score < bestScore)
+                    {
+                        best = i;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            size_t t = frontier[best];
+            frontier[best] = frontier.back();
+            frontier.pop_back();
+
+            assigned[t] = true;
+            order.push_back(t);
+            centerSum += centroids[t];
+            normalSum += m_facePlanes[t].normal();
+            size++;
+
+            for (int k = 0; k < 3; k++)
+            {
+                size_t v = corner(t, k);
+                for (size_t a = adjacencyFirst[v]; a < adjacencyFirst[v + 1]; a++)
+                {
+                    size_t n = adjacency[a];
+                    if (assigned[n] || stamp[n] == cluster)
+                        continue;
+
+                    stamp[n] = cluster;
+                    frontier.push_back(n);
+                }
+            }
+        }
+    }
+
+    reorderTriangles(order);
+    clusterStarts.push_back(count);
+
+    // bounds of the clusters
+    m_clusters.resize(clusterStarts.size() - 1);
+    for (size_t c = 0; c < m_clusters.size(); c++)
+    {
+        Cluster &cluster = m_clusters[c];
+        cluster.first = clusterStarts[c];
+        cluster.count = clusterStarts[c + 1] - clusterStarts[c];
+        cluster.firstVertex = NONE;
+        cluster.lastVertex = 0;
+
+        math::vec3 min = m_vertices[corner(cluster.first, 0)].p;
+        math::vec3 max = min;
+        math::vec3 normalSum;
+
+        for (size_t t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                size_t v = corner(t, k);
+                const math::vec3 &p = m_vertices[v].p;
+
+                min.set(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+                max.set(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+                cluster.firstVertex = std::min(cluster.firstVertex, v);
+                cluster.lastVertex = std::max(cluster.lastVertex, v + 1);
+            }
+
+            normalSum += m_facePlanes[t].normal();
+        }
+
+        cluster.center = 0.5f * (min + max);
+        float radiusSq = 0.0f;
+        for (size_t t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                math::vec3 d = m_vertices[corner(t, k)].p - cluster.center;
+                radiusSq = std::max(radiusSq, d.dotProduct(d));
+            }
+        }
+        cluster.radius = sqrt(radiusSq);
+
+        // the widest angle between the axis and the normals, degenerate triangles have no normal
+        cluster.coneAxis = normalSum;
+        cluster.coneAxis.normalize();
+        float minDot = cluster.coneAxis.isZero() ? -1.0f : 1.0f;
+
+        for (size_t t = cluster.first; t < cluster.first + cluster.count; t++)
+        {
+            const math::vec3 &n = m_facePlanes[t].normal();
+            if (!n.isZero())
+                minDot = std::min(minDot, n.dotProduct(cluster.coneAxis));
+        }
+
+        cluster.coneCutoff = minDot > 0.0f ? sqrt(1.0f - minDot * minDot) : 1.0f;
+    }
+}
+
 bool VertexBuffer::operator< (const VertexBuffer &vb)
 {
     return m_material->alpha > vb.m_material->alpha;
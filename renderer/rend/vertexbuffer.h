@@ -9,7 +9,9 @@
 #define VERTEXBUFFER_H
 
 #include "../math/vertex.h"
+#include "../math/plane.h"
 #include "boundingsphere.h"
+#include "indexarray.h"
 #include "../math/m44.h"
 
 namespace rend
@@ -27,7 +29,7 @@ class VertexBuffer
 public:
     //! Some anti-boilerplate typedefs.
     typedef std::vector<math::vertex> VertexArray;
-    typedef std::vector<uint16_t> IndexArray;
+    typedef rend::IndexArray IndexArray;
 
     enum VertexBufferType
     {
@@ -37,6 +39,28 @@ public:
         LINELIST                /*!< Each two vertices define the line. */
     };
 
+    //! Maximum triangles count of the cluster.
+    static const size_t CLUSTER_TRIANGLES = 128;
+
+    //! Compact group of neighbour triangles, which is culled as a whole.
+    struct Cluster
+    {
+        //! Triangles [first, first + count) of the buffer.
+        size_t first;
+        size_t count;
+        //! Vertices [firstVertex, lastVertex) include all vertices of the triangles. Clusters of the
+        //! indexed buffer share vertices, so these ranges overlap and are usually wide.
+        size_t firstVertex;
+        size_t lastVertex;
+        //! Object space bounding sphere.
+        math::vec3 center;
+        float radius;
+        //! Normals of all triangles are in the cone around the axis.
+        math::vec3 coneAxis;
+        //! Sine of the cone half angle, the cone is too wide for culling if it is 1.
+        float coneCutoff;
+    };
+
 private:
     friend class Mesh; // because mesh is vertex buffer container.
 
@@ -54,6 +78,21 @@ private:
     //! Indices for uv coords.
     IndexArray m_uvsIndices;
 
+    //! Object space plane of every triangle, the normal looks to the front side.
+    std::vector<math::Plane> m_facePlanes;
+
+    //! Object space axis aligned bounding box.
+    math::vec3 m_boundsMin, m_boundsMax;
+
+    //! Clusters of the large buffers.
+    std::vector<Cluster> m_clusters;
+
+    //! Moves triangles to the given order.
+    void reorderTriangles(const std::vector<size_t> &order);
+
+    template<typename Index>
+    void computeIndexedNormals(const Index *indices);
+
 public:
     //! Default ctor.
     VertexBuffer(VertexBufferType type = UNDEFINED);
@@ -63,7 +102,7 @@ public:
     //! Sets the material to this submesh.
     void            setMaterial(sptr(Material) material);
     //! Gets material.
-    sptr(Material)  getMaterial() const { return m_material; }
+    const sptr(Material) &getMaterial() const { return m_material; }
 
     //! Sets the type.
     void                setType(VertexBufferType type) { m_type = type; }
@@ -71,18 +110,34 @@ public:
     VertexBufferType    getType() const { return m_type; }
 
     //! Appends vertices to this submesh. Also computes vertex normals and bounding sphere.
+    /*! Indices become 32 bit, if the buffer has more vertices, than 16 bit indices address. */
     void appendVertices(const std::vector<math::vertex> &vertices, const std::vector<int> &indices,
                         const std::vector<math::vec2> &uvs, const std::vector<int> &uvinds, bool isNormalsComputed = false);
     void appendVertices(const std::vector<math::vertex> &vertices, const std::vector<int> &indices, bool isNormalsComputed = false);
     void appendVertices(const std::vector<math::vertex> &vertices, bool isNormalsComputed = false);
+    //! Replaces the triangles of the indexed buffer, texture coordinates must be in the vertices.
+    //! Rebuilds the face planes, drops the clusters.
+    void setIndices(const IndexArray &indices);
 
     //! Helper to compute vertex normals.
     void computeVertexNormals();
+    //! Rebuilds triangle planes. Called by appendVertices().
+    void computeFacePlanes();
+    //! Rebuilds bounding box. Called by appendVertices().
+    void computeBoundingBox();
+    //! Groups triangles of the buffer, which has more than two clusters of them, into clusters.
+    /*!
+      * Triangles are reordered, so every cluster is a continuous range. Called by appendVertices()
+      * after computeFacePlanes().
+      */
+    void buildClusters();
 
     //! How many vertices in the buffer?
     int numVertices() const { return m_vertices.size(); }
     //! How many indices in the buffer?
     int numIndices() const { return m_indices.size(); }
+    //! Indices are 32 bit.
+    bool hasWideIndices() const { return m_indices.wide(); }
 
     //! Gets i-th vertex from the array.
     math::vertex    vertex(unsigned i) const { return m_vertices[i]; }
@@ -93,6 +148,13 @@ public:
     const VertexArray&  getVertices() const { return m_vertices; }
     //! Returns reference to all indices of the submesh.
     const IndexArray&   getIndices() const { return m_indices; }
+    //! Object space planes of the triangles, for the back face culling before the transformation.
+    const std::vector<math::Plane> &getFacePlanes() const { return m_facePlanes; }
+    //! Object space bounding box corners.
+    const math::vec3 &getBoundsMin() const { return m_boundsMin; }
+    const math::vec3 &getBoundsMax() const { return m_boundsMax; }
+    //! Clusters in the order of triangles, empty for the small buffers.
+    const std::vector<Cluster> &getClusters() const { return m_clusters; }
 
     //!
     const std::vector<math::vec2> &getUVs() const { return m_uvs; }
@@ -84,6 +84,8 @@ void Viewport::resize(int w, int h)
     m_camera->m_viewPlaneHeight = 2.0f / m_aspect;
 
     m_camera->m_distance = 0.5f * m_camera->m_viewPlaneWidth * (1.0f / tan(math::DegToRad(m_camera->m_fov / 2.0f)));
+
+    m_camera->buildProjection(m_width, m_height, m_aspect);
 }
 
 }
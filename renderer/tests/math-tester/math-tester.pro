@@ -11,10 +11,51 @@ SOURCES += main.cpp \
     test_math_utils.cpp \
     ../../math/math_utils.cpp \
     test_plane.cpp \
-    ../../math/plane.cpp
+    ../../math/plane.cpp \
+    test_triangle.cpp \
+    test_simd.cpp \
+    test_texture.cpp \
+    test_rasterizer.cpp \
+    test_indexarray.cpp \
+    test_scenetree.cpp \
+    test_meshsimplifier.cpp \
+    test_lighting.cpp \
+    test_terrain.cpp \
+    resourcemgr_stub.cpp \
+    ../../math/simd.cpp \
+    test_frustum.cpp \
+    ../../math/frustum.cpp \
+    ../../math/poly.cpp \
+    ../../math/vertex.cpp \
+    ../../rend/material.cpp \
+    ../../rend/light.cpp \
+    ../../rend/lighting.cpp \
+    ../../rend/texture.cpp \
+    ../../rend/color.cpp \
+    ../../rend/framebuffer.cpp \
+    ../../rend/software/trianglerasterizer.cpp \
+    ../../rend/software/flattrianglerasterizer.cpp \
+    ../../rend/scenetree.cpp \
+    ../../rend/sceneobject.cpp \
+    ../../rend/boundingsphere.cpp \
+    ../../rend/mesh.cpp \
+    ../../rend/vertexbuffer.cpp \
+    ../../rend/camera.cpp \
+    ../../rend/terrainsceneobject.cpp \
+    ../../rend/heightsource.cpp \
+    ../../rend/meshsimplifier.cpp \
+    ../../base/decoderobj.cpp \
+    ../../base/osfile.cpp \
+    ../../base/logger.cpp \
+    ../../comm/utils.cpp
 
-INCLUDEPATH += ../../math/ \
-               ../../comm/
+INCLUDEPATH += ../../ \
+               ../../math/ \
+               ../../comm/ \
+               ../../rend/ \
+               ../../base/
+
+DEFINES += RENDERER_LIBRARY
 
 SOURCES += ../../math/m33.cpp
 
@@ -26,5 +67,23 @@ HEADERS += \
     ../../math/m33.h \
     ../../math/m22.h \
     ../../math/math_utils.h \
-    ../../math/plane.h
+    ../../math/plane.h \
+    ../../math/poly.h \
+    ../../math/simd.h \
+    ../../math/frustum.h \
+    ../../rend/material.h \
+    ../../rend/light.h \
+    ../../rend/lighting.h \
+    ../../rend/texture.h \
+    ../../rend/indexarray.h \
+    ../../rend/scenetree.h \
+    ../../rend/sceneobject.h \
+    ../../rend/mesh.h \
+    ../../rend/meshsimplifier.h \
+    ../../rend/terrainsceneobject.h \
+    ../../base/decoderobj.h \
+    ../../rend/framebuffer.h \
+    ../../rend/software/trianglerasterizer.h \
+    ../../rend/software/flattrianglerasterizer.h \
+    ../../rend/software/texturedtrianglerasterizer.h
 
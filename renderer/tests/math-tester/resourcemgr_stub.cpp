@@ -0,0 +1,24 @@
+/*
+ * resourcemgr_stub.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include "stdafx.h"
+
+#include "resourcemgr.h"
+#include "resource.h"
+
+// Scene objects load their textures through the resource manager, which needs the platform image
+// decoders. Tests do not load resources, so nothing is found.
+
+namespace base
+{
+
+sptr(Resource) ResourceMgr::getResource(const std::string &/*name*/)
+{
+    return sptr(Resource)();
+}
+
+}
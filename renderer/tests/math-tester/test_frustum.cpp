@@ -0,0 +1,99 @@
+/*
+ * test_frustum.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "frustum.h"
+#include "m44.h"
+#include "vec3.h"
+
+using namespace math;
+
+namespace
+{
+
+// camera in the origin looks along Z, 90 degrees fov: x' = x, y' = y, w = z
+Frustum makeFrustum()
+{
+    M44 viewProjection(1.0f, 0.0f, 0.0f, 0.0f,
+                       0.0f, 1.0f, 0.0f, 0.0f,
+                       0.0f, 0.0f, 1.0f, 1.0f,
+                       0.0f, 0.0f, 0.0f, 0.0f);
+
+    Frustum f;
+    f.set(viewProjection, 5.0f, 1000.0f);
+    return f;
+}
+
+}
+
+TEST(Frustum, Default)
+{
+    Frustum f;
+
+    EXPECT_EQ(FRUSTUM_INTERSECT, f.testSphere(vec3(0.0f, 0.0f, 100.0f), 10.0f));
+    EXPECT_EQ(FRUSTUM_INTERSECT, f.testBox(vec3(0.0f, 0.0f, -100.0f), vec3(1.0f, 1.0f, 1.0f)));
+}
+
+TEST(Frustum, Planes)
+{
+    Frustum f = makeFrustum();
+
+    // normalized planes give euclidean distances
+    EXPECT_FLOAT_EQ(-50.0f / sqrt(2.0f), f.distance(Frustum::RIGHT, vec3(100.0f, 0.0f, 50.0f)));
+    EXPECT_FLOAT_EQ(95.0f, f.distance(Frustum::NEAR_PLANE, vec3(0.0f, 0.0f, 100.0f)));
+    EXPECT_FLOAT_EQ(900.0f, f.distance(Frustum::FAR_PLANE, vec3(0.0f, 0.0f, 100.0f)));
+}
+
+TEST(Frustum, Sphere)
+{
+    Frustum f = makeFrustum();
+
+    EXPECT_EQ(FRUSTUM_INSIDE, f.testSphere(vec3(0.0f, 0.0f, 100.0f), 10.0f));
+    EXPECT_EQ(FRUSTUM_OUTSIDE, f.testSphere(vec3(0.0f, 0.0f, -100.0f), 10.0f));     // behind
+    EXPECT_EQ(FRUSTUM_OUTSIDE, f.testSphere(vec3(100.0f, 0.0f, 50.0f), 10.0f));     // right
+    EXPECT_EQ(FRUSTUM_OUTSIDE, f.testSphere(vec3(0.0f, -100.0f, 50.0f), 10.0f));    // bottom
+    EXPECT_EQ(FRUSTUM_OUTSIDE, f.testSphere(vec3(0.0f, 0.0f, 1200.0f), 10.0f));     // far
+    EXPECT_EQ(FRUSTUM_INTERSECT, f.testSphere(vec3(50.0f, 0.0f, 50.0f), 10.0f));
+    EXPECT_EQ(FRUSTUM_INTERSECT, f.testSphere(vec3(0.0f, 0.0f, 0.0f), 10.0f));
+}
+
+TEST(Frustum, Spheres)
+{
+    Frustum f = makeFrustum();
+
+    // more than one SSE group and a tail, the same answers as one by one
+    const float x[] = { 0.0f, 0.0f, 100.0f, 0.0f, 0.0f, 50.0f, 0.0f };
+    const float y[] = { 0.0f, 0.0f, 0.0f, -100.0f, 0.0f, 0.0f, 0.0f };
+    const float z[] = { 100.0f, -100.0f, 50.0f, 50.0f, 1200.0f, 50.0f, 0.0f };
+    const float r[] = { 10.0f, 10.0f, 10.0f, 10.0f, 10.0f, 10.0f, 10.0f };
+    const size_t count = sizeof(x) / sizeof(x[0]);
+
+    FrustumRelation relations[count];
+    f.testSpheres(x, y, z, r, count, relations);
+
+    for (size_t i = 0; i < count; i++)
+        EXPECT_EQ(f.testSphere(vec3(x[i], y[i], z[i]), r[i]), relations[i]) << i;
+
+    EXPECT_EQ(FRUSTUM_INSIDE, relations[0]);
+    EXPECT_EQ(FRUSTUM_OUTSIDE, relations[4]);
+    EXPECT_EQ(FRUSTUM_INTERSECT, relations[6]);
+}
+
+TEST(Frustum, Box)
+{
+    Frustum f = makeFrustum();
+
+    EXPECT_EQ(FRUSTUM_INSIDE, f.testBox(vec3(0.0f, 0.0f, 100.0f), vec3(10.0f, 10.0f, 10.0f)));
+    EXPECT_EQ(FRUSTUM_OUTSIDE, f.testBox(vec3(0.0f, 0.0f, 3.0f), vec3(1.0f, 1.0f, 1.0f)));      // before near
+    EXPECT_EQ(FRUSTUM_INTERSECT, f.testBox(vec3(0.0f, 0.0f, 5.0f), vec3(1.0f, 1.0f, 1.0f)));
+
+    // corner of the box crosses the left plane, the sphere around it would too
+    EXPECT_EQ(FRUSTUM_INTERSECT, f.testBox(vec3(-45.0f, 0.0f, 50.0f), vec3(6.0f, 1.0f, 1.0f)));
+    EXPECT_EQ(FRUSTUM_INSIDE, f.testBox(vec3(-45.0f, 0.0f, 50.0f), vec3(1.0f, 1.0f, 1.0f)));
+}
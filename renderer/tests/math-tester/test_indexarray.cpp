@@ -0,0 +1,97 @@
+/*
+ * test_indexarray.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "indexarray.h"
+
+using namespace rend;
+
+TEST(IndexArray, PushBackWidens)
+{
+    IndexArray indices;
+    EXPECT_TRUE(indices.empty());
+    EXPECT_FALSE(indices.wide());
+    EXPECT_EQ(0, indices.data<uint16_t>());
+
+    for (uint32_t i = IndexArray::SHORT_MAX - 2; i <= IndexArray::SHORT_MAX; i++)
+        indices.push_back(i);
+
+    EXPECT_FALSE(indices.wide());
+    EXPECT_EQ(sizeof(uint16_t), indices.bytesPerIndex());
+    ASSERT_EQ(3u, indices.size());
+    EXPECT_EQ(0xffffu, indices.data<uint16_t>()[2]);
+
+    // 0x10000 does not fit 16 bits
+    indices.push_back(0x10000);
+    indices.push_back(7);
+
+    EXPECT_TRUE(indices.wide());
+    EXPECT_EQ(sizeof(uint32_t), indices.bytesPerIndex());
+    ASSERT_EQ(5u, indices.size());
+
+    // old indices are kept
+    const uint32_t expected[] = { 0xfffd, 0xfffe, 0xffff, 0x10000, 7 };
+    const uint32_t *data = indices.data<uint32_t>();
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        EXPECT_EQ(expected[i], indices[i]);
+        EXPECT_EQ(expected[i], data[i]);
+    }
+
+    indices.clear();
+    EXPECT_TRUE(indices.empty());
+    EXPECT_FALSE(indices.wide());
+}
+
+TEST(IndexArray, AssignChoosesWidth)
+{
+    std::vector<uint32_t> small = { 0, 1, 2, IndexArray::SHORT_MAX };
+    IndexArray narrow(small.begin(), small.end());
+
+    EXPECT_FALSE(narrow.wide());
+    ASSERT_EQ(small.size(), narrow.size());
+    for (size_t i = 0; i < small.size(); i++)
+        EXPECT_EQ(small[i], narrow.data<uint16_t>()[i]);
+
+    // the big index is the last one
+    std::vector<uint32_t> big = { 0, 1, 2, IndexArray::SHORT_MAX + 1 };
+    IndexArray wide(big.begin(), big.end());
+
+    EXPECT_TRUE(wide.wide());
+    ASSERT_EQ(big.size(), wide.size());
+    for (size_t i = 0; i < big.size(); i++)
+        EXPECT_EQ(big[i], wide.data<uint32_t>()[i]);
+
+    // reassigning narrows again
+    wide.assign(small.begin(), small.end());
+    EXPECT_FALSE(wide.wide());
+    EXPECT_EQ(small.size(), wide.size());
+    EXPECT_EQ(0xffffu, wide[3]);
+}
+
+TEST(IndexArray, Swap)
+{
+    std::vector<uint32_t> small = { 3, 4, 5 };
+    std::vector<uint32_t> big = { 100000, 1 };
+
+    IndexArray a(small.begin(), small.end());
+    IndexArray b(big.begin(), big.end());
+
+    a.swap(b);
+
+    EXPECT_TRUE(a.wide());
+    ASSERT_EQ(2u, a.size());
+    EXPECT_EQ(100000u, a[0]);
+    EXPECT_EQ(1u, a.data<uint32_t>()[1]);
+
+    EXPECT_FALSE(b.wide());
+    ASSERT_EQ(3u, b.size());
+    EXPECT_EQ(5u, b[2]);
+    EXPECT_EQ(3u, b.data<uint16_t>()[0]);
+}
@@ -0,0 +1,163 @@
+/*
+ * test_lighting.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "lighting.h"
+#include "light.h"
+#include "material.h"
+
+using namespace rend;
+
+namespace
+{
+
+float random(float from, float to)
+{
+    return from + (to - from) * (rand() / (float)RAND_MAX);
+}
+
+math::vec3 randomNormal()
+{
+    math::vec3 n;
+    do
+    {
+        n = math::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f));
+    } while (n.dotProduct(n) < 0.01f);
+
+    return n.normalize();
+}
+
+//! Base color plus every light one by one, as Light::shade does.
+Color3 reference(const Lighting::Lights &lights, const Material &material,
+                 const math::vec3 &normal, const math::vec3 &point, const Color3 &base)
+{
+    Color3 color = base;
+    for (const auto &light : lights)
+        light->shade(material, normal, point, color);
+
+    return color;
+}
+
+//! Lights round every term down to the integer, Lighting rounds once.
+void expectClose(const Color3 &expected, const Color3 &actual, int tolerance, size_t point)
+{
+    const ColorComp comps[] = { RED, GREEN, BLUE };
+    for (ColorComp c : comps)
+        EXPECT_NEAR((int)expected[c], (int)actual[c], tolerance) << "point " << point << ", component " << c;
+}
+
+}
+
+TEST(Lighting, MatchesLights)
+{
+    srand(3);
+
+    Material material;
+    material.ambientColor = Color3(200, 150, 100);
+    material.diffuseColor = Color3(120, 180, 240);
+
+    Lighting::Lights lights;
+    lights.push_back(std::make_shared<AmbientLight>(Color3(30, 40, 50)));
+    lights.push_back(std::make_shared<AmbientLight>(Color3(10, 0, 20)));
+    lights.push_back(std::make_shared<DirectionalLight>(Color3(60, 70, 80), math::vec3(1, 2, -1)));
+    lights.push_back(std::make_shared<DirectionalLight>(Color3(50, 20, 10), math::vec3(-1, 0, 1)));
+    lights.push_back(std::make_shared<PointLight>(Color3(90, 60, 30), math::vec3(3, 5, 0), 1.0f, 0.05f, 0.001f));
+    lights.push_back(std::make_shared<PointLight>(Color3(20, 80, 40), math::vec3(-6, 0, 4), 0.5f, 0.1f, 0.0f));
+
+    // the light, which is off, is skipped by both
+    auto off = std::make_shared<DirectionalLight>(Color3(255, 255, 255), math::vec3(0, 0, 1));
+    off->turnoff();
+    lights.push_back(off);
+
+    Lighting lighting;
+    lighting.set(lights);
+    ASSERT_TRUE(lighting.enabled());
+
+    const int tolerance = (int)lights.size();
+
+    // full groups of four and the tails of 1, 2 and 3 points
+    const size_t counts[] = { 1, 2, 3, 4, 5, 6, 7, 13, Lighting::MAX_POINTS };
+    for (size_t count : counts)
+    {
+        // exactly count points, the tail must not read past them
+        std::vector<float> nx(count), ny(count), nz(count), px(count), py(count), pz(count);
+        std::vector<Color3> base(count), out(count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            math::vec3 n = randomNormal();
+            nx[i] = n.x;
+            ny[i] = n.y;
+            nz[i] = n.z;
+            px[i] = random(-10.0f, 10.0f);
+            py[i] = random(-10.0f, 10.0f);
+            pz[i] = random(-10.0f, 10.0f);
+            base[i] = Color3(rand() % 60, rand() % 60, rand() % 60);
+        }
+
+        lighting.shade(material, nx.data(), ny.data(), nz.data(), px.data(), py.data(), pz.data(),
+                       base.data(), count, out.data());
+
+        for (size_t i = 0; i < count; i++)
+        {
+            math::vec3 n(nx[i], ny[i], nz[i]), p(px[i], py[i], pz[i]);
+
+            Color3 expected = reference(lights, material, n, p, base[i]);
+            expectClose(expected, out[i], tolerance, i);
+
+            // one point path gives the same color
+            Color3 single = Lighting::add(base[i], lighting.reflected(material, n, p));
+            expectClose(single, out[i], 1, i);
+        }
+    }
+}
+
+TEST(Lighting, SingleClamp)
+{
+    Material material;
+    material.ambientColor = Color3(255, 128, 0);
+    material.diffuseColor = Color3(255, 128, 0);
+
+    Lighting::Lights lights;
+    lights.push_back(std::make_shared<AmbientLight>(Color3(200, 200, 200)));
+    lights.push_back(std::make_shared<DirectionalLight>(Color3(200, 200, 200), math::vec3(0, 0, 1)));
+
+    Lighting lighting;
+    lighting.set(lights);
+
+    math::vec3 normal(0, 0, 1), point(0, 0, 0);
+
+    // the reflected light is not clamped
+    Lighting::LightColor light = lighting.reflected(material, normal, point);
+    EXPECT_NEAR(2 * 200 * 255 / 256.0f, light.r, 1e-2f);
+    EXPECT_NEAR(2 * 200 * 128 / 256.0f, light.g, 1e-2f);
+    EXPECT_NEAR(0.0f, light.b, 1e-2f);
+
+    // only the sum with the base color is clamped
+    float nx = normal.x, ny = normal.y, nz = normal.z;
+    float px = point.x, py = point.y, pz = point.z;
+    Color3 base(100, 100, 100), out;
+    lighting.shade(material, &nx, &ny, &nz, &px, &py, &pz, &base, 1, &out);
+
+    EXPECT_EQ(255u, out[RED]);
+    EXPECT_EQ(255u, out[GREEN]);
+    EXPECT_EQ(100u, out[BLUE]);
+
+    Color3 expected = reference(lights, material, normal, point, base);
+    expectClose(expected, out, (int)lights.size(), 0);
+
+    // nothing is lit, when the lights are off
+    for (const auto &l : lights)
+        l->turnoff();
+    lighting.set(lights);
+    EXPECT_FALSE(lighting.enabled());
+
+    lighting.shade(material, &nx, &ny, &nz, &px, &py, &pz, &base, 1, &out);
+    EXPECT_EQ(base.color(), out.color());
+}
@@ -0,0 +1,294 @@
+/*
+ * test_meshsimplifier.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "meshsimplifier.h"
+#include "mesh.h"
+#include "decoderobj.h"
+
+using namespace rend;
+
+namespace
+{
+
+const float EPSILON = 1e-4f;
+//! Border planes are weighted, not fixed, so the border vertices may leave them a little.
+const float BORDER_EPSILON = 1e-3f;
+
+//! Adds the grid of size x size quads, which spans a0 * u + a1 * v for u, v in [0, 1] from the origin.
+//! Vertices on the grid sides are shared with the vertices, which are already there.
+void appendGrid(std::vector<math::vertex> &vertices, std::vector<int> &indices, int size,
+                const math::vec3 &origin, const math::vec3 &a0, const math::vec3 &a1,
+                const std::function<float(float, float)> &height = std::function<float(float, float)>())
+{
+    math::vec3 normal = a0.crossProduct(a1).normalize();
+    std::vector<int> grid((size + 1) * (size + 1));
+    size_t shared = vertices.size();
+
+    for (int j = 0; j <= size; j++)
+    {
+        for (int i = 0; i <= size; i++)
+        {
+            float u = (float)i / size, v = (float)j / size;
+            math::vec3 p = origin + a0 * u + a1 * v;
+            if (height)
+                p += normal * height(u, v);
+
+            auto same = std::find_if(vertices.begin(), vertices.begin() + shared,
+                                     [&](const math::vertex &vert) { return (vert.p - p).dotProduct(vert.p - p) < EPSILON * EPSILON; });
+
+            if (same == vertices.begin() + shared)
+            {
+                math::vertex vert;
+                vert.p = p;
+                vert.n = normal;
+                grid[j * (size + 1) + i] = (int)vertices.size();
+                vertices.push_back(vert);
+            }
+            else
+                grid[j * (size + 1) + i] = (int)(same - vertices.begin());
+        }
+    }
+
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            int v00 = grid[j * (size + 1) + i], v10 = grid[j * (size + 1) + i + 1];
+            int v01 = grid[(j + 1) * (size + 1) + i], v11 = grid[(j + 1) * (size + 1) + i + 1];
+
+            int quad[6] = { v00, v10, v11, v00, v11, v01 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+VertexBuffer makeBuffer(const std::vector<math::vertex> &vertices, const std::vector<int> &indices)
+{
+    VertexBuffer vb(VertexBuffer::INDEXEDTRIANGLELIST);
+    vb.appendVertices(vertices, indices, true);
+    vb.setMaterial(std::make_shared<Material>());
+    return vb;
+}
+
+//! Closed box [-1, 1]^3 of 6 grids, faces are counter-clockwise from the outside.
+VertexBuffer makeBox(int size)
+{
+    std::vector<math::vertex> vertices;
+    std::vector<int> indices;
+
+    const math::vec3 x(2, 0, 0), y(0, 2, 0), z(0, 0, 2);
+    const math::vec3 o(-1, -1, -1);
+
+    appendGrid(vertices, indices, size, o, y, x);           // z = -1
+    appendGrid(vertices, indices, size, o + z, x, y);       // z = 1
+    appendGrid(vertices, indices, size, o, x, z);           // y = -1
+    appendGrid(vertices, indices, size, o + y, z, x);       // y = 1
+    appendGrid(vertices, indices, size, o, z, y);           // x = -1
+    appendGrid(vertices, indices, size, o + x, y, z);       // x = 1
+
+    return makeBuffer(vertices, indices);
+}
+
+//! Bumpy open grid [0, 1]^2 in the XY plane, faces look along +Z.
+VertexBuffer makeTerrain(int size)
+{
+    std::vector<math::vertex> vertices;
+    std::vector<int> indices;
+
+    appendGrid(vertices, indices, size, math::vec3(0, 0, 0), math::vec3(1, 0, 0), math::vec3(0, 1, 0),
+               [](float u, float v) { return 0.05f * sin(u * 9.0f) * cos(v * 7.0f); });
+
+    return makeBuffer(vertices, indices);
+}
+
+math::vec3 faceNormal(const VertexBuffer &vb, int face)
+{
+    const math::vec3 &p0 = vb.vertex(vb.index(face * 3)).p;
+    const math::vec3 &p1 = vb.vertex(vb.index(face * 3 + 1)).p;
+    const math::vec3 &p2 = vb.vertex(vb.index(face * 3 + 2)).p;
+
+    return (p1 - p0).crossProduct(p2 - p0);
+}
+
+bool onBorder(const math::vec3 &p)
+{
+    return fabs(p.x) < BORDER_EPSILON || fabs(p.x - 1.0f) < BORDER_EPSILON
+        || fabs(p.y) < BORDER_EPSILON || fabs(p.y - 1.0f) < BORDER_EPSILON;
+}
+
+//! Triangles as sorted triples of the vertex positions, the order of triangles does not matter.
+std::vector<std::vector<float> > triangles(const VertexBuffer &vb)
+{
+    std::vector<std::vector<float> > res;
+
+    for (int i = 0; i < vb.numIndices(); i += 3)
+    {
+        std::vector<float> t;
+        for (int k = 0; k < 3; k++)
+        {
+            const math::vec3 &p = vb.vertex(vb.index(i + k)).p;
+            t.push_back(p.x);
+            t.push_back(p.y);
+            t.push_back(p.z);
+        }
+        res.push_back(t);
+    }
+
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+}
+
+TEST(MeshSimplifier, ClosedMesh)
+{
+    VertexBuffer box = makeBox(8);
+    ASSERT_EQ(6 * 8 * 8 * 2, box.numIndices() / 3);
+    ASSERT_EQ(6 * 8 * 8 + 2, box.numVertices());
+
+    MeshSimplifier simplifier(box);
+
+    // 12 triangles are the least box, the last collapses may move the corners
+    const size_t targets[] = { 400, 100, 12 };
+    for (size_t target : targets)
+    {
+        simplifier.simplify(target);
+        EXPECT_LE(simplifier.numTriangles(), target);
+
+        // flat sides collapse without error
+        if (target > 12)
+        {
+            EXPECT_LT(simplifier.error(), 1e-2f) << "target " << target;
+        }
+
+        VertexBuffer result;
+        simplifier.result(result);
+        ASSERT_EQ(simplifier.numTriangles() * 3, (size_t)result.numIndices());
+
+        // the box is convex, so every triangle looks away from the center
+        for (int face = 0; face < result.numIndices() / 3; face++)
+        {
+            math::vec3 center = result.vertex(result.index(face * 3)).p;
+            EXPECT_GT(faceNormal(result, face).dotProduct(center), 0.0f) << "target " << target << ", face " << face;
+        }
+
+        // every edge is still shared by two triangles
+        std::map<std::pair<int, int>, int> edges;
+        for (int i = 0; i < result.numIndices(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                int a = result.index(i + k), b = result.index(i + (k + 1) % 3);
+                edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+            }
+        }
+        for (const auto &edge : edges)
+            EXPECT_EQ(2, edge.second);
+    }
+}
+
+TEST(MeshSimplifier, OpenGrid)
+{
+    const int SIZE = 24;
+
+    VertexBuffer terrain = makeTerrain(SIZE);
+    MeshSimplifier simplifier(terrain);
+
+    const size_t target = SIZE * SIZE * 2 / 4;
+    simplifier.simplify(target);
+    EXPECT_LE(simplifier.numTriangles(), target);
+
+    VertexBuffer result;
+    simplifier.result(result);
+
+    std::map<std::pair<int, int>, int> edges;
+    for (int face = 0; face < result.numIndices() / 3; face++)
+    {
+        // no triangle is flipped
+        EXPECT_GT(faceNormal(result, face).z, 0.0f) << "face " << face;
+
+        for (int k = 0; k < 3; k++)
+        {
+            int a = result.index(face * 3 + k), b = result.index(face * 3 + (k + 1) % 3);
+            edges[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+
+    // border vertices stay on the border planes, so the outline is kept
+    int borderEdges = 0;
+    for (const auto &edge : edges)
+    {
+        if (edge.second != 1)
+            continue;
+
+        borderEdges++;
+        const math::vec3 &a = result.vertex(edge.first.first).p;
+        const math::vec3 &b = result.vertex(edge.first.second).p;
+
+        EXPECT_TRUE(onBorder(a));
+        EXPECT_TRUE(onBorder(b));
+        EXPECT_TRUE(fabs(a.x - b.x) < 2 * BORDER_EPSILON || fabs(a.y - b.y) < 2 * BORDER_EPSILON);
+    }
+    EXPECT_GE(borderEdges, 4);
+
+    for (const auto &v : result.getVertices())
+    {
+        EXPECT_GE(v.p.x, -BORDER_EPSILON);
+        EXPECT_LE(v.p.x, 1.0f + BORDER_EPSILON);
+        EXPECT_GE(v.p.y, -BORDER_EPSILON);
+        EXPECT_LE(v.p.y, 1.0f + BORDER_EPSILON);
+    }
+}
+
+TEST(MeshSimplifier, LodCache)
+{
+    const std::string path = ::testing::TempDir() + "meshsimplifier.lod";
+    const uint64_t HASH = 0x1234567890abcdefULL;
+
+    Mesh mesh;
+    mesh.appendSubmesh(makeTerrain(32));
+    MeshSimplifier::buildLods(mesh);
+    ASSERT_GT(mesh.numLods(), 0u);
+
+    // a level with more than 0xffff vertices is stored with 32 bit indices
+    auto wide = std::make_shared<Mesh>();
+    wide->appendSubmesh(makeTerrain(260));
+    ASSERT_TRUE(wide->getSubmeshes().front().hasWideIndices());
+    mesh.addLod(wide, 0.5f);
+    ASSERT_FALSE(mesh.getLod(0)->getSubmeshes().front().hasWideIndices());
+
+    base::DecoderOBJ::saveLods(mesh, path, HASH);
+
+    Mesh loaded;
+    loaded.appendSubmesh(mesh.getSubmeshes().front());
+    ASSERT_TRUE(base::DecoderOBJ::loadLods(loaded, path, HASH));
+    ASSERT_EQ(mesh.numLods(), loaded.numLods());
+
+    for (size_t level = 0; level < mesh.numLods(); level++)
+    {
+        const VertexBuffer &a = mesh.getLod(level)->getSubmeshes().front();
+        const VertexBuffer &b = loaded.getLod(level)->getSubmeshes().front();
+
+        EXPECT_FLOAT_EQ(mesh.getLodError(level), loaded.getLodError(level));
+        EXPECT_EQ(a.hasWideIndices(), b.hasWideIndices());
+        EXPECT_EQ(a.numVertices(), b.numVertices());
+        EXPECT_EQ(a.numIndices(), b.numIndices());
+        EXPECT_TRUE(triangles(a) == triangles(b)) << "level " << level;
+        EXPECT_EQ(mesh.getSubmeshes().front().getMaterial(), b.getMaterial());
+    }
+
+    // the model has changed since the cache was written
+    Mesh stale;
+    stale.appendSubmesh(mesh.getSubmeshes().front());
+    EXPECT_FALSE(base::DecoderOBJ::loadLods(stale, path, HASH + 1));
+    EXPECT_EQ(0u, stale.numLods());
+
+    remove(path.c_str());
+}
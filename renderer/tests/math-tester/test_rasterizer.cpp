@@ -0,0 +1,210 @@
+/*
+ * test_rasterizer.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "poly.h"
+#include "framebuffer.h"
+#include "software/flattrianglerasterizer.h"
+#include "software/texturedtrianglerasterizer.h"
+
+using namespace rend;
+
+namespace
+{
+
+const int SIZE = 64;
+//! Triangles are drawn tile by tile, as SoftwareRenderer does.
+const int TILE = 16;
+
+//! Exposes the edge setup, so the tests know which stepping path is taken.
+struct SetupProbe : public TriangleRasterizer
+{
+    bool wide(const math::Triangle &t) const
+    {
+        TriangleSetup s;
+        return setup(t, ScreenRect(0, 0, SIZE, SIZE), s) && s.wide;
+    }
+
+    void drawTriangle(const math::Triangle &, FrameBuffer *, const ScreenRect &) { }
+};
+
+math::Triangle makeTriangle(const math::vec3 &a, const math::vec3 &b, const math::vec3 &c, const Material &material)
+{
+    math::vertex v[3];
+    v[0].p = a;
+    v[1].p = b;
+    v[2].p = c;
+
+    math::Triangle t(v);
+    t.setMaterial(material.handle());
+    return t;
+}
+
+//! Draws the triangles in the given order, each one nearer than the previous ones, so a pixel covered
+//! twice passes the depth test again and is counted as a duplicate write.
+void draw(std::vector<math::Triangle> &triangles, FrameBuffer &fb)
+{
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        float z = 1000.0f / (i + 1);
+        for (int k = 0; k < 3; k++)
+            triangles[i].v(k).p.z = z;
+    }
+
+    FlatTriangleRasterizer rasterizer;
+
+    for (int y = 0; y < SIZE; y += TILE)
+        for (int x = 0; x < SIZE; x += TILE)
+            for (const auto &t : triangles)
+                rasterizer.drawTriangle(t, &fb, ScreenRect(x, y, x + TILE, y + TILE));
+}
+
+void expectCoveredOnce(FrameBuffer &fb)
+{
+    EXPECT_EQ(0, fb.duplicateWrites());
+
+    const uint8_t *coverage = fb.coverage();
+    for (int i = 0; i < SIZE * SIZE; i++)
+        ASSERT_EQ(1, coverage[i]) << "pixel " << i % SIZE << ", " << i / SIZE;
+}
+
+}
+
+TEST(Rasterizer, SharedEdgesOfGrid)
+{
+    const int CELLS = 10;
+    const float CELL = 7.3f;
+
+    Material material;
+    FrameBuffer fb(SIZE, SIZE);
+    fb.setCoverageTest(true);
+    fb.clear();
+
+    // jittered grid larger than the screen, vertices are off the sub-pixel grid
+    srand(7);
+    std::vector<math::vec3> points;
+    for (int j = 0; j <= CELLS; j++)
+    {
+        for (int i = 0; i <= CELLS; i++)
+        {
+            float jx = (rand() % 1000 - 500) / 400.0f;
+            float jy = (rand() % 1000 - 500) / 400.0f;
+            points.push_back(math::vec3(i * CELL - 4.0f + jx, j * CELL - 4.0f + jy, 0.0f));
+        }
+    }
+
+    // cells are split by alternating diagonals, so edges of all directions are shared
+    std::vector<math::Triangle> triangles;
+    for (int j = 0; j < CELLS; j++)
+    {
+        for (int i = 0; i < CELLS; i++)
+        {
+            const math::vec3 &p00 = points[j * (CELLS + 1) + i];
+            const math::vec3 &p10 = points[j * (CELLS + 1) + i + 1];
+            const math::vec3 &p01 = points[(j + 1) * (CELLS + 1) + i];
+            const math::vec3 &p11 = points[(j + 1) * (CELLS + 1) + i + 1];
+
+            if ((i + j) % 2)
+            {
+                triangles.push_back(makeTriangle(p00, p10, p11, material));
+                triangles.push_back(makeTriangle(p00, p11, p01, material));
+            }
+            else
+            {
+                triangles.push_back(makeTriangle(p00, p10, p01, material));
+                triangles.push_back(makeTriangle(p10, p11, p01, material));
+            }
+        }
+    }
+
+    // axis aligned edges with the pixel centers exactly on them
+    triangles.push_back(makeTriangle(math::vec3(0.5f, 0.5f, 0), math::vec3(8.5f, 0.5f, 0), math::vec3(0.5f, 8.5f, 0), material));
+
+    SetupProbe probe;
+    for (const auto &t : triangles)
+        ASSERT_FALSE(probe.wide(t));
+
+    // the extra triangle overlaps the grid, it is drawn into own buffer
+    math::Triangle corner = triangles.back();
+    triangles.pop_back();
+
+    draw(triangles, fb);
+    expectCoveredOnce(fb);
+
+    std::vector<math::Triangle> halves = { corner,
+                                           makeTriangle(math::vec3(8.5f, 0.5f, 0), math::vec3(8.5f, 8.5f, 0), math::vec3(0.5f, 8.5f, 0), material) };
+    fb.clear();
+    draw(halves, fb);
+    EXPECT_EQ(0, fb.duplicateWrites());
+
+    const uint8_t *coverage = fb.coverage();
+    for (int y = 0; y < SIZE; y++)
+    {
+        for (int x = 0; x < SIZE; x++)
+        {
+            // pixels with centers in [0.5, 8.5) x [0.5, 8.5)
+            int expected = (x < 8 && y < 8) ? 1 : 0;
+            ASSERT_EQ(expected, coverage[y * SIZE + x]) << "pixel " << x << ", " << y;
+        }
+    }
+}
+
+TEST(Rasterizer, SharedEdgesOfWideFan)
+{
+    const float RADIUS = 400000.0f;
+    // spokes along the rows, the columns and the diagonals, so they run through the pixel centers
+    const int SECTORS = 8;
+    const float dirs[SECTORS][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+
+    Material material;
+    FrameBuffer fb(SIZE, SIZE);
+    fb.setCoverageTest(true);
+    fb.clear();
+
+    // edges are too long for the 32-bit stepping
+    math::vec3 center(31.5f, 29.5f, 0.0f);
+    std::vector<math::Triangle> triangles;
+    for (int i = 0; i < SECTORS; i++)
+    {
+        const float *a = dirs[i], *b = dirs[(i + 1) % SECTORS];
+        triangles.push_back(makeTriangle(center,
+                                         center + math::vec3(a[0], a[1], 0.0f) * RADIUS,
+                                         center + math::vec3(b[0], b[1], 0.0f) * RADIUS,
+                                         material));
+    }
+
+    SetupProbe probe;
+    for (const auto &t : triangles)
+        ASSERT_TRUE(probe.wide(t));
+
+    draw(triangles, fb);
+    expectCoveredOnce(fb);
+}
+
+TEST(Rasterizer, AffineMappingError)
+{
+    // depths 1 and 4: the perspective u = s / (4 - 3s) is behind the affine u = s by 1/3 at s = 2/3
+    EXPECT_NEAR(1.0f / 3.0f, TexturedTriangleRasterizer::affineMappingError(4.0f), 1e-6f);
+    EXPECT_FLOAT_EQ(0.0f, TexturedTriangleRasterizer::affineMappingError(1.0f));
+
+    // the bound is the max difference of the two mappings of u from 0 to 1 between depths 1 and r
+    const float ratios[] = { 1.01f, 1.5f, 2.0f, 4.0f, 10.0f, 100.0f };
+    for (float r : ratios)
+    {
+        float maxError = 0.0f;
+        for (int i = 0; i <= 10000; i++)
+        {
+            float s = i / 10000.0f;
+            float u = s / r / ((1.0f - s) + s / r);
+            maxError = std::max(maxError, fabsf(u - s));
+        }
+
+        EXPECT_NEAR(maxError, TexturedTriangleRasterizer::affineMappingError(r), 1e-4f) << "r " << r;
+    }
+}
@@ -0,0 +1,229 @@
+/*
+ * test_scenetree.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "scenetree.h"
+#include "sceneobject.h"
+#include "m44.h"
+
+using namespace rend;
+
+namespace
+{
+
+//! Object with a sphere around its position instead of a mesh.
+class Ball : public SceneObject
+{
+    float m_radius;
+
+public:
+    Ball(const math::vec3 &position, float radius) : m_radius(radius) { setPosition(position); }
+
+    BoundingSphere bsphere() const { return BoundingSphere(getPosition(), m_radius); }
+    float radius() const { return m_radius; }
+};
+
+//! Scene objects with their insertion order.
+struct Entry
+{
+    sptr(Ball) ball;
+    size_t order;
+};
+
+float random(float from, float to)
+{
+    return from + (to - from) * (rand() / (float)RAND_MAX);
+}
+
+math::vec3 randomPoint()
+{
+    return math::vec3(random(-600.0f, 600.0f), random(-600.0f, 600.0f), random(-200.0f, 1200.0f));
+}
+
+// camera in the origin looks along Z, 90 degrees fov
+math::Frustum makeFrustum()
+{
+    math::M44 viewProjection(1.0f, 0.0f, 0.0f, 0.0f,
+                             0.0f, 1.0f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 1.0f,
+                             0.0f, 0.0f, 0.0f, 0.0f);
+
+    math::Frustum f;
+    f.set(viewProjection, 5.0f, 1000.0f);
+    return f;
+}
+
+//! Tree culling gives the same objects in the same order as the sphere test of every object.
+void expectCulled(const SceneTree &tree, const std::vector<Entry> &entries, const math::Frustum &frustum)
+{
+    std::vector<SceneTree::Visible> visible;
+    tree.cull(frustum, visible);
+
+    std::vector<const Entry *> expected;
+    for (const auto &e : entries)
+    {
+        BoundingSphere sphere = e.ball->bsphere();
+        if (frustum.testSphere(sphere.center(), sphere.radius()) != math::FRUSTUM_OUTSIDE)
+            expected.push_back(&e);
+    }
+    std::sort(expected.begin(), expected.end(), [](const Entry *a, const Entry *b) { return a->order < b->order; });
+
+    ASSERT_EQ(expected.size(), visible.size());
+    for (size_t i = 0; i < visible.size(); i++)
+    {
+        ASSERT_EQ(expected[i]->ball.get(), visible[i].object->get());
+
+        BoundingSphere sphere = expected[i]->ball->bsphere();
+        EXPECT_EQ(frustum.testSphere(sphere.center(), sphere.radius()), visible[i].relation);
+    }
+}
+
+bool overlaps(const math::vec3 &aMin, const math::vec3 &aMax, const math::vec3 &bMin, const math::vec3 &bMax)
+{
+    return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z
+        && bMin.x <= aMax.x && bMin.y <= aMax.y && bMin.z <= aMax.z;
+}
+
+//! Box query finds every object, which box intersects the query box. Others may be found
+//! only because of the box margin, which is less than 20% of the radius.
+void expectQueried(const SceneTree &tree, const std::vector<Entry> &entries, const math::vec3 &min, const math::vec3 &max)
+{
+    std::vector<sptr(SceneObject)> found;
+    tree.query(min, max, found);
+
+    std::vector<SceneObject *> foundObjects;
+    for (const auto &obj : found)
+        foundObjects.push_back(obj.get());
+    std::sort(foundObjects.begin(), foundObjects.end());
+    ASSERT_TRUE(std::adjacent_find(foundObjects.begin(), foundObjects.end()) == foundObjects.end());
+
+    for (const auto &e : entries)
+    {
+        math::vec3 c = e.ball->getPosition();
+        float r = e.ball->radius();
+        bool isFound = std::binary_search(foundObjects.begin(), foundObjects.end(), e.ball.get());
+
+        math::vec3 tight(r, r, r), loose(1.2f * r, 1.2f * r, 1.2f * r);
+
+        if (overlaps(c - tight, c + tight, min, max))
+        {
+            EXPECT_TRUE(isFound);
+        }
+        else if (!overlaps(c - loose, c + loose, min, max))
+        {
+            EXPECT_FALSE(isFound);
+        }
+    }
+}
+
+}
+
+TEST(SceneTree, Balanced)
+{
+    const int OBJECTS = 4096;
+
+    SceneTree tree;
+    std::vector<sptr(Ball)> balls;
+
+    // sorted positions are the worst case for the insertion without rotations
+    for (int i = 0; i < OBJECTS; i++)
+    {
+        balls.push_back(std::make_shared<Ball>(math::vec3(i * 10.0f, 0.0f, 0.0f), 1.0f));
+        tree.insert(balls.back());
+    }
+
+    EXPECT_EQ(size_t(OBJECTS), tree.size());
+    // log2(4096) = 12, the rotations keep the height close to it
+    EXPECT_LE(tree.height(), 2 * 12);
+
+    for (int i = 0; i < OBJECTS; i += 2)
+        tree.remove(balls[i]);
+
+    EXPECT_EQ(size_t(OBJECTS / 2), tree.size());
+    EXPECT_LE(tree.height(), 2 * 11);
+}
+
+TEST(SceneTree, RandomOperations)
+{
+    const int OBJECTS = 500;
+    const int STEPS = 200;
+
+    srand(12345);
+
+    SceneTree tree;
+    math::Frustum frustum = makeFrustum();
+
+    std::vector<Entry> entries;
+    size_t nextOrder = 0;
+
+    auto insert = [&]()
+    {
+        Entry e = { std::make_shared<Ball>(randomPoint(), random(1.0f, 40.0f)), nextOrder++ };
+        tree.insert(e.ball);
+        entries.push_back(e);
+    };
+
+    for (int i = 0; i < OBJECTS; i++)
+        insert();
+
+    for (int step = 0; step < STEPS; step++)
+    {
+        for (int op = 0; op < 20; op++)
+        {
+            size_t index = rand() % entries.size();
+            Ball &ball = *entries[index].ball;
+
+            switch (rand() % 5)
+            {
+            case 0:
+                insert();
+                break;
+
+            case 1:
+                if (entries.size() > 1)
+                {
+                    tree.remove(entries[index].ball);
+                    entries.erase(entries.begin() + index);
+                }
+                break;
+
+            case 2:
+                // stays inside of the enlarged box
+                ball.setPosition(ball.getPosition() + math::vec3(random(-0.01f, 0.01f), 0.0f, 0.0f) * ball.radius());
+                break;
+
+            case 3:
+                ball.setPosition(ball.getPosition() + math::vec3(random(-50.0f, 50.0f), random(-50.0f, 50.0f), random(-50.0f, 50.0f)));
+                break;
+
+            default:
+                ball.setPosition(randomPoint());
+                break;
+            }
+        }
+
+        tree.update();
+        ASSERT_EQ(entries.size(), tree.size());
+
+        expectCulled(tree, entries, frustum);
+
+        math::vec3 corner = randomPoint();
+        math::vec3 size(random(10.0f, 300.0f), random(10.0f, 300.0f), random(10.0f, 300.0f));
+        expectQueried(tree, entries, corner, corner + size);
+    }
+
+    // default frustum does not reject anything
+    expectCulled(tree, entries, math::Frustum());
+
+    int n = (int)entries.size();
+    int log2n = 0;
+    while ((1 << log2n) < n)
+        log2n++;
+    EXPECT_LE(tree.height(), 2 * log2n);
+}
@@ -0,0 +1,222 @@
+/*
+ * test_simd.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "stdafx.h"
+#include "simd.h"
+#include "m33.h"
+#include "m44.h"
+#include "vertex.h"
+
+using namespace math;
+
+namespace
+{
+
+// odd count, so the wide loop, the 4-wide loop and the scalar tail are all used
+const size_t POINTS = 1003;
+
+std::vector<vertex> randomVertices(size_t count)
+{
+    std::vector<vertex> res(count);
+    srand(42);
+
+    for (auto &v : res)
+    {
+        v.p.set((rand() % 2001 - 1000) * 0.1f, (rand() % 2001 - 1000) * 0.1f, (rand() % 2001 - 1000) * 0.1f);
+        v.n.set((rand() % 201 - 100) * 0.01f, (rand() % 201 - 100) * 0.01f, (rand() % 201 - 100) * 0.01f);
+    }
+
+    return res;
+}
+
+M44 someTransform()
+{
+    M33 rot = M33::getRotateYMatrix(0.3f) * M33::getRotateXMatrix(-1.1f);
+    rot *= 2.5f;
+
+    return M44(rot, vec3(10.0f, -20.0f, 150.0f));
+}
+
+// same as rend::Camera::clipFlags()
+int clipFlags(float x, float y, float w, float nearW)
+{
+    int flags = w < nearW ? CLIP_PLANE_NEAR : 0;
+
+    if (x < -w)
+        flags |= CLIP_PLANE_LEFT;
+    else if (x > w)
+        flags |= CLIP_PLANE_RIGHT;
+
+    if (y < -w)
+        flags |= CLIP_PLANE_BOTTOM;
+    else if (y > w)
+        flags |= CLIP_PLANE_TOP;
+
+    return flags;
+}
+
+double msSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+TEST(Simd, TransformPoints)
+{
+    std::vector<vertex> verts = randomVertices(POINTS);
+    M44 m = someTransform();
+
+    std::vector<float> x(POINTS), y(POINTS), z(POINTS), w(POINTS);
+    TransformPoints(m, &verts[0].p, sizeof(vertex), POINTS, &x[0], &y[0], &z[0], &w[0]);
+
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        vec3 ref = verts[i].p * m;
+
+        EXPECT_FLOAT_EQ(ref.x, x[i]);
+        EXPECT_FLOAT_EQ(ref.y, y[i]);
+        EXPECT_FLOAT_EQ(ref.z, z[i]);
+        EXPECT_FLOAT_EQ(1.0f, w[i]);
+    }
+
+    // outputs may be skipped
+    std::vector<float> onlyZ(POINTS);
+    TransformPoints(m, &verts[0].p, sizeof(vertex), POINTS, 0, 0, &onlyZ[0], 0);
+    EXPECT_EQ(z, onlyZ);
+}
+
+TEST(Simd, ClipFlags)
+{
+    std::vector<vertex> verts = randomVertices(POINTS);
+    std::vector<float> x(POINTS), y(POINTS), w(POINTS);
+
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        x[i] = verts[i].p.x;
+        y[i] = verts[i].p.y;
+        w[i] = verts[i].p.z;
+    }
+
+    // on the planes
+    x[0] = w[0] = 5.0f;
+    y[1] = -w[1];
+    w[2] = -10.0f; x[2] = 0.0f; y[2] = 20.0f;
+
+    const float nearW = 5.0f;
+    std::vector<uint8_t> flags(POINTS);
+    ClipFlags(&x[0], &y[0], &w[0], POINTS, nearW, &flags[0]);
+
+    for (size_t i = 0; i < POINTS; i++)
+        EXPECT_EQ(clipFlags(x[i], y[i], w[i], nearW), flags[i]) << "point " << i;
+}
+
+TEST(Simd, ClipToScreen)
+{
+    std::vector<vertex> verts = randomVertices(POINTS);
+    std::vector<float> x(POINTS), y(POINTS), w(POINTS);
+
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        x[i] = verts[i].p.x;
+        y[i] = verts[i].p.y;
+        w[i] = fabs(verts[i].p.z) + 1.0f;
+    }
+
+    std::vector<float> sx(POINTS), sy(POINTS);
+    ClipToScreen(&x[0], &y[0], &w[0], POINTS, 319.5f, 319.5f, -239.5f, 239.5f, &sx[0], &sy[0]);
+
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        // screen coordinates are near zero at the corners, compare in pixels
+        EXPECT_NEAR(319.5f * x[i] / w[i] + 319.5f, sx[i], 1E-3f);
+        EXPECT_NEAR(-239.5f * y[i] / w[i] + 239.5f, sy[i], 1E-3f);
+    }
+
+    // in place
+    ClipToScreen(&x[0], &y[0], &w[0], POINTS, 319.5f, 319.5f, -239.5f, 239.5f, &x[0], &y[0]);
+    EXPECT_EQ(sx, x);
+    EXPECT_EQ(sy, y);
+}
+
+TEST(Simd, BackfaceDots)
+{
+    std::vector<vertex> verts = randomVertices(POINTS);
+    vec3 eye(5.0f, -3.0f, -200.0f);
+
+    std::vector<float> dots(POINTS);
+    BackfaceDots(&verts[0].n, sizeof(vertex), &verts[0].p, sizeof(vertex), POINTS, eye, &dots[0]);
+
+    for (size_t i = 0; i < POINTS; i++)
+        EXPECT_FLOAT_EQ(verts[i].n.dotProduct(eye - verts[i].p), dots[i]);
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(Simd, DISABLED_Benchmark)
+{
+    const size_t VERTICES = 1 << 20;
+    const int RUNS = 10;
+
+    std::vector<vertex> verts = randomVertices(VERTICES);
+    M44 m = someTransform();
+    vec3 eye(5.0f, -3.0f, -200.0f);
+
+    std::vector<float> x(VERTICES), y(VERTICES), w(VERTICES), dots(VERTICES);
+    std::vector<uint8_t> flags(VERTICES);
+    double scalar[3] = { 0.0, 0.0, 0.0 }, simd[3] = { 0.0, 0.0, 0.0 };
+
+    for (int run = 0; run < RUNS; run++)
+    {
+        // transformation
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < VERTICES; i++)
+        {
+            vec3 p = verts[i].p * m;
+            x[i] = p.x;
+            y[i] = p.y;
+            w[i] = p.z;
+        }
+        scalar[0] += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        TransformPoints(m, &verts[0].p, sizeof(vertex), VERTICES, &x[0], &y[0], 0, &w[0]);
+        simd[0] += msSince(start);
+
+        // frustum planes
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < VERTICES; i++)
+            flags[i] = (uint8_t)clipFlags(x[i], y[i], w[i], 5.0f);
+        scalar[1] += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        ClipFlags(&x[0], &y[0], &w[0], VERTICES, 5.0f, &flags[0]);
+        simd[1] += msSince(start);
+
+        // back faces
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < VERTICES; i++)
+            dots[i] = verts[i].n.dotProduct(eye - verts[i].p);
+        scalar[2] += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        BackfaceDots(&verts[0].n, sizeof(vertex), &verts[0].p, sizeof(vertex), VERTICES, eye, &dots[0]);
+        simd[2] += msSince(start);
+    }
+
+    const char *names[3] = { "transform", "clip flags", "back faces" };
+    for (int k = 0; k < 3; k++)
+    {
+        printf("[ BENCH    ] %-10s scalar %7.1f Mvert/s, %s %7.1f Mvert/s\n", names[k],
+               VERTICES * RUNS / (scalar[k] * 1000.0), SimdInstructionSet(), VERTICES * RUNS / (simd[k] * 1000.0));
+    }
+
+    EXPECT_GT(SimdWidth(), 1);
+}
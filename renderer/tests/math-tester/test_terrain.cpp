@@ -0,0 +1,211 @@
+/*
+ * test_terrain.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include "stdafx.h"
+#include "terrainsceneobject.h"
+
+using namespace rend;
+
+namespace
+{
+
+//! Exposes the chunk triangulations.
+struct PatternProbe : public TerrainSceneObject
+{
+    enum { BOTTOM_SIDE = BOTTOM, RIGHT_SIDE = RIGHT, TOP_SIDE = TOP, LEFT_SIDE = LEFT, SIDES = SIDES_COUNT };
+
+    typedef int Steps[SIDES_COUNT];
+
+    const VertexBuffer::IndexArray &triangles(int columns, int rows, int level, const Steps &steps)
+    {
+        return pattern(columns, rows, level, steps);
+    }
+};
+
+typedef std::pair<int, int> Segment;
+
+//! Max level, which step divides the chunk and leaves an inner part, as the terrain chooses them.
+int maxLevel(int columns, int rows)
+{
+    int level = 0;
+    for (int step = 2; columns % step == 0 && rows % step == 0 && columns / step >= 2 && rows / step >= 2; step *= 2)
+        level++;
+
+    return level;
+}
+
+//! Max level of the neighbour, which shares the side of the given length.
+int maxSideLevel(int length)
+{
+    int level = 0;
+    for (int step = 2; length % step == 0 && length / step >= 2; step *= 2)
+        level++;
+
+    return level;
+}
+
+//! Edges of the triangles, which lie on the side, by the position along the side.
+std::vector<Segment> sideSegments(const VertexBuffer::IndexArray &indices, int columns, int rows, int side)
+{
+    bool alongX = side == PatternProbe::BOTTOM_SIDE || side == PatternProbe::TOP_SIDE;
+    int line = side == PatternProbe::BOTTOM_SIDE || side == PatternProbe::LEFT_SIDE ? 0 : (alongX ? rows : columns);
+
+    std::vector<Segment> segments;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+            int ax = a % (columns + 1), az = a / (columns + 1);
+            int bx = b % (columns + 1), bz = b / (columns + 1);
+
+            if (alongX && az == line && bz == line)
+                segments.push_back(Segment(std::min(ax, bx), std::max(ax, bx)));
+            else if (!alongX && ax == line && bx == line)
+                segments.push_back(Segment(std::min(az, bz), std::max(az, bz)));
+        }
+    }
+
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+//! Triangles have the same winding and cover every cell of the chunk once.
+void expectCovered(const VertexBuffer::IndexArray &indices, int columns, int rows)
+{
+    ASSERT_EQ(0u, indices.size() % 3);
+
+    std::set<Segment> edges;
+    int doubleArea = 0;
+
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        int x[3], z[3];
+        for (int k = 0; k < 3; k++)
+        {
+            ASSERT_LT(indices[i + k], uint32_t((columns + 1) * (rows + 1)));
+            x[k] = indices[i + k] % (columns + 1);
+            z[k] = indices[i + k] / (columns + 1);
+        }
+
+        int cross = (x[1] - x[0]) * (z[2] - z[0]) - (z[1] - z[0]) * (x[2] - x[0]);
+        ASSERT_LT(cross, 0) << "triangle " << i / 3;
+        doubleArea -= cross;
+
+        // no edge is passed twice in the same direction, so no triangles overlap along it
+        for (int k = 0; k < 3; k++)
+            ASSERT_TRUE(edges.insert(Segment(indices[i + k], indices[i + (k + 1) % 3])).second) << "triangle " << i / 3;
+    }
+
+    EXPECT_EQ(2 * columns * rows, doubleArea);
+
+    // edges without the opposite one are on the chunk border, so there are no holes inside
+    for (const auto &edge : edges)
+    {
+        if (edges.count(Segment(edge.second, edge.first)))
+            continue;
+
+        int ax = edge.first % (columns + 1), az = edge.first / (columns + 1);
+        int bx = edge.second % (columns + 1), bz = edge.second / (columns + 1);
+
+        bool border = (az == bz && (az == 0 || az == rows)) || (ax == bx && (ax == 0 || ax == columns));
+        EXPECT_TRUE(border) << ax << ", " << az << " - " << bx << ", " << bz;
+    }
+}
+
+//! Side is split by the segments of the step from 0 to the length.
+void expectSide(const std::vector<Segment> &segments, int length, int step)
+{
+    ASSERT_EQ(size_t(length / step), segments.size());
+    for (size_t i = 0; i < segments.size(); i++)
+        EXPECT_EQ(Segment((int)i * step, ((int)i + 1) * step), segments[i]);
+}
+
+//! Random steps of the other sides: the neighbours are as fine as the chunk or coarser.
+void randomSteps(PatternProbe::Steps &steps, int columns, int rows, int level)
+{
+    for (int side = 0; side < PatternProbe::SIDES; side++)
+    {
+        bool alongX = side == PatternProbe::BOTTOM_SIDE || side == PatternProbe::TOP_SIDE;
+        int top = maxSideLevel(alongX ? columns : rows);
+        steps[side] = 1 << (level + rand() % (top - level + 1));
+    }
+}
+
+}
+
+TEST(Terrain, NeighbourChunksShareSides)
+{
+    const int SAMPLES = 4;
+
+    srand(11);
+    PatternProbe probe;
+
+    // the last chunk of the row or column may be smaller
+    const Segment sizes[] = { Segment(32, 32), Segment(24, 32), Segment(32, 24), Segment(8, 12) };
+
+    for (const auto &a : sizes)
+    {
+        for (const auto &b : sizes)
+        {
+            // b is on the right of a, or above it
+            for (int vertical = 0; vertical < 2; vertical++)
+            {
+                int lengthA = vertical ? a.first : a.second;
+                int lengthB = vertical ? b.first : b.second;
+                if (lengthA != lengthB)
+                    continue;
+
+                int sideA = vertical ? PatternProbe::TOP_SIDE : PatternProbe::RIGHT_SIDE;
+                int sideB = vertical ? PatternProbe::BOTTOM_SIDE : PatternProbe::LEFT_SIDE;
+
+                for (int levelA = 0; levelA <= maxLevel(a.first, a.second); levelA++)
+                {
+                    for (int levelB = 0; levelB <= maxLevel(b.first, b.second); levelB++)
+                    {
+                        // the side takes the step of the coarser chunk
+                        int step = 1 << std::max(levelA, levelB);
+
+                        for (int sample = 0; sample < SAMPLES; sample++)
+                        {
+                            PatternProbe::Steps stepsA, stepsB;
+                            randomSteps(stepsA, a.first, a.second, levelA);
+                            randomSteps(stepsB, b.first, b.second, levelB);
+                            stepsA[sideA] = stepsB[sideB] = step;
+
+                            SCOPED_TRACE(testing::Message() << a.first << "x" << a.second << " level " << levelA << ", "
+                                                            << b.first << "x" << b.second << " level " << levelB
+                                                            << (vertical ? ", above" : ", on the right"));
+
+                            const VertexBuffer::IndexArray &trianglesA = probe.triangles(a.first, a.second, levelA, stepsA);
+                            const VertexBuffer::IndexArray &trianglesB = probe.triangles(b.first, b.second, levelB, stepsB);
+
+                            expectCovered(trianglesA, a.first, a.second);
+                            expectCovered(trianglesB, b.first, b.second);
+
+                            std::vector<Segment> segmentsA = sideSegments(trianglesA, a.first, a.second, sideA);
+                            std::vector<Segment> segmentsB = sideSegments(trianglesB, b.first, b.second, sideB);
+
+                            expectSide(segmentsA, lengthA, step);
+                            EXPECT_TRUE(segmentsA == segmentsB);
+
+                            // other sides follow their own steps too
+                            for (int side = 0; side < PatternProbe::SIDES; side++)
+                            {
+                                bool alongX = side == PatternProbe::BOTTOM_SIDE || side == PatternProbe::TOP_SIDE;
+                                expectSide(sideSegments(trianglesA, a.first, a.second, side),
+                                           alongX ? a.first : a.second, stepsA[side]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,278 @@
+/*
+ * test_texture.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+#include "stdafx.h"
+#include "texture.h"
+
+using namespace rend;
+
+namespace
+{
+
+// not multiples of the tile size, so the padded tiles are used
+const int WIDTH = 37;
+const int HEIGHT = 23;
+
+std::vector<Color3> randomPixels(int width, int height)
+{
+    std::vector<Color3> res(width * height);
+    srand(42);
+
+    for (auto &c : res)
+        c = Color3(rand() % 256, rand() % 256, rand() % 256);
+
+    return res;
+}
+
+double msSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! Sums 2x2 footprints, like the bilinear filter, along spans of the triangle, which is mapped
+//! to the texture rotated by (dx, dy). The next span starts one texel aside, as the next screen row.
+uint32_t walk(const Texture &texture, float dx, float dy, int spans, int spanLength)
+{
+    uint32_t sum = 0;
+    int mask = texture.width() - 1;
+
+    for (int s = 0; s < spans; s++)
+    {
+        float x = 0.5f - dy * s;
+        float y = 0.5f + dx * s;
+
+        for (int i = 0; i < spanLength; i++)
+        {
+            int xi = int(x) & mask;
+            int yi = int(y) & mask;
+
+            sum += texture.texel(xi, yi) + texture.texel(xi + 1, yi) +
+                   texture.texel(xi, yi + 1) + texture.texel(xi + 1, yi + 1);
+
+            x += dx;
+            y += dy;
+        }
+    }
+
+    return sum;
+}
+
+//! Scalar bilinear filtering with the same 8 bit weights as Texture::sampleBilinear.
+uint32_t referenceBilinear(const Texture &texture, float u, float v)
+{
+    float fu = u * (texture.width() - 1.f);
+    float fv = v * (texture.height() - 1.f);
+    int x = (int)floor(fu);
+    int y = (int)floor(fv);
+    int wu = (int)((fu - floor(fu)) * 256.0f);
+    int wv = (int)((fv - floor(fv)) * 256.0f);
+
+    int w[4];
+    w[0] = (256 - wu) * (256 - wv) >> 8;
+    w[1] = wu * (256 - wv) >> 8;
+    w[2] = (256 - wu) * wv >> 8;
+    w[3] = 256 - w[0] - w[1] - w[2];
+
+    uint32_t t[4] = { texture.texel(x, y), texture.texel(x + 1, y), texture.texel(x, y + 1), texture.texel(x + 1, y + 1) };
+
+    uint32_t res = 0;
+    for (int c = 0; c < 32; c += 8)
+    {
+        uint32_t sum = 0;
+        for (int k = 0; k < 4; k++)
+            sum += ((t[k] >> c) & 0xFF) * w[k];
+        res |= (sum >> 8) << c;
+    }
+
+    return res;
+}
+
+}
+
+TEST(Texture, PackedTexels)
+{
+    std::vector<Color3> pixels = randomPixels(WIDTH, HEIGHT);
+    Texture texture(pixels, WIDTH, HEIGHT);
+
+    for (int y = 0; y < HEIGHT; y++)
+    {
+        for (int x = 0; x < WIDTH; x++)
+            EXPECT_EQ(pixels[y * WIDTH + x].color(), texture.at(x, y).color());
+    }
+
+    EXPECT_EQ(0u, texture.texel(-1, 0));
+    EXPECT_EQ(0u, texture.texel(WIDTH, 0));
+    EXPECT_EQ(0u, texture.texel(0, HEIGHT));
+}
+
+TEST(Texture, TiledLayout)
+{
+    std::vector<Color3> pixels = randomPixels(WIDTH, HEIGHT);
+    Texture texture(pixels, WIDTH, HEIGHT);
+    texture.generateMips();
+
+    Texture linear(pixels, WIDTH, HEIGHT);
+    linear.generateMips();
+
+    texture.setLayout(Texture::TL_TILED);
+    ASSERT_EQ(Texture::TL_TILED, texture.layout());
+    ASSERT_EQ(linear.levels(), texture.levels());
+
+    for (int l = 0; l < texture.levels(); l++)
+    {
+        const Texture *a = linear.level(l);
+        const Texture *b = texture.level(l);
+
+        EXPECT_EQ(Texture::TL_TILED, b->layout());
+        for (int y = 0; y < a->height(); y++)
+        {
+            for (int x = 0; x < a->width(); x++)
+                EXPECT_EQ(a->texel(x, y), b->texel(x, y));
+        }
+    }
+
+    // texels of a tile are neighbours
+    EXPECT_EQ(texture.index(0, 0) + 1, texture.index(1, 0));
+    EXPECT_EQ(texture.index(0, 0) + Texture::TILE_SIZE, texture.index(0, 1));
+
+    texture.setLayout(Texture::TL_LINEAR);
+    for (int y = 0; y < HEIGHT; y++)
+    {
+        for (int x = 0; x < WIDTH; x++)
+            EXPECT_EQ(y * WIDTH + x, texture.index(x, y));
+    }
+
+    auto line = texture.getLine(3);
+    ASSERT_EQ(size_t(WIDTH), line.size());
+    EXPECT_EQ(pixels[3 * WIDTH + 5].color(), line[5].color());
+}
+
+TEST(Texture, Mips)
+{
+    std::vector<uint8_t> values = { 0, 4, 8, 12,
+                                    4, 8, 12, 16 };
+    Texture texture(Texture::TF_R8, values, 4, 2);
+    texture.generateMips();
+
+    ASSERT_EQ(3, texture.levels());
+
+    const Texture *half = texture.level(1);
+    ASSERT_EQ(2, half->width());
+    ASSERT_EQ(1, half->height());
+    EXPECT_EQ(4u, half->at(0, 0)[RED]);
+    EXPECT_EQ(12u, half->at(1, 0)[GREEN]);
+
+    EXPECT_EQ(8u, texture.level(2)->at(0, 0)[BLUE]);
+    EXPECT_EQ(texture.level(2), texture.level(10));
+}
+
+TEST(Texture, SampleBilinear)
+{
+    // odd count, so the wide loop, the 4-wide loop and the tail are all used
+    const size_t POINTS = 1003;
+
+    std::vector<Color3> pixels = randomPixels(WIDTH, HEIGHT);
+    Texture texture(pixels, WIDTH, HEIGHT);
+
+    // a bit out of [0, 1], so the black border is sampled too
+    std::vector<float> u(POINTS), v(POINTS);
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        u[i] = (rand() % 1201 - 100) / 1000.0f;
+        v[i] = (rand() % 1201 - 100) / 1000.0f;
+    }
+
+    for (int layout = 0; layout < 2; layout++)
+    {
+        texture.setLayout(layout ? Texture::TL_TILED : Texture::TL_LINEAR);
+
+        std::vector<uint32_t> colors(POINTS);
+        texture.sampleBilinear(&u[0], &v[0], POINTS, &colors[0]);
+
+        for (size_t i = 0; i < POINTS; i++)
+            EXPECT_EQ(referenceBilinear(texture, u[i], v[i]), colors[i]) << "point " << i << ", layout " << layout;
+    }
+
+    std::vector<uint8_t> values(WIDTH * HEIGHT, 200);
+    Texture gray(Texture::TF_R8, values, WIDTH, HEIGHT);
+
+    uint32_t color;
+    float center = 0.5f;
+    gray.sampleBilinear(&center, &center, 1, &color);
+    EXPECT_EQ(RgbToInt(200, 200, 200), color);
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(Texture, DISABLED_Benchmark)
+{
+    const int SIZE = 1024;
+    const int SPANS = 1024;
+    const int SPAN_LENGTH = 512;
+    const int RUNS = 5;
+
+    std::vector<Color3> pixels = randomPixels(SIZE, SIZE);
+    Texture linear(pixels, SIZE, SIZE);
+    Texture tiled(pixels, SIZE, SIZE);
+    tiled.setLayout(Texture::TL_TILED);
+
+    // unit steps along the rows, the columns and the diagonal
+    const float dirs[3][2] = { { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 0.7071f, 0.7071f } };
+    const char *names[3] = { "horizontal", "vertical", "diagonal" };
+
+    for (int d = 0; d < 3; d++)
+    {
+        double ms[2] = { 0.0, 0.0 };
+        uint32_t sums[2] = { 0, 0 };
+
+        for (int run = 0; run < RUNS; run++)
+        {
+            const Texture *textures[2] = { &linear, &tiled };
+
+            for (int k = 0; k < 2; k++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                sums[k] += walk(*textures[k], dirs[d][0], dirs[d][1], SPANS, SPAN_LENGTH);
+                ms[k] += msSince(start);
+            }
+        }
+
+        EXPECT_EQ(sums[0], sums[1]);
+
+        printf("[ BENCH    ] %-10s linear %7.1f Msamples/s, tiled %7.1f Msamples/s\n", names[d],
+               SPANS * SPAN_LENGTH * RUNS / (ms[0] * 1000.0), SPANS * SPAN_LENGTH * RUNS / (ms[1] * 1000.0));
+    }
+
+    // bilinear filtering, one texel at a time vs the kernel
+    const size_t POINTS = 1 << 20;
+    std::vector<float> u(POINTS), v(POINTS);
+    std::vector<uint32_t> colors(POINTS);
+    for (size_t i = 0; i < POINTS; i++)
+    {
+        u[i] = (float)(i % SPAN_LENGTH) / SPAN_LENGTH;
+        v[i] = (float)(i / SPAN_LENGTH) / (POINTS / SPAN_LENGTH);
+    }
+
+    double scalar = 0.0, simd = 0.0;
+    for (int run = 0; run < RUNS; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < POINTS; i++)
+            colors[i] = referenceBilinear(linear, u[i], v[i]);
+        scalar += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        linear.sampleBilinear(&u[0], &v[0], POINTS, &colors[0]);
+        simd += msSince(start);
+    }
+
+    printf("[ BENCH    ] bilinear   scalar %7.1f Msamples/s, kernel %7.1f Msamples/s\n",
+           POINTS * RUNS / (scalar * 1000.0), POINTS * RUNS / (simd * 1000.0));
+}
@@ -0,0 +1,136 @@
+/*
+ * test_triangle.cpp
+ *
+ *      Author: flamingo
+ *      E-mail: epiforce57@gmail.com
+ */
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <chrono>
+
+#include "stdafx.h"
+#include "poly.h"
+
+using namespace math;
+
+TEST(MaterialRegistry, Handles)
+{
+    rend::MaterialHandle h1, h2;
+    {
+        rend::Material m1, m2;
+        h1 = m1.handle();
+        h2 = m2.handle();
+
+        EXPECT_NE(0u, h1);
+        EXPECT_NE(h1, h2);
+        EXPECT_EQ(&m1, rend::MaterialRegistry::instance().get(h1));
+        EXPECT_EQ(&m2, rend::MaterialRegistry::instance().get(h2));
+    }
+
+    EXPECT_EQ(0, rend::MaterialRegistry::instance().get(h1));
+    EXPECT_EQ(0, rend::MaterialRegistry::instance().get(0));
+
+    // freed handles are reused
+    rend::Material m3;
+    EXPECT_TRUE(m3.handle() == h1 || m3.handle() == h2);
+}
+
+TEST(Triangle, Material)
+{
+    auto material = std::make_shared<rend::Material>();
+    material->shadeMode = rend::Material::SM_GOURAUD;
+
+    Triangle t;
+    EXPECT_EQ(0, t.getMaterial());
+
+    t.setMaterial(material->handle());
+    Triangle copy = t;
+    EXPECT_EQ(material.get(), copy.getMaterial());
+    EXPECT_EQ(rend::Material::SM_GOURAUD, copy.getMaterial()->shadeMode);
+}
+
+namespace
+{
+
+//! Triangle layout before the material handles.
+struct SharedMaterialTriangle
+{
+    vertex verts[3];
+    vec3 normal;
+    sptr(rend::Material) material;
+    bool clipped;
+};
+
+// One frame of the render list: triangles are built from the submesh by several threads (createTriangles),
+// then every stage reads the material of each triangle.
+template<typename T, typename SetFn, typename GetFn>
+double frameTime(std::vector<T> &list, int threads, int frames, SetFn setMaterial, GetFn getMaterial)
+{
+    const int STAGES = 3;   // back faces, lighting, rasterizer
+    size_t chunk = (list.size() + threads - 1) / threads;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int f = 0; f < frames; f++)
+    {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; i++)
+        {
+            workers.push_back(std::thread([&, i]()
+            {
+                T triangle;
+                size_t to = std::min(list.size(), (i + 1) * chunk);
+
+                size_t from = std::min(list.size(), i * chunk);
+
+                for (size_t t = from; t < to; t++)
+                {
+                    setMaterial(triangle);
+                    list[t] = triangle;
+                }
+
+                for (int s = 0; s < STAGES; s++)
+                    for (size_t t = from; t < to; t++)
+                        list[t].clipped = getMaterial(list[t])->sideType == rend::Material::TWO_SIDE;
+            }));
+        }
+
+        for (auto &w : workers)
+            w.join();
+    }
+
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+}
+
+}
+
+// run with --gtest_also_run_disabled_tests
+TEST(Triangle, DISABLED_MaterialHandleBenchmark)
+{
+    // not a multiple of the threads count
+    const size_t TRIANGLES = (1 << 20) + 7;
+    const int FRAMES = 5;
+    const int threads = std::max((int)std::thread::hardware_concurrency(), 2);
+
+    auto material = std::make_shared<rend::Material>();
+
+    std::vector<SharedMaterialTriangle> before(TRIANGLES);
+    double beforeTime = frameTime(before, threads, FRAMES,
+                                  [&](SharedMaterialTriangle &t) { t.material = material; },
+                                  [](const SharedMaterialTriangle &t) -> sptr(rend::Material) { return t.material; });
+
+    std::vector<Triangle> after(TRIANGLES);
+    double afterTime = frameTime(after, threads, FRAMES,
+                                 [&](Triangle &t) { t.setMaterial(material->handle()); },
+                                 [](const Triangle &t) { return t.getMaterial(); });
+
+    printf("[ BENCH    ] %d threads, %d triangles: shared_ptr %.2f ms/frame, handle %.2f ms/frame\n",
+           threads, (int)TRIANGLES, beforeTime, afterTime);
+
+    // every old triangle holds a reference, every new one is built
+    EXPECT_EQ(TRIANGLES + 1, (size_t)material.use_count());
+    EXPECT_EQ(TRIANGLES, (size_t)std::count_if(after.begin(), after.end(),
+                                                [&](const Triangle &t) { return t.getMaterial() == material.get(); }));
+}
@@ -233,6 +233,18 @@ TEST(Matrix3x3, MatrixDeterminant)
     EXPECT_EQ(214, a.determinant());
 }
 
+TEST(Matrix3x3, MatrixMaxScale)
+{
+    // exact for the rotation and the scale
+    M33 a = M33::getScaleMatrix(vec3(2.0f, 5.0f, 3.0f)) * M33::getRotateYMatrix(30.0f);
+    EXPECT_NEAR(5.0f, a.maxScale(), 1E-4);
+
+    // upper bound for the shear
+    M33 b(1, 1, 0, 0, 1, 0, 0, 0, 1);
+    vec3 v(0.6f, 0.8f, 0.0f);
+    EXPECT_GE(b.maxScale(), (v * b).length());
+}
+
 TEST(Matrix3x3, MatrixOperations)
 {
     M33 a(A), b(B);